@@ -0,0 +1,296 @@
+#include "AssetLoader.hpp"
+#include "ChunkFile.hpp"
+#include "FileWatcher.hpp"
+#include "AsyncReader.hpp"
+#include "ThreadPool.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ASSETLOADER_SSE2
+#include <emmintrin.h>
+#endif
+
+#include <chrono>
+#include <future>
+#include <algorithm>
+#include <stdexcept>
+#include <cassert>
+#include <cmath>
+
+AssetLoader::AssetLoader(std::vector< std::string > const &scene_files, std::vector< std::string > const &mesh_files, bool watch) : results(16), quit(false), finished(false) {
+	thread = std::thread(&AssetLoader::run, this, scene_files, mesh_files, watch);
+}
+
+AssetLoader::~AssetLoader() {
+	quit = true;
+	thread.join();
+}
+
+void AssetLoader::run(std::vector< std::string > scene_files, std::vector< std::string > mesh_files, bool watch) {
+	//hand a result to the GL thread, waiting for room in the queue:
+	auto push = [this](std::unique_ptr< Result > &&result) {
+		while (!results.try_push(std::move(result))) {
+			if (quit) return false;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		return true;
+	};
+
+	//parse a blob (on a loader task): scene blobs once their contents have been read, mesh blobs
+	// by opening them on demand (so their vertex data is only ever read straight into the arena):
+	auto parse = [](std::string const &filename, bool is_scene, std::vector< char > &&contents, std::string const &error) {
+		std::unique_ptr< Result > result(new Result);
+		result->filename = filename;
+		try {
+			if (!error.empty()) throw std::runtime_error(error);
+			if (is_scene) {
+				ChunkFile file(filename, std::move(contents));
+				parse_scene(file, &result->scene);
+			} else {
+				result->meshes.reset(new MeshBatch);
+				Meshes::parse(std::unique_ptr< ChunkFile >(new ChunkFile(filename, ChunkFile::OnDemand())), result->meshes.get());
+			}
+		} catch (std::exception &e) {
+			result->meshes.reset();
+			result->error = "Failed to load '" + filename + "': " + e.what();
+		}
+		return result;
+	};
+
+	//(the reader finishes its reads -- which queue loader tasks -- before the loader tasks finish)
+	ThreadPool tasks;
+	AsyncReader reader;
+
+	//read scene blobs all at once (so many reads are in flight), parse each on a loader task as soon as
+	// it arrives (mesh blobs right away), and hand the results to the GL thread in order:
+	auto load = [&](std::vector< std::string > const &filenames, bool reload) {
+		typedef std::promise< std::unique_ptr< Result > > Promise;
+		std::vector< std::future< std::unique_ptr< Result > > > futures;
+		for (auto const &filename : filenames) {
+			bool is_scene = (std::find(scene_files.begin(), scene_files.end(), filename) != scene_files.end());
+			std::shared_ptr< Promise > promise(new Promise);
+			futures.emplace_back(promise->get_future());
+			if (!is_scene) {
+				tasks.run([&parse, filename, promise](){
+					promise->set_value(parse(filename, false, std::vector< char >(), ""));
+				});
+				continue;
+			}
+			reader.read_file(filename, [&tasks, &parse, filename, is_scene, promise](std::vector< char > &&data, std::string const &error) {
+				std::shared_ptr< std::vector< char > > contents(new std::vector< char >(std::move(data)));
+				tasks.run([&parse, filename, is_scene, promise, contents, error](){
+					promise->set_value(parse(filename, is_scene, std::move(*contents), error));
+				});
+			});
+		}
+		for (auto &future : futures) {
+			while (future.wait_for(std::chrono::milliseconds(10)) != std::future_status::ready) {
+				if (quit) return false;
+			}
+			std::unique_ptr< Result > result = future.get();
+			result->reload = reload;
+			if (!push(std::move(result))) return false;
+		}
+		return true;
+	};
+
+	//(start watching before the first read, so changes made during it aren't missed)
+	std::unique_ptr< FileWatcher > watcher;
+	if (watch) {
+		std::vector< std::string > files = scene_files;
+		files.insert(files.end(), mesh_files.begin(), mesh_files.end());
+		watcher.reset(new FileWatcher(files));
+	}
+
+	{ //scene blobs first, then mesh blobs:
+		std::vector< std::string > files = scene_files;
+		files.insert(files.end(), mesh_files.begin(), mesh_files.end());
+		if (!load(files, false)) return;
+	}
+
+	finished.store(true, std::memory_order_release);
+
+	if (!watcher) return;
+	while (!quit) {
+		std::vector< std::string > changed = watcher->poll(std::chrono::milliseconds(100));
+		if (!load(changed, true)) return;
+	}
+}
+
+void AssetLoader::parse_scene(std::string const &filename, std::vector< SceneEntry > *entries) {
+	ChunkFile file(filename);
+	parse_scene(file, entries);
+}
+
+void AssetLoader::parse_scene(ChunkFile &file, std::vector< SceneEntry > *entries) {
+	parse_scene(file, 0, -1U, entries);
+}
+
+//quantized scene entries ('scq0', written by 'scene_pages --quantize'), decoded relative to the
+// box of the page ('pag0') each falls in:
+static void parse_quantized_scene(ChunkFile &file, uint32_t begin, uint32_t end, std::vector< AssetLoader::SceneEntry > *entries_) {
+	assert(entries_);
+	auto &entries = *entries_;
+
+	struct QuantizedEntry {
+		uint16_t position[3]; //fraction of the way across the page's box (in 65535ths)
+		uint16_t mesh; //index in 'scm0'
+		uint32_t rotation; //smallest three: index of the largest component in the top two bits, then the others in 10 bits each
+		uint32_t scale; //index in 'scs0' (entries share scales)
+	};
+	static_assert(sizeof(QuantizedEntry) == 16, "Quantized scene entry should be packed");
+	struct MeshName {
+		uint32_t name_begin, name_end;
+	};
+	static_assert(sizeof(MeshName) == 8, "Mesh name should be packed");
+	struct PageEntry {
+		glm::vec3 min;
+		uint32_t entry_start;
+		glm::vec3 max;
+		uint32_t entry_count;
+	};
+	static_assert(sizeof(PageEntry) == 32, "Page entry should be packed");
+
+	//hash each mesh name once (rather than once per entry):
+	ChunkSpan< char > strings = file.get< char >("str0");
+	std::vector< MeshId > meshes;
+	for (MeshName const &name : file.get< MeshName >("scm0")) {
+		if (!(name.name_begin <= name.name_end && name.name_end <= strings.size())) {
+			throw std::runtime_error("mesh name has out-of-range begin/end");
+		}
+		meshes.emplace_back(strings.begin() + name.name_begin, strings.begin() + name.name_end);
+	}
+	ChunkSpan< glm::vec3 > scales = file.get< glm::vec3 >("scs0");
+
+	size_t count = file.count< QuantizedEntry >("scq0");
+	if (end == -1U) end = uint32_t(count);
+	if (!(begin <= end && end <= count)) {
+		throw std::runtime_error("scene entry range is out of bounds");
+	}
+	//(just the range, so a page of a huge scene opened on demand reads only its own entries)
+	std::vector< QuantizedEntry > storage;
+	ChunkSpan< QuantizedEntry > data = file.get_range< QuantizedEntry >("scq0", begin, end - begin, &storage);
+	if (!file.has("pag0")) {
+		throw std::runtime_error("quantized scene entries have no pages to be decoded against");
+	}
+	ChunkSpan< PageEntry > pages = file.get< PageEntry >("pag0");
+
+	//first page holding entry 'begin' (pages are in entry order):
+	PageEntry const *page = std::upper_bound(pages.begin(), pages.end(), begin, [](uint32_t at, PageEntry const &p) {
+		return at < p.entry_start;
+	});
+	if (page != pages.begin()) --page;
+
+	//(the entries' rotations are decoded from the smallest three: +/-(1/sqrt(2)) maps to 0/1023)
+	float const Half = 1.0f / std::sqrt(2.0f);
+	float const Step = 2.0f * Half / 1023.0f;
+
+	entries.reserve(entries.size() + (end - begin));
+	for (uint32_t at = begin; at < end; ++page) {
+		if (page == pages.end() || !(page->entry_start <= at && at - page->entry_start < page->entry_count)) {
+			throw std::runtime_error("quantized scene entries aren't covered by pages");
+		}
+		uint32_t page_end = at + std::min(end - at, page->entry_count - (at - page->entry_start));
+		glm::vec3 min = page->min;
+		glm::vec3 step = (page->max - page->min) * (1.0f / 65535.0f);
+		for (; at < page_end; ++at) {
+			QuantizedEntry const &entry = data[at - begin];
+			if (entry.mesh >= meshes.size()) {
+				throw std::runtime_error("quantized scene entry has out-of-range mesh");
+			}
+			if (entry.scale >= scales.size()) {
+				throw std::runtime_error("quantized scene entry has out-of-range scale");
+			}
+			entries.emplace_back();
+			AssetLoader::SceneEntry &out = entries.back();
+			out.mesh = meshes[entry.mesh];
+			out.scale = scales[entry.scale];
+			uint32_t largest = entry.rotation >> 30;
+
+			#ifdef ASSETLOADER_SSE2
+			__m128i packed = _mm_loadu_si128(reinterpret_cast< __m128i const * >(&entry));
+			//position: min + step * quantized (the mesh lands in the unused fourth lane):
+			__m128 position = _mm_add_ps(_mm_setr_ps(min.x, min.y, min.z, 0.0f),
+				_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(packed, _mm_setzero_si128())), _mm_setr_ps(step.x, step.y, step.z, 0.0f)));
+			//rotation: the three small components in lanes 0-2 (kept in place, so the conversion is exact), the largest in lane 3:
+			__m128i bits = _mm_and_si128(_mm_shuffle_epi32(packed, _MM_SHUFFLE(2, 2, 2, 2)), _mm_setr_epi32(0x3ff, 0x3ff << 10, 0x3ff << 20, 0));
+			__m128 small = _mm_sub_ps(
+				_mm_mul_ps(_mm_cvtepi32_ps(bits), _mm_setr_ps(Step, Step / 1024.0f, Step / (1024.0f * 1024.0f), 0.0f)),
+				_mm_setr_ps(Half, Half, Half, 0.0f));
+			__m128 squares = _mm_mul_ps(small, small);
+			squares = _mm_add_ps(squares, _mm_shuffle_ps(squares, squares, _MM_SHUFFLE(2, 3, 0, 1)));
+			squares = _mm_add_ps(squares, _mm_shuffle_ps(squares, squares, _MM_SHUFFLE(1, 0, 3, 2)));
+			__m128 big = _mm_sqrt_ps(_mm_max_ps(_mm_setzero_ps(), _mm_sub_ps(_mm_set1_ps(1.0f), squares)));
+			__m128 rotation = _mm_add_ps(small, _mm_and_ps(big, _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1))));
+			//move the largest component into its place:
+			if (largest == 0) rotation = _mm_shuffle_ps(rotation, rotation, _MM_SHUFFLE(2, 1, 0, 3));
+			else if (largest == 1) rotation = _mm_shuffle_ps(rotation, rotation, _MM_SHUFFLE(2, 1, 3, 0));
+			else if (largest == 2) rotation = _mm_shuffle_ps(rotation, rotation, _MM_SHUFFLE(2, 3, 1, 0));
+			float lanes[8];
+			_mm_storeu_ps(lanes, position);
+			_mm_storeu_ps(lanes + 4, rotation);
+			out.position = glm::vec3(lanes[0], lanes[1], lanes[2]);
+			for (uint32_t c = 0; c < 4; ++c) {
+				out.rotation[c] = lanes[4 + c];
+			}
+			#else
+			out.position = min + step * glm::vec3(entry.position[0], entry.position[1], entry.position[2]);
+			float sum = 0.0f;
+			for (uint32_t c = 0, small = 0; c < 4; ++c) {
+				if (c == largest) continue;
+				float value = float((entry.rotation >> (10 * small)) & 0x3ff) * Step - Half;
+				out.rotation[c] = value;
+				sum += value * value;
+				small += 1;
+			}
+			out.rotation[largest] = std::sqrt(std::max(0.0f, 1.0f - sum));
+			#endif
+		}
+	}
+
+	file.release(reinterpret_cast< char const * >(data.begin()), sizeof(QuantizedEntry) * data.size());
+}
+
+void AssetLoader::parse_scene(ChunkFile &file, uint32_t begin, uint32_t end, std::vector< SceneEntry > *entries_) {
+	assert(entries_);
+	auto &entries = *entries_;
+
+	if (file.has("scq0")) {
+		parse_quantized_scene(file, begin, end, entries_);
+		return;
+	}
+
+	//read strings chunk:
+	ChunkSpan< char > strings = file.get< char >("str0");
+
+	{ //read scene chunk:
+		struct SceneEntry {
+			uint32_t name_begin, name_end;
+			glm::vec3 position;
+			glm::quat rotation;
+			glm::vec3 scale;
+		};
+		static_assert(sizeof(SceneEntry) == 48, "Scene entry should be packed");
+
+		size_t count = file.count< SceneEntry >("scn0");
+		if (end == -1U) end = uint32_t(count);
+		if (!(begin <= end && end <= count)) {
+			throw std::runtime_error("scene entry range is out of bounds");
+		}
+		std::vector< SceneEntry > storage;
+		ChunkSpan< SceneEntry > data = file.get_range< SceneEntry >("scn0", begin, end - begin, &storage);
+
+		entries.reserve(entries.size() + data.size());
+		for (auto const &entry : data) {
+			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
+				throw std::runtime_error("index entry has out-of-range name begin/end");
+			}
+			entries.emplace_back();
+			entries.back().mesh = MeshId(strings.begin() + entry.name_begin, strings.begin() + entry.name_end);
+			entries.back().position = entry.position;
+			entries.back().rotation = entry.rotation;
+			entries.back().scale = entry.scale;
+		}
+		//(the stored entries aren't needed again, so a big mapped scene needn't stay resident)
+		file.release(reinterpret_cast< char const * >(data.begin()), sizeof(SceneEntry) * data.size());
+	}
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Meshes.hpp"
+#include "MeshId.hpp"
+#include "SPSCQueue.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+//"AssetLoader" reads and validates scene and mesh blobs on a background thread.
+// Every scene blob's reads are queued at once (through AsyncReader), and each blob is parsed
+// on a loader task as soon as it has arrived. Mesh blobs are opened on demand instead (see
+// ChunkFile): their index data is read in, but their vertex data stays on disk until the
+// upload reads it straight into the geometry arena, so it is never held in memory whole.
+// Each finished blob is handed to the GL thread -- in order -- through a lock-free queue;
+// call poll() once per frame to pick them up (and upload them).
+// If asked to watch, it keeps running after the first load and re-reads any blob
+// that is rewritten on disk (e.g., by the export scripts), marking those results as reloads.
+
+struct AssetLoader {
+	//a scene.blob entry, with its mesh name already hashed:
+	struct SceneEntry {
+		MeshId mesh;
+		glm::vec3 position;
+		glm::quat rotation;
+		glm::vec3 scale;
+	};
+
+	//one finished blob:
+	struct Result {
+		std::string filename;
+		std::unique_ptr< MeshBatch > meshes; //set for mesh blobs
+		std::vector< SceneEntry > scene; //filled for scene blobs
+		std::string error; //non-empty if reading the blob failed
+		bool reload = false; //blob was re-read because it changed after being loaded
+	};
+
+	//start reading the scene blobs and then the mesh blobs (in order) on a new thread:
+	AssetLoader(std::vector< std::string > const &scene_files, std::vector< std::string > const &mesh_files, bool watch = false);
+	//stops reading (if still going) and joins the thread:
+	~AssetLoader();
+	AssetLoader(AssetLoader const &) = delete;
+	AssetLoader &operator=(AssetLoader const &) = delete;
+
+	//GL thread: take the next finished blob, if there is one:
+	bool poll(std::unique_ptr< Result > *result) { return results.try_pop(result); }
+
+	//GL thread: true once every blob has been read (once) and poll()'d:
+	bool done() const { return finished.load(std::memory_order_acquire) && results.empty(); }
+
+	//read scene.blob-style entries from a file:
+	// note: will throw if file fails to read.
+	static void parse_scene(std::string const &filename, std::vector< SceneEntry > *entries);
+	static void parse_scene(ChunkFile &file, std::vector< SceneEntry > *entries);
+	//read entries [begin, end) of a scene blob (e.g., one of its pages; see ScenePager), then
+	// release their storage (see ChunkFile::release):
+	// (blobs may instead hold 16-byte quantized entries -- see 'scene_pages --quantize' -- which are decoded with SSE2 where available)
+	// note: will throw if the range or any of its entries is malformed.
+	static void parse_scene(ChunkFile &file, uint32_t begin, uint32_t end, std::vector< SceneEntry > *entries);
+
+	//internals:
+	void run(std::vector< std::string > scene_files, std::vector< std::string > mesh_files, bool watch);
+	SPSCQueue< std::unique_ptr< Result > > results;
+	std::atomic< bool > quit;
+	std::atomic< bool > finished;
+	std::thread thread;
+};
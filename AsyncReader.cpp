@@ -0,0 +1,323 @@
+#include "AsyncReader.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//io_uring is used directly (through syscalls), so it needs only the kernel headers:
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define ASYNC_READER_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#endif
+#endif
+
+#include <iostream>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <cassert>
+
+struct AsyncReader::Read {
+	intptr_t file; //fd (or HANDLE on Windows)
+	uint64_t offset;
+	char *to;
+	size_t size; //bytes still to read
+	std::function< void(bool ok) > done;
+	#ifdef ASYNC_READER_URING
+	iovec iov;
+	#endif
+};
+
+//blocking reads use at most this many threads:
+static constexpr uint32_t MaxFallbackThreads = 16;
+
+AsyncReader::AsyncReader(uint32_t depth_) : depth(std::max(1U, depth_)) {
+	#ifdef ASYNC_READER_URING
+	io_uring_params params;
+	std::memset(&params, 0, sizeof(params));
+	ring_fd = int(syscall(__NR_io_uring_setup, depth, &params));
+	if (ring_fd != -1) {
+		//map the submission ring, completion ring, and submission entries:
+		sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+		cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		if (params.features & IORING_FEAT_SINGLE_MMAP) {
+			sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+		}
+		sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+		sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+		if (sq_ring != MAP_FAILED) {
+			cq_ring = (params.features & IORING_FEAT_SINGLE_MMAP) ? sq_ring
+				: mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+		}
+		if (sq_ring != MAP_FAILED && cq_ring != MAP_FAILED) {
+			sqes = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+		}
+		if (sq_ring == MAP_FAILED || cq_ring == MAP_FAILED || sqes == MAP_FAILED) {
+			if (sq_ring != MAP_FAILED) munmap(sq_ring, sq_ring_size);
+			if (cq_ring != MAP_FAILED && cq_ring != sq_ring) munmap(cq_ring, cq_ring_size);
+			sq_ring = cq_ring = sqes = nullptr;
+			close(ring_fd);
+			ring_fd = -1;
+		}
+	}
+	if (ring_fd != -1) {
+		char *sq = static_cast< char * >(sq_ring);
+		sq_head = reinterpret_cast< uint32_t * >(sq + params.sq_off.head);
+		sq_tail = reinterpret_cast< uint32_t * >(sq + params.sq_off.tail);
+		sq_mask = reinterpret_cast< uint32_t * >(sq + params.sq_off.ring_mask);
+		sq_array = reinterpret_cast< uint32_t * >(sq + params.sq_off.array);
+		char *cq = static_cast< char * >(cq_ring);
+		cq_head = reinterpret_cast< uint32_t * >(cq + params.cq_off.head);
+		cq_tail = reinterpret_cast< uint32_t * >(cq + params.cq_off.tail);
+		cq_mask = reinterpret_cast< uint32_t * >(cq + params.cq_off.ring_mask);
+		cqes = cq + params.cq_off.cqes;
+		//(the kernel may round the queue up, but never keep more in flight than asked)
+		depth = std::min(depth, params.sq_entries);
+		completions = std::thread(&AsyncReader::reap, this);
+		return;
+	}
+	std::cerr << "NOTE: io_uring unavailable; reading files on a thread pool instead." << std::endl;
+	#endif
+	pool.reset(new ThreadPool(std::min(depth, MaxFallbackThreads)));
+}
+
+AsyncReader::~AsyncReader() {
+	wait();
+	#ifdef ASYNC_READER_URING
+	if (ring_fd != -1) {
+		//a no-op with no Read attached tells the completion thread to stop:
+		{
+			std::unique_lock< std::mutex > lock(mutex);
+			uint32_t tail = *sq_tail;
+			uint32_t index = tail & *sq_mask;
+			io_uring_sqe &sqe = static_cast< io_uring_sqe * >(sqes)[index];
+			std::memset(&sqe, 0, sizeof(sqe));
+			sqe.opcode = IORING_OP_NOP;
+			sqe.user_data = 0;
+			sq_array[index] = index;
+			__atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+			if (!enter(tail)) {
+				//(nothing else will wake the completion thread, so leave it -- and the ring it reads -- be)
+				completions.detach();
+				pool.reset();
+				return;
+			}
+		}
+		completions.join();
+		munmap(sqes, sqes_size);
+		if (cq_ring != sq_ring) munmap(cq_ring, cq_ring_size);
+		munmap(sq_ring, sq_ring_size);
+		close(ring_fd);
+	}
+	#endif
+	pool.reset();
+}
+
+void AsyncReader::read_file(std::string const &filename, FileDone const &done) {
+	//open the file and get its size:
+	intptr_t file = -1;
+	uint64_t size = 0;
+	#ifdef _WIN32
+	HANDLE handle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	LARGE_INTEGER file_size;
+	if (handle != INVALID_HANDLE_VALUE && GetFileSizeEx(handle, &file_size)) {
+		file = reinterpret_cast< intptr_t >(handle);
+		size = uint64_t(file_size.QuadPart);
+	} else if (handle != INVALID_HANDLE_VALUE) {
+		CloseHandle(handle);
+	}
+	#else
+	int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+	struct stat st;
+	if (fd != -1 && fstat(fd, &st) == 0) {
+		file = fd;
+		size = uint64_t(st.st_size);
+	} else if (fd != -1) {
+		close(fd);
+	}
+	#endif
+	if (file == -1) {
+		done(std::vector< char >(), "Failed to open '" + filename + "'.");
+		return;
+	}
+
+	//pieces share the file's buffer; the last one to finish closes the file and calls 'done':
+	struct FileRead {
+		intptr_t file;
+		std::vector< char > data;
+		std::atomic< size_t > remaining;
+		std::atomic< bool > failed;
+		std::string filename;
+		FileDone done;
+		void finish() {
+			#ifdef _WIN32
+			CloseHandle(reinterpret_cast< HANDLE >(file));
+			#else
+			close(int(file));
+			#endif
+			if (failed) done(std::vector< char >(), "Failed to read '" + filename + "'.");
+			else done(std::move(data), "");
+		}
+	};
+	std::shared_ptr< FileRead > file_read(new FileRead);
+	file_read->file = file;
+	file_read->data.resize(size_t(size));
+	file_read->remaining = size_t((size + PieceSize - 1) / PieceSize);
+	file_read->failed = false;
+	file_read->filename = filename;
+	file_read->done = done;
+	if (size == 0) {
+		file_read->finish();
+		return;
+	}
+
+	for (uint64_t offset = 0; offset < size; offset += PieceSize) {
+		Read *read = new Read;
+		read->file = file;
+		read->offset = offset;
+		read->to = file_read->data.data() + offset;
+		read->size = size_t(std::min< uint64_t >(PieceSize, size - offset));
+		read->done = [file_read](bool ok) {
+			if (!ok) file_read->failed = true;
+			if (--file_read->remaining == 0) file_read->finish();
+		};
+		submit(read, false);
+	}
+}
+
+void AsyncReader::wait() {
+	std::unique_lock< std::mutex > lock(mutex);
+	read_finished.wait(lock, [this](){ return in_flight == 0; });
+}
+
+void AsyncReader::submit(Read *read, bool resubmit) {
+	std::unique_lock< std::mutex > lock(mutex);
+	if (!resubmit) {
+		//(a resubmitted read is already counted as in flight)
+		read_finished.wait(lock, [this](){ return in_flight < depth; });
+		++in_flight;
+	}
+	#ifdef ASYNC_READER_URING
+	if (ring_fd != -1) {
+		read->iov.iov_base = read->to;
+		read->iov.iov_len = read->size;
+		uint32_t tail = *sq_tail;
+		uint32_t index = tail & *sq_mask;
+		io_uring_sqe &sqe = static_cast< io_uring_sqe * >(sqes)[index];
+		std::memset(&sqe, 0, sizeof(sqe));
+		sqe.opcode = IORING_OP_READV; //(rather than IORING_OP_READ, which needs a newer kernel)
+		sqe.fd = int(read->file);
+		sqe.off = read->offset;
+		sqe.addr = reinterpret_cast< uint64_t >(&read->iov);
+		sqe.len = 1;
+		sqe.user_data = reinterpret_cast< uint64_t >(read);
+		sq_array[index] = index;
+		__atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+		if (enter(tail)) return;
+		//(the ring refused the read, so do it here instead -- it must still finish, or wait() never returns)
+		lock.unlock();
+		read_blocking(read);
+		return;
+	}
+	#endif
+	lock.unlock();
+	pool->run([this, read](){ read_blocking(read); });
+}
+
+bool AsyncReader::enter(uint32_t tail) {
+	#ifdef ASYNC_READER_URING
+	while (syscall(__NR_io_uring_enter, ring_fd, 1, 0, 0, nullptr, 0) == -1) {
+		if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+			std::this_thread::yield();
+			continue;
+		}
+		//(a failed enter consumes nothing, so take the entry back; otherwise the next enter would submit it)
+		std::cerr << "WARNING: io_uring_enter failed (" << std::strerror(errno) << ")." << std::endl;
+		__atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+		return false;
+	}
+	return true;
+	#else
+	(void)tail;
+	return false;
+	#endif
+}
+
+void AsyncReader::finish(Read *read, bool ok) {
+	read->done(ok);
+	delete read;
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		--in_flight;
+	}
+	read_finished.notify_all();
+}
+
+void AsyncReader::read_blocking(Read *read) {
+	while (read->size > 0) {
+		#ifdef _WIN32
+		OVERLAPPED overlapped;
+		std::memset(&overlapped, 0, sizeof(overlapped));
+		overlapped.Offset = DWORD(read->offset);
+		overlapped.OffsetHigh = DWORD(read->offset >> 32);
+		DWORD got = 0;
+		DWORD want = DWORD(std::min< size_t >(read->size, 0x40000000));
+		if (!ReadFile(reinterpret_cast< HANDLE >(read->file), read->to, want, &got, &overlapped) || got == 0) {
+			finish(read, false);
+			return;
+		}
+		#else
+		ssize_t got = pread(int(read->file), read->to, read->size, off_t(read->offset));
+		if (got == -1 && errno == EINTR) continue;
+		if (got <= 0) {
+			finish(read, false);
+			return;
+		}
+		#endif
+		read->offset += uint64_t(got);
+		read->to += got;
+		read->size -= size_t(got);
+	}
+	finish(read, true);
+}
+
+void AsyncReader::reap() {
+	#ifdef ASYNC_READER_URING
+	while (true) {
+		uint32_t head = *cq_head;
+		if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+			syscall(__NR_io_uring_enter, ring_fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+			continue;
+		}
+		io_uring_cqe cqe = static_cast< io_uring_cqe * >(cqes)[head & *cq_mask];
+		__atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+		if (cqe.user_data == 0) return; //(the destructor's no-op)
+
+		Read *read = reinterpret_cast< Read * >(cqe.user_data);
+		if (cqe.res == -EINTR || cqe.res == -EAGAIN) {
+			submit(read, true);
+		} else if (cqe.res <= 0) {
+			finish(read, false);
+		} else if (size_t(cqe.res) < read->size) {
+			//short read, so ask for the rest:
+			read->offset += uint64_t(cqe.res);
+			read->to += cqe.res;
+			read->size -= size_t(cqe.res);
+			submit(read, true);
+		} else {
+			finish(read, true);
+		}
+	}
+	#endif
+}
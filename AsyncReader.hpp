@@ -0,0 +1,68 @@
+#pragma once
+
+#include "ThreadPool.hpp"
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstdint>
+#include <cstddef>
+
+//"AsyncReader" keeps many file reads in flight at once -- through io_uring on Linux (when
+// the kernel allows it), or else through a pool of threads doing positioned reads -- so
+// loading from a slow disk runs at the device's queue depth rather than one read at a time.
+// Completion callbacks run on the reader's own threads, so they should be short
+// (e.g., handing the data to a loader task).
+
+struct AsyncReader {
+	//keep up to 'depth' reads in flight:
+	AsyncReader(uint32_t depth = 64);
+	//waits for reads in flight, then stops:
+	~AsyncReader();
+	AsyncReader(AsyncReader const &) = delete;
+	AsyncReader &operator=(AsyncReader const &) = delete;
+
+	//read a whole file, as PieceSize pieces all queued at once; done(data, error) is called
+	// (on a reader thread, or right away if the file fails to open) once the last piece arrives:
+	// (error is empty on success; may wait for room in the queue)
+	typedef std::function< void(std::vector< char > &&data, std::string const &error) > FileDone;
+	void read_file(std::string const &filename, FileDone const &done);
+
+	//wait until no reads are in flight:
+	void wait();
+
+	//true if reads go through io_uring:
+	bool uring() const { return ring_fd != -1; }
+
+	static constexpr size_t PieceSize = 1 << 20;
+
+	//internals:
+	struct Read; //one read in flight (defined in AsyncReader.cpp)
+	void submit(Read *read, bool resubmit);
+	//(io_uring) submit the entry queued at 'tail' (with 'mutex' held); on failure, takes it back off the ring:
+	bool enter(uint32_t tail);
+	void finish(Read *read, bool ok);
+	void read_blocking(Read *read);
+
+	uint32_t depth;
+	std::mutex mutex;
+	std::condition_variable read_finished;
+	uint32_t in_flight = 0;
+
+	//io_uring state (Linux only):
+	int ring_fd = -1;
+	void *sq_ring = nullptr, *cq_ring = nullptr, *sqes = nullptr;
+	size_t sq_ring_size = 0, cq_ring_size = 0, sqes_size = 0;
+	uint32_t *sq_head = nullptr, *sq_tail = nullptr, *sq_mask = nullptr, *sq_array = nullptr;
+	uint32_t *cq_head = nullptr, *cq_tail = nullptr, *cq_mask = nullptr;
+	void *cqes = nullptr;
+	std::thread completions; //reaps io_uring completions
+	void reap();
+
+	//fallback state:
+	std::unique_ptr< ThreadPool > pool;
+};
@@ -0,0 +1,426 @@
+#include "ChunkFile.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <cerrno>
+#include <limits>
+
+#ifndef _WIN32
+//(in nanoseconds, so rewrites within the same second are seen)
+static uint64_t modification_time(struct stat const &st) {
+	#ifdef __APPLE__
+	return uint64_t(st.st_mtimespec.tv_sec) * 1000000000ULL + uint64_t(st.st_mtimespec.tv_nsec);
+	#else
+	return uint64_t(st.st_mtim.tv_sec) * 1000000000ULL + uint64_t(st.st_mtim.tv_nsec);
+	#endif
+}
+#endif
+
+ChunkFile::ChunkFile(std::string const &filename_) : filename(filename_) {
+	#ifdef _WIN32
+	file_handle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file_handle == INVALID_HANDLE_VALUE) {
+		file_handle = nullptr;
+		throw std::runtime_error("Failed to open '" + filename + "'.");
+	}
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file_handle, &file_size)) {
+		CloseHandle(file_handle);
+		throw std::runtime_error("Failed to get size of '" + filename + "'.");
+	}
+	size = size_t(file_size.QuadPart);
+	if (size != 0) {
+		mapping_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping_handle) {
+			data = reinterpret_cast< char const * >(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+		}
+		if (!data) {
+			if (mapping_handle) CloseHandle(mapping_handle);
+			CloseHandle(file_handle);
+			throw std::runtime_error("Failed to map '" + filename + "'.");
+		}
+	}
+	#else
+	fd = open(filename.c_str(), O_RDONLY);
+	if (fd == -1) {
+		throw std::runtime_error("Failed to open '" + filename + "'.");
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		throw std::runtime_error("Failed to get size of '" + filename + "'.");
+	}
+	size = size_t(st.st_size);
+	if (size != 0) {
+		void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapped == MAP_FAILED) {
+			close(fd);
+			throw std::runtime_error("Failed to map '" + filename + "'.");
+		}
+		//the whole file is about to be read front-to-back:
+		madvise(mapped, size, MADV_WILLNEED);
+		data = reinterpret_cast< char const * >(mapped);
+	}
+	#endif
+
+	try {
+		build_directory();
+	} catch (...) {
+		unmap();
+		throw;
+	}
+}
+
+ChunkFile::ChunkFile(std::string const &filename_, std::vector< char > &&contents_) : filename(filename_), contents(std::move(contents_)) {
+	size = contents.size();
+	if (size != 0) data = contents.data();
+	build_directory();
+}
+
+ChunkFile::ChunkFile(std::string const &filename_, OnDemand) : filename(filename_), on_demand(true) {
+	#ifdef _WIN32
+	file_handle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file_handle == INVALID_HANDLE_VALUE) {
+		file_handle = nullptr;
+		throw std::runtime_error("Failed to open '" + filename + "'.");
+	}
+	LARGE_INTEGER file_size;
+	FILETIME written;
+	if (!GetFileSizeEx(file_handle, &file_size) || !GetFileTime(file_handle, NULL, NULL, &written)) {
+		CloseHandle(file_handle);
+		throw std::runtime_error("Failed to get size of '" + filename + "'.");
+	}
+	size = size_t(file_size.QuadPart);
+	opened_time = (uint64_t(written.dwHighDateTime) << 32) | written.dwLowDateTime;
+	#else
+	fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		throw std::runtime_error("Failed to open '" + filename + "'.");
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		throw std::runtime_error("Failed to get size of '" + filename + "'.");
+	}
+	size = size_t(st.st_size);
+	opened_time = modification_time(st);
+	#endif
+
+	try {
+		build_directory();
+	} catch (...) {
+		unmap();
+		throw;
+	}
+}
+
+ChunkFile::~ChunkFile() {
+	unmap();
+}
+
+void ChunkFile::unmap() {
+	if (!contents.empty()) { //(nothing mapped)
+		data = nullptr;
+		return;
+	}
+	#ifdef _WIN32
+	if (data) UnmapViewOfFile(data);
+	if (mapping_handle) CloseHandle(mapping_handle);
+	if (file_handle) CloseHandle(file_handle);
+	mapping_handle = file_handle = nullptr;
+	#else
+	if (data) munmap(const_cast< char * >(data), size);
+	if (fd != -1) close(fd);
+	fd = -1;
+	#endif
+	data = nullptr;
+}
+
+void ChunkFile::build_directory() {
+	//read the header at 'at' and check that the payload fits in the file:
+	auto header_at = [this](uint64_t at, std::string *magic) -> ChunkInfo {
+		ChunkHeader header;
+		ChunkHeaderExtension extension;
+		if (at > size || size - at < sizeof(header)) {
+			throw std::runtime_error("Failed to read chunk header in '" + filename + "'");
+		}
+		read_at(at, &header, sizeof(header));
+		if (header.size == ChunkSizeExtended) {
+			if (size - at - sizeof(header) < sizeof(extension)) {
+				throw std::runtime_error("Failed to read chunk header extension in '" + filename + "'");
+			}
+			read_at(at + sizeof(header), &extension, sizeof(extension));
+		}
+		ChunkInfo info = chunk_info(header, extension);
+		if (size - at - info.header_size < info.size) {
+			throw std::runtime_error("Chunk data runs past end of '" + filename + "'");
+		}
+		*magic = std::string(header.magic, 4);
+		return info;
+	};
+
+	//add a chunk listed in a table of contents, checking it against its header:
+	auto add_listed = [&](char const magic[4], uint64_t offset, uint64_t stored_size, uint32_t flags) {
+		std::string header_magic;
+		ChunkInfo info = header_at(offset, &header_magic);
+		if (header_magic != std::string(magic, 4) || info.size != stored_size
+			|| (info.flags & ChunkFlagCompressed) != (flags & ChunkFlagCompressed)) {
+			throw std::runtime_error("Table of contents entry doesn't match chunk header in '" + filename + "'");
+		}
+		Entry entry;
+		entry.magic = header_magic;
+		entry.begin = size_t(offset + info.header_size);
+		entry.size = size_t(stored_size);
+		entry.flags = flags;
+		directory.emplace_back(entry);
+	};
+
+	if (size == 0) return;
+
+	std::string first_magic;
+	ChunkInfo first = header_at(0, &first_magic);
+	if (first_magic == "toc0") {
+		//table of contents present, so just check + copy its entries:
+		if (first.size % sizeof(TocEntry) != 0) {
+			throw std::runtime_error("Size of toc0 chunk not divisible by entry size");
+		}
+		std::vector< TocEntry > toc(size_t(first.size / sizeof(TocEntry)));
+		read_at(first.header_size, toc.data(), sizeof(TocEntry) * toc.size());
+		directory.reserve(toc.size());
+		for (TocEntry const &entry : toc) {
+			add_listed(entry.magic, entry.offset, entry.size, entry.flags);
+		}
+	} else if (first_magic == "toc1") {
+		//64-bit table of contents:
+		if (first.size % sizeof(TocEntry64) != 0) {
+			throw std::runtime_error("Size of toc1 chunk not divisible by entry size");
+		}
+		std::vector< TocEntry64 > toc(size_t(first.size / sizeof(TocEntry64)));
+		read_at(first.header_size, toc.data(), sizeof(TocEntry64) * toc.size());
+		directory.reserve(toc.size());
+		for (TocEntry64 const &entry : toc) {
+			add_listed(entry.magic, entry.offset, entry.size, entry.flags);
+		}
+	} else {
+		//no table of contents, so hop from header to header:
+		for (size_t at = 0; at < size; ) {
+			Entry entry;
+			ChunkInfo info = header_at(at, &entry.magic);
+			entry.begin = at + info.header_size;
+			entry.size = size_t(info.size);
+			entry.flags = info.flags;
+			directory.emplace_back(entry);
+			at = entry.begin + entry.size;
+		}
+	}
+}
+
+ChunkFile::Entry const *ChunkFile::find(std::string const &magic) const {
+	for (auto const &entry : directory) {
+		if (entry.magic == magic) return &entry;
+	}
+	return nullptr;
+}
+
+void ChunkFile::release(char const *begin, size_t bytes) const {
+	#ifndef _WIN32
+	if (!contents.empty() || !data || !(data <= begin && begin + bytes <= data + size)) return;
+	//(only whole pages inside the range, so neighbouring data stays put)
+	uintptr_t page = uintptr_t(sysconf(_SC_PAGESIZE));
+	uintptr_t first = (reinterpret_cast< uintptr_t >(begin) + page - 1) / page * page;
+	uintptr_t last = (reinterpret_cast< uintptr_t >(begin) + bytes) / page * page;
+	if (first < last) {
+		madvise(reinterpret_cast< void * >(first), last - first, MADV_DONTNEED);
+	}
+	#else
+	(void)begin;
+	(void)bytes;
+	#endif
+}
+
+char const *ChunkFile::inflate(Entry const &entry, size_t *bytes) {
+	auto found = payloads.find(entry.begin);
+	if (found == payloads.end()) {
+		std::vector< char > read_body;
+		char const *body = data + entry.begin;
+		if (!data) {
+			read_body.resize(entry.size);
+			read_at(entry.begin, read_body.data(), read_body.size());
+			body = read_body.data();
+		}
+		uint64_t inflated_bytes = inflated_size(body, entry.size);
+		if (inflated_bytes > std::numeric_limits< size_t >::max()) {
+			throw std::runtime_error("Compressed '" + entry.magic + "' chunk in '" + filename + "' is too big to inflate.");
+		}
+		copies.emplace_back(size_t(inflated_bytes));
+		inflate_chunk(body, entry.size, copies.back().data());
+		found = payloads.emplace(entry.begin, &copies.back()).first;
+	}
+	*bytes = found->second->size();
+	return found->second->data();
+}
+
+char const *ChunkFile::load(Entry const &entry) {
+	auto found = payloads.find(entry.begin);
+	if (found == payloads.end()) {
+		copies.emplace_back(entry.size);
+		read_at(entry.begin, copies.back().data(), entry.size);
+		found = payloads.emplace(entry.begin, &copies.back()).first;
+	}
+	return found->second->data();
+}
+
+uint64_t ChunkFile::payload_size(Entry const &entry) {
+	if (!(entry.flags & ChunkFlagCompressed)) return entry.size;
+	//(only the body's first header is needed, not its blocks)
+	char header[sizeof(CompressedChunkHeader)];
+	size_t bytes = std::min(entry.size, sizeof(header));
+	read_at(entry.begin, header, bytes);
+	return inflated_size(header, entry.size);
+}
+
+void ChunkFile::read_payload(Entry const &entry, uint64_t offset, size_t bytes, char *to) {
+	if ((entry.flags & ChunkFlagCompressed) && payloads.count(entry.begin)) {
+		//(already inflated whole by get() or read())
+		std::vector< char > const &payload = *payloads[entry.begin];
+		if (offset > payload.size() || bytes > payload.size() - offset) {
+			throw std::runtime_error("Read past end of '" + entry.magic + "' chunk in '" + filename + "'");
+		}
+		std::memcpy(to, payload.data() + offset, bytes);
+		return;
+	}
+	if (entry.flags & ChunkFlagCompressed) {
+		BlockLayout const &layout = block_layout(entry);
+		if (offset > layout.size || bytes > layout.size - offset) {
+			throw std::runtime_error("Read past end of '" + entry.magic + "' chunk in '" + filename + "'");
+		}
+		for (uint64_t at = offset, end = offset + bytes; at < end; ) {
+			uint32_t b = uint32_t(at / layout.block_size);
+			uint64_t block_begin = uint64_t(b) * layout.block_size;
+			size_t block_bytes = size_t(std::min< uint64_t >(layout.block_size, layout.size - block_begin));
+			size_t skip = size_t(at - block_begin);
+			size_t take = size_t(std::min< uint64_t >(block_bytes - skip, end - at));
+			bool cached = (cached_chunk == entry.begin && cached_block == b);
+			if (skip == 0 && take == block_bytes && !cached) {
+				inflate_block_to(entry, layout, b, to + (at - offset), block_bytes);
+			} else {
+				if (!cached) {
+					cached_chunk = -1; //(in case inflating throws)
+					cached_inflated.resize(block_bytes);
+					inflate_block_to(entry, layout, b, cached_inflated.data(), block_bytes);
+					cached_chunk = entry.begin;
+					cached_block = b;
+				}
+				std::memcpy(to + (at - offset), cached_inflated.data() + skip, take);
+			}
+			at += take;
+		}
+		return;
+	}
+	if (offset > entry.size || bytes > entry.size - offset) {
+		throw std::runtime_error("Read past end of '" + entry.magic + "' chunk in '" + filename + "'");
+	}
+	read_at(entry.begin + offset, to, bytes);
+}
+
+ChunkFile::BlockLayout const &ChunkFile::block_layout(Entry const &entry) {
+	auto found = layouts.find(entry.begin);
+	if (found != layouts.end()) return found->second;
+
+	BlockLayout layout;
+	CompressedChunkHeader header;
+	{ //(inflated_size checks the header against the body's size)
+		char bytes[sizeof(CompressedChunkHeader)];
+		read_at(entry.begin, bytes, std::min(entry.size, sizeof(bytes)));
+		layout.size = inflated_size(bytes, entry.size);
+		std::memcpy(&header, bytes, sizeof(header));
+	}
+	layout.block_size = header.block_size;
+	std::vector< uint32_t > compressed(header.block_count);
+	read_at(entry.begin + sizeof(header), compressed.data(), sizeof(uint32_t) * compressed.size());
+	layout.offsets.resize(size_t(header.block_count) + 1);
+	layout.offsets[0] = sizeof(header) + sizeof(uint32_t) * size_t(header.block_count);
+	for (uint32_t b = 0; b < header.block_count; ++b) {
+		layout.offsets[b + 1] = layout.offsets[b] + compressed[b];
+		if (layout.offsets[b + 1] > entry.size) {
+			throw std::runtime_error("Compressed chunk block runs past end of chunk.");
+		}
+	}
+	return layouts.emplace(entry.begin, std::move(layout)).first->second;
+}
+
+void ChunkFile::inflate_block_to(Entry const &entry, BlockLayout const &layout, uint32_t b, char *to, size_t bytes) {
+	size_t begin = layout.offsets[b];
+	size_t compressed = layout.offsets[b + 1] - begin;
+	char const *block = data + entry.begin + begin;
+	if (!data) {
+		compressed_block.resize(compressed);
+		read_at(entry.begin + begin, compressed_block.data(), compressed);
+		block = compressed_block.data();
+	}
+	inflate_block(block, compressed, to, bytes);
+}
+
+void ChunkFile::read_at(uint64_t offset, void *to_, size_t bytes) const {
+	char *to = static_cast< char * >(to_);
+	if (!on_demand) {
+		std::memcpy(to, data + offset, bytes);
+		return;
+	}
+	while (bytes > 0) {
+		#ifdef _WIN32
+		OVERLAPPED overlapped;
+		std::memset(&overlapped, 0, sizeof(overlapped));
+		overlapped.Offset = DWORD(offset);
+		overlapped.OffsetHigh = DWORD(offset >> 32);
+		DWORD got = 0;
+		DWORD want = DWORD(std::min< size_t >(bytes, 0x40000000));
+		if (!ReadFile(reinterpret_cast< HANDLE >(file_handle), to, want, &got, &overlapped) || got == 0) {
+			throw std::runtime_error("Failed to read '" + filename + (changed() ? "' (it was rewritten while open)." : "'."));
+		}
+		#else
+		ssize_t got = pread(fd, to, bytes, off_t(offset));
+		if (got == -1 && errno == EINTR) continue;
+		if (got <= 0) {
+			throw std::runtime_error("Failed to read '" + filename + (changed() ? "' (it was rewritten while open)." : "'."));
+		}
+		#endif
+		offset += uint64_t(got);
+		to += got;
+		bytes -= size_t(got);
+	}
+}
+
+bool ChunkFile::changed() const {
+	if (!on_demand) return false;
+	#ifdef _WIN32
+	LARGE_INTEGER file_size;
+	FILETIME written;
+	if (!GetFileSizeEx(reinterpret_cast< HANDLE >(file_handle), &file_size) || !GetFileTime(reinterpret_cast< HANDLE >(file_handle), NULL, NULL, &written)) return true;
+	return size_t(file_size.QuadPart) != size || ((uint64_t(written.dwHighDateTime) << 32) | written.dwLowDateTime) != opened_time;
+	#else
+	struct stat st;
+	if (fstat(fd, &st) != 0) return true;
+	return size_t(st.st_size) != size || modification_time(st) != opened_time;
+	#endif
+}
+
+char const *ChunkFile::aligned_copy(char const *begin, size_t bytes) {
+	if (copies.size() == payloads.size()) { //(first copy that isn't an inflated or read-on-demand payload)
+		std::cerr << "NOTE: '" << filename << "' has unaligned chunks; copying them (re-export to load without copies)." << std::endl;
+	}
+	copies.emplace_back(begin, begin + bytes);
+	return copies.back().data();
+}
@@ -0,0 +1,246 @@
+#pragma once
+
+#include "chunk_zlib.hpp"
+
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <stdexcept>
+#include <type_traits>
+#include <cstdint>
+#include <cstddef>
+
+//ChunkSpan is a typed, bounds-checked view of (part of) a chunk's payload:
+template< typename T >
+struct ChunkSpan {
+	ChunkSpan() = default;
+	ChunkSpan(T const *begin_, size_t size_) : begin_(begin_), size_(size_) { }
+
+	T const *begin() const { return begin_; }
+	T const *end() const { return begin_ + size_; }
+	size_t size() const { return size_; }
+	bool empty() const { return size_ == 0; }
+
+	//note: will throw if index is out of range.
+	T const &operator[](size_t i) const {
+		if (i >= size_) throw std::out_of_range("Chunk span index out of range.");
+		return begin_[i];
+	}
+
+	//view of elements [start, start+count); note: will throw if range is out of bounds.
+	ChunkSpan< T > subspan(size_t start, size_t count) const {
+		if (!(start <= size_ && count <= size_ - start)) throw std::out_of_range("Chunk span range out of bounds.");
+		return ChunkSpan< T >(begin_ + start, count);
+	}
+
+	//internals:
+	T const *begin_ = nullptr;
+	size_t size_ = 0;
+};
+
+//"ChunkFile" memory-maps a chunk file (e.g., meshes.blob) and hands out spans
+// that point directly into the mapping, so loading costs no copies and no heap allocation.
+// Chunks can be fetched by magic number in any order (get), or read in order with
+// the same contract as read_chunk (read).
+//
+// A file may start with an optional table-of-contents chunk ('toc0', or 'toc1' with 64-bit
+// offsets) listing every other chunk; when it is missing, the directory is built by hopping
+// chunk headers. Chunk headers may be extended with 64-bit sizes (see chunk_header.hpp).
+//
+// A ChunkFile can also be built over a file's contents that were already read into memory
+// (e.g., by AsyncReader); it then owns those contents instead of a mapping.
+//
+// Or it can be opened on demand: only chunk headers are read up front, get() and read() read
+// (just) the chunk asked for, and read_payload() reads part of a chunk -- e.g., straight into a
+// mapped GL buffer -- so a big chunk never needs to be resident. The file stays open, so renaming
+// a new file over it leaves this one intact (see changed() for files rewritten in place).
+//
+// Compressed chunks (see chunk_zlib.hpp) are inflated -- once, on first access -- into
+// memory owned by the ChunkFile, so spans of them work just like spans of the mapping.
+// read_payload() instead inflates just the blocks it needs, one at a time, so a big
+// compressed chunk can be streamed without ever being inflated whole.
+
+struct ChunkFile {
+	//map the file and build the chunk directory:
+	// note: will throw if file fails to open or map, or if the chunk structure is malformed.
+	ChunkFile(std::string const &filename);
+	//take ownership of a file's contents (read elsewhere) and build the chunk directory:
+	// note: will throw if the chunk structure is malformed.
+	ChunkFile(std::string const &filename, std::vector< char > &&contents);
+	//open the file and build the chunk directory, reading payloads only when asked for:
+	// note: will throw if file fails to open or read, or if the chunk structure is malformed.
+	struct OnDemand { };
+	ChunkFile(std::string const &filename, OnDemand);
+	~ChunkFile();
+	ChunkFile(ChunkFile const &) = delete;
+	ChunkFile &operator=(ChunkFile const &) = delete;
+
+	//'toc0' entry format:
+	struct TocEntry {
+		char magic[4];
+		uint32_t offset; //offset of the chunk's header from the start of the file
+		uint32_t size; //size of the chunk's payload (or compressed body)
+		uint32_t flags; //ChunkFlagCompressed, or zero
+	};
+	static_assert(sizeof(TocEntry) == 16, "TocEntry is packed");
+
+	//'toc1' entry format:
+	struct TocEntry64 {
+		char magic[4];
+		uint32_t flags;
+		uint64_t offset;
+		uint64_t size;
+	};
+	static_assert(sizeof(TocEntry64) == 24, "TocEntry64 is packed");
+
+	//directory of chunks in the file (in file order, not including the table of contents):
+	struct Entry {
+		std::string magic;
+		size_t begin; //offset of payload
+		size_t size; //size of payload (as stored, so compressed size for compressed chunks)
+		uint32_t flags;
+	};
+	std::vector< Entry > directory;
+
+	//check if there is a chunk with the indicated magic number:
+	bool has(std::string const &magic) const { return find(magic) != nullptr; }
+
+	//fetch the first chunk with the indicated magic number:
+	// note: will throw if the chunk is missing or malformed.
+	template< typename T >
+	ChunkSpan< T > get(std::string const &magic) {
+		Entry const *entry = find(magic);
+		if (!entry) throw std::runtime_error("Missing '" + magic + "' chunk in '" + filename + "'");
+		return span< T >(*entry);
+	}
+
+	//fetch elements [start, start+count) of the first chunk with the indicated magic number; unless they
+	// can point into the mapping (or contents), only they are read (or inflated) -- into 'storage':
+	// note: will throw if the chunk is missing or malformed, or the range is out of bounds.
+	template< typename T >
+	ChunkSpan< T > get_range(std::string const &magic, size_t start, size_t count, std::vector< T > *storage) {
+		static_assert(std::is_trivially_copyable< T >::value, "chunk elements must be plain data");
+		Entry const *entry = find(magic);
+		if (!entry) throw std::runtime_error("Missing '" + magic + "' chunk in '" + filename + "'");
+		if (data && !(entry->flags & ChunkFlagCompressed)) return span< T >(*entry).subspan(start, count);
+		size_t total = elements< T >(*entry);
+		if (!(start <= total && count <= total - start)) throw std::out_of_range("Chunk span range out of bounds.");
+		storage->resize(count);
+		read_payload(*entry, uint64_t(start) * sizeof(T), sizeof(T) * count, reinterpret_cast< char * >(storage->data()));
+		return ChunkSpan< T >(storage->data(), count);
+	}
+
+	//number of elements in the first chunk with the indicated magic number (without reading its payload):
+	// note: will throw if the chunk is missing or malformed.
+	template< typename T >
+	size_t count(std::string const &magic) {
+		Entry const *entry = find(magic);
+		if (!entry) throw std::runtime_error("Missing '" + magic + "' chunk in '" + filename + "'");
+		return elements< T >(*entry);
+	}
+
+	//read the next chunk (skipping the table of contents), which must have the indicated magic number:
+	// note: will throw if the magic doesn't match or the chunk is malformed.
+	template< typename T >
+	ChunkSpan< T > read(std::string const &magic) {
+		if (next >= directory.size()) throw std::runtime_error("Failed to read chunk header");
+		Entry const &entry = directory[next];
+		if (entry.magic != magic) throw std::runtime_error("Unexpected magic number in chunk");
+		++next;
+		return span< T >(entry);
+	}
+
+	//size of a chunk's payload (once inflated, for compressed chunks):
+	// note: will throw if a compressed chunk's headers are malformed.
+	uint64_t payload_size(Entry const &entry);
+	//copy bytes [offset, offset+bytes) of a chunk's payload to 'to' (straight from the file, if opened on demand;
+	// for compressed chunks, a block at a time -- blocks the range covers whole are inflated straight into 'to'):
+	// note: will throw if the range is past the end of the payload, the file fails to read, or a block is malformed.
+	void read_payload(Entry const &entry, uint64_t offset, size_t bytes, char *to);
+	//true if the file (opened on demand) has been rewritten in place since it was opened:
+	// (i.e., its size or modification time changed; data read from it may be a mix of old and new)
+	bool changed() const;
+
+	//let the OS drop the pages of [begin, begin+bytes) that are mapped from the file (they are read
+	// again if touched), so streaming through a big file doesn't keep all of it resident:
+	// (does nothing for contents read into memory, files opened on demand, inflated payloads, or on Windows)
+	void release(char const *begin, size_t bytes) const;
+
+	//true if every chunk has been read():
+	bool at_end() const { return next == directory.size(); }
+
+	//internals:
+	Entry const *find(std::string const &magic) const;
+
+	template< typename T >
+	ChunkSpan< T > span(Entry const &entry) {
+		static_assert(std::is_trivially_copyable< T >::value, "chunk elements must be plain data");
+		char const *begin = data + entry.begin;
+		size_t bytes = entry.size;
+		if (entry.flags & ChunkFlagCompressed) {
+			//(inflated payloads are heap allocated, so suitably aligned)
+			begin = inflate(entry, &bytes);
+		} else if (!data) {
+			//(as are payloads read on demand)
+			begin = load(entry);
+		}
+		if (bytes % sizeof(T) != 0) {
+			throw std::runtime_error("Size of chunk not divisible by element size");
+		}
+		if (reinterpret_cast< uintptr_t >(begin) % alignof(T) != 0) {
+			//older writers didn't pad payloads; fall back to an aligned copy:
+			begin = aligned_copy(begin, bytes);
+		}
+		return ChunkSpan< T >(reinterpret_cast< T const * >(begin), bytes / sizeof(T));
+	}
+	template< typename T >
+	size_t elements(Entry const &entry) {
+		uint64_t bytes = payload_size(entry);
+		if (bytes % sizeof(T) != 0) {
+			throw std::runtime_error("Size of chunk not divisible by element size");
+		}
+		return size_t(bytes / sizeof(T));
+	}
+	char const *aligned_copy(char const *begin, size_t bytes);
+	//inflate a compressed chunk (or find it, if already inflated); returns payload and sets *bytes to its size:
+	char const *inflate(Entry const &entry, size_t *bytes);
+	//read a chunk's (stored) payload from a file opened on demand (or find it, if already read):
+	char const *load(Entry const &entry);
+	//where each block of a compressed chunk's body is (read from its headers, then remembered):
+	struct BlockLayout {
+		uint64_t size = 0; //of the inflated payload
+		uint32_t block_size = 0;
+		std::vector< size_t > offsets; //of each block (and the end of the last) from the start of the body
+	};
+	BlockLayout const &block_layout(Entry const &entry);
+	//inflate block 'b' of a compressed chunk into exactly 'bytes' bytes at 'to':
+	void inflate_block_to(Entry const &entry, BlockLayout const &layout, uint32_t b, char *to, size_t bytes);
+	//copy bytes [offset, offset+bytes) of the file (mapping, or contents) to 'to':
+	// note: will throw if the file fails to read.
+	void read_at(uint64_t offset, void *to, size_t bytes) const;
+	void build_directory();
+	void unmap();
+
+	std::string filename;
+	char const *data = nullptr; //start of mapping (or of contents)
+	size_t size = 0; //size of mapping (or contents, or file opened on demand)
+	std::vector< char > contents; //file contents, if not mapped
+	bool on_demand = false; //neither mapped nor read into memory (so 'data' is null)
+	uint64_t opened_time = 0; //modification time when opened on demand (see changed())
+	size_t next = 0; //index in directory of next chunk for read()
+	std::list< std::vector< char > > copies; //storage for misaligned, inflated, and read-on-demand payloads
+	std::map< size_t, std::vector< char > const * > payloads; //entry.begin -> inflated or read-on-demand payload (in copies)
+	std::map< size_t, BlockLayout > layouts; //entry.begin -> block layout (of compressed chunks read a block at a time)
+	//last block read_payload inflated only part of (reads rarely line up with blocks, so the next read often wants the rest):
+	size_t cached_chunk = -1; //entry.begin
+	uint32_t cached_block = 0;
+	std::vector< char > cached_inflated;
+	std::vector< char > compressed_block; //(a block's compressed bytes, read from a file opened on demand)
+	#ifdef _WIN32
+	void *file_handle = nullptr;
+	void *mapping_handle = nullptr;
+	#else
+	int fd = -1;
+	#endif
+};
@@ -0,0 +1,121 @@
+#include "FileWatcher.hpp"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <iostream>
+#include <thread>
+#include <algorithm>
+
+FileWatcher::FileWatcher(std::vector< std::string > const &filenames_, std::chrono::milliseconds settle_) : settle(settle_), filenames(filenames_) {
+	#ifdef __linux__
+	fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd != -1) {
+		//watch directories rather than files, so a file replaced by a rename is still seen:
+		for (auto const &filename : filenames) {
+			std::string directory = filename.substr(0, filename.rfind('/') + 1); //(empty, or ends in '/')
+			int wd = inotify_add_watch(fd, (directory.empty() ? "." : directory.c_str()), IN_CLOSE_WRITE | IN_MOVED_TO);
+			if (wd == -1) {
+				close(fd);
+				fd = -1;
+				break;
+			}
+			directories[wd] = directory;
+		}
+	}
+	if (fd == -1) {
+		std::cerr << "NOTE: inotify unavailable; watching files by modification time instead." << std::endl;
+	}
+	#endif
+	if (fd == -1) {
+		for (auto const &filename : filenames) {
+			stamps.emplace_back(stamp(filename));
+		}
+	}
+}
+
+FileWatcher::~FileWatcher() {
+	#ifdef __linux__
+	if (fd != -1) close(fd);
+	#endif
+}
+
+FileWatcher::Stamp FileWatcher::stamp(std::string const &filename) {
+	Stamp ret;
+	struct stat st;
+	if (stat(filename.c_str(), &st) == 0) {
+		ret.mtime = int64_t(st.st_mtime);
+		ret.size = int64_t(st.st_size);
+	}
+	return ret;
+}
+
+std::vector< std::string > FileWatcher::poll(std::chrono::milliseconds timeout) {
+	Clock::time_point deadline = Clock::now() + timeout;
+	while (true) {
+		Clock::time_point now = Clock::now();
+
+		//note changes:
+		#ifdef __linux__
+		if (fd != -1) {
+			alignas(inotify_event) char buffer[4096];
+			ssize_t got;
+			while ((got = read(fd, buffer, sizeof(buffer))) > 0) {
+				for (char const *at = buffer; at < buffer + got; ) {
+					inotify_event const &event = *reinterpret_cast< inotify_event const * >(at);
+					at += sizeof(inotify_event) + event.len;
+					if (event.len == 0) continue;
+					auto directory = directories.find(event.wd);
+					if (directory == directories.end()) continue;
+					std::string filename = directory->second + event.name;
+					if (std::find(filenames.begin(), filenames.end(), filename) != filenames.end()) {
+						pending[filename] = now;
+					}
+				}
+			}
+		}
+		#endif
+		if (fd == -1) {
+			for (uint32_t i = 0; i < filenames.size(); ++i) {
+				Stamp current = stamp(filenames[i]);
+				if (current != stamps[i]) {
+					stamps[i] = current;
+					pending[filenames[i]] = now;
+				}
+			}
+		}
+
+		//report files that have been quiet long enough:
+		std::vector< std::string > settled;
+		Clock::time_point next_settle = deadline;
+		for (auto p = pending.begin(); p != pending.end(); ) {
+			if (now - p->second >= settle) {
+				settled.emplace_back(p->first);
+				p = pending.erase(p);
+			} else {
+				next_settle = std::min(next_settle, p->second + settle);
+				++p;
+			}
+		}
+		if (!settled.empty() || now >= deadline) return settled;
+
+		//wait for more changes (or for pending ones to settle):
+		std::chrono::milliseconds wait = std::chrono::duration_cast< std::chrono::milliseconds >(next_settle - now) + std::chrono::milliseconds(1);
+		#ifdef __linux__
+		if (fd != -1) {
+			pollfd pfd;
+			pfd.fd = fd;
+			pfd.events = POLLIN;
+			pfd.revents = 0;
+			::poll(&pfd, 1, int(wait.count()));
+			continue;
+		}
+		#endif
+		std::this_thread::sleep_for(wait);
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <cstdint>
+
+//"FileWatcher" reports files that have been rewritten since they were last reported.
+// On Linux it uses inotify on each file's directory, so files replaced by a rename
+// (as well as files rewritten in place) are seen without polling the disk.
+// Elsewhere (or if inotify is unavailable) it compares modification times and sizes.
+//
+// A change is only reported once the file has been quiet for 'settle', so a reader
+// doesn't pick it up while the writer is still writing.
+
+struct FileWatcher {
+	FileWatcher(std::vector< std::string > const &filenames, std::chrono::milliseconds settle = std::chrono::milliseconds(100));
+	~FileWatcher();
+	FileWatcher(FileWatcher const &) = delete;
+	FileWatcher &operator=(FileWatcher const &) = delete;
+
+	//wait up to 'timeout' for watched files to change; returns the files that settled (each once):
+	std::vector< std::string > poll(std::chrono::milliseconds timeout);
+
+	//internals:
+	typedef std::chrono::steady_clock Clock;
+	std::chrono::milliseconds settle;
+	std::vector< std::string > filenames;
+	std::map< std::string, Clock::time_point > pending; //changed file -> time of last change
+
+	//modification-time fallback:
+	struct Stamp {
+		int64_t mtime = -1;
+		int64_t size = -1;
+		bool operator!=(Stamp const &o) const { return mtime != o.mtime || size != o.size; }
+	};
+	static Stamp stamp(std::string const &filename);
+	std::vector< Stamp > stamps; //parallel to filenames
+
+	//inotify:
+	int fd = -1;
+	std::map< int, std::string > directories; //watch descriptor -> directory (with trailing '/')
+};
@@ -0,0 +1,61 @@
+#include "FrameCapture.hpp"
+
+#include <cassert>
+
+FrameCapture::FrameCapture(glm::uvec2 const &size_, uint32_t ring) : size(size_), slots(ring) {
+	assert(ring > 0);
+	for (Slot &slot : slots) {
+		glGenBuffers(1, &slot.buffer);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+		glBufferData(GL_PIXEL_PACK_BUFFER, GLsizeiptr(4) * size.x * size.y, NULL, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+bool FrameCapture::capture(uint32_t tag) {
+	if (count == slots.size()) return false;
+	Slot &slot = slots[(first + count) % slots.size()];
+	count += 1;
+
+	//(with a pack buffer bound, glReadPixels only queues a copy -- it returns right away)
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.tag = tag;
+	return true;
+}
+
+void FrameCapture::hand_over(std::function< void(Frame &&) > const &on_frame, bool wait) {
+	while (count != 0) {
+		Slot &slot = slots[first];
+		//(a zero timeout only asks; flushing makes sure the fence gets to the GPU)
+		GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		while (wait && status == GL_TIMEOUT_EXPIRED) {
+			status = glClientWaitSync(slot.fence, 0, GLuint64(100000000)); //(100ms at a time)
+		}
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+		glDeleteSync(slot.fence);
+		slot.fence = 0;
+
+		Frame frame;
+		frame.tag = slot.tag;
+		frame.size = size;
+		frame.pixels.resize(size_t(size.x) * size.y);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+		uint32_t const *mapped = reinterpret_cast< uint32_t const * >(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, GLsizeiptr(4) * frame.pixels.size(), GL_MAP_READ_BIT));
+		if (mapped) {
+			//(the framebuffer's alpha isn't meaningful -- it's cleared to zero -- so make it opaque)
+			for (size_t i = 0; i < frame.pixels.size(); ++i) {
+				frame.pixels[i] = mapped[i] | 0xff000000;
+			}
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		first = (first + 1) % slots.size();
+		count -= 1;
+		if (mapped) on_frame(std::move(frame));
+	}
+}
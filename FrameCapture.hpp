@@ -0,0 +1,58 @@
+#pragma once
+
+#include "GL.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+//"FrameCapture" reads the framebuffer back without stalling the frame:
+// capture() starts an asynchronous glReadPixels into one of a ring of pixel buffer objects
+// and drops a fence after it; poll() -- called once per frame -- hands over every readback
+// whose fence has signaled (typically a frame or two later). Nothing ever waits on the GPU.
+//
+// Frames come out in capture order, with a lower-left origin and opaque alpha.
+
+struct FrameCapture {
+	//'ring' readbacks may be in flight at once:
+	FrameCapture(glm::uvec2 const &size, uint32_t ring = 3);
+	FrameCapture(FrameCapture const &) = delete;
+	FrameCapture &operator=(FrameCapture const &) = delete;
+	//(like other GL objects in this code, the pixel buffers live as long as the context)
+
+	//one finished readback:
+	struct Frame {
+		uint32_t tag = 0; //as passed to capture()
+		glm::uvec2 size = glm::uvec2(0);
+		std::vector< uint32_t > pixels; //RGBA, rows bottom-to-top
+	};
+
+	//GL thread: start reading back the current read framebuffer (e.g., after rendering, before swapping):
+	// returns false (and captures nothing) if every buffer in the ring is still in flight.
+	bool capture(uint32_t tag = 0);
+
+	//GL thread: pass every finished readback (in order) to 'on_frame':
+	void poll(std::function< void(Frame &&) > const &on_frame) { hand_over(on_frame, false); }
+
+	//GL thread: wait for every readback in flight, and pass them all (in order) to 'on_frame':
+	// (stalls until the GPU catches up -- for, e.g., ending one recording before starting another)
+	void drain(std::function< void(Frame &&) > const &on_frame) { hand_over(on_frame, true); }
+
+	//readbacks started but not yet handed over:
+	uint32_t in_flight() const { return count; }
+
+	glm::uvec2 size;
+
+	//internals:
+	struct Slot {
+		GLuint buffer = 0;
+		GLsync fence = 0;
+		uint32_t tag = 0;
+	};
+	std::vector< Slot > slots;
+	void hand_over(std::function< void(Frame &&) > const &on_frame, bool wait);
+	uint32_t first = 0; //oldest readback in flight
+	uint32_t count = 0;
+};
@@ -0,0 +1,59 @@
+#include "FrameRecorder.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+FrameRecorder::FrameRecorder(Encode const &encode_, Policy policy_, uint32_t capacity_, uint32_t threads) : depth(0), peak_depth(0), dropped(0), encoded(0), encode(encode_), policy(policy_), capacity(capacity_) {
+	assert(capacity > 0);
+	if (threads == 0) threads = std::max(1U, std::thread::hardware_concurrency() - std::min(2U, std::thread::hardware_concurrency()));
+	for (uint32_t i = 0; i < threads; ++i) {
+		encoders.emplace_back(&FrameRecorder::work, this);
+	}
+}
+
+FrameRecorder::~FrameRecorder() {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		quit = true;
+	}
+	frame_ready.notify_all();
+	for (auto &encoder : encoders) {
+		encoder.join();
+	}
+}
+
+bool FrameRecorder::push(std::string const &filename, FrameCapture::Frame &&frame) {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		if (frames.size() >= capacity) {
+			if (policy == Drop) {
+				dropped += 1;
+				return false;
+			}
+			space_ready.wait(lock, [this](){ return frames.size() < capacity; });
+		}
+		frames.emplace_back(filename, std::move(frame));
+		depth = uint32_t(frames.size());
+		if (depth > peak_depth) peak_depth = depth.load();
+	}
+	frame_ready.notify_one();
+	return true;
+}
+
+void FrameRecorder::work() {
+	std::unique_lock< std::mutex > lock(mutex);
+	while (true) {
+		frame_ready.wait(lock, [this](){ return quit || !frames.empty(); });
+		if (frames.empty()) return; //(quit, and nothing left to encode)
+		std::pair< std::string, FrameCapture::Frame > frame = std::move(frames.front());
+		frames.pop_front();
+		depth = uint32_t(frames.size());
+		lock.unlock();
+		space_ready.notify_one();
+
+		encode(frame.first, frame.second);
+		encoded += 1;
+
+		lock.lock();
+	}
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "FrameCapture.hpp"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+
+//"FrameRecorder" encodes captured frames on a pool of encoder threads (e.g., as numbered PNGs).
+// Frames wait in a bounded queue; when it is full, push() either drops the frame or blocks
+// the caller until an encoder takes one, depending on the policy:
+//  - Drop keeps the game running at full speed, leaving gaps in the recording under load,
+//  - Block records every frame, slowing the game down to the encoders' pace instead.
+// Counters (queue depth, peak depth, frames dropped and encoded) may be read from any thread.
+
+struct FrameRecorder {
+	enum Policy {
+		Drop,
+		Block,
+	};
+
+	//encode one frame (called on an encoder thread):
+	typedef std::function< void(std::string const &filename, FrameCapture::Frame const &frame) > Encode;
+
+	//start 'threads' encoders (by default, all but two hardware threads -- leaving the game and the
+	// driver theirs), with room for 'capacity' frames waiting:
+	FrameRecorder(Encode const &encode, Policy policy, uint32_t capacity = 16, uint32_t threads = 0);
+	//encodes every queued frame, then joins the encoders:
+	~FrameRecorder();
+	FrameRecorder(FrameRecorder const &) = delete;
+	FrameRecorder &operator=(FrameRecorder const &) = delete;
+
+	//queue a frame to be encoded to 'filename':
+	// returns false if the frame was dropped (queue full, Drop policy).
+	bool push(std::string const &filename, FrameCapture::Frame &&frame);
+
+	//encoder threads (e.g., for "fps per core" numbers):
+	uint32_t size() const { return uint32_t(encoders.size()); }
+
+	std::atomic< uint32_t > depth; //frames waiting
+	std::atomic< uint32_t > peak_depth; //most frames ever waiting at once
+	std::atomic< uint32_t > dropped;
+	std::atomic< uint32_t > encoded;
+
+	//internals:
+	void work();
+	Encode encode;
+	Policy policy;
+	uint32_t capacity;
+	std::vector< std::thread > encoders;
+	std::mutex mutex;
+	std::condition_variable frame_ready; //a frame was queued (or quitting)
+	std::condition_variable space_ready; //a frame was taken
+	std::deque< std::pair< std::string, FrameCapture::Frame > > frames;
+	bool quit = false;
+};
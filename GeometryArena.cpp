@@ -0,0 +1,315 @@
+#include "GeometryArena.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+#include <iterator>
+#include <cstring>
+#include <cassert>
+
+constexpr GeometryArena::Handle GeometryArena::InvalidHandle;
+constexpr uint32_t GeometryArena::IndexPool;
+constexpr uint32_t GeometryArena::MinPoolBytes;
+constexpr uint32_t GeometryArena::UploadSliceBytes;
+
+GeometryArena::Pool &GeometryArena::index_pool() {
+	if (pools.empty()) {
+		pools.emplace_back();
+		pools.back().format = "indices";
+		pools.back().stride = 1;
+		pools.back().align = 4;
+	}
+	return pools[IndexPool];
+}
+
+uint32_t GeometryArena::vertex_pool(std::string const &format, GLsizei stride, std::function< void() > const &set_attributes) {
+	index_pool(); //make sure pools[IndexPool] exists
+
+	for (uint32_t i = 0; i < pools.size(); ++i) {
+		if (i == IndexPool || pools[i].format != format) continue;
+		if (pools[i].stride != stride) {
+			throw std::runtime_error("Vertex format '" + format + "' used with two different strides.");
+		}
+		return i;
+	}
+
+	pools.emplace_back();
+	Pool &pool = pools.back();
+	pool.format = format;
+	pool.stride = stride;
+	pool.set_attributes = set_attributes;
+	glGenVertexArrays(1, &pool.vao);
+	//(buffer is created -- and VAO bound to it -- on first allocation)
+	return uint32_t(pools.size() - 1);
+}
+
+GeometryArena::Handle GeometryArena::allocate(uint32_t pool_index, uint32_t count, void const *data) {
+	if (pool_index == IndexPool) index_pool();
+	assert(pool_index < pools.size());
+	assert(count > 0);
+
+	uint32_t size = reserved(pools[pool_index], count);
+	uint32_t offset = 0;
+	if (!pools[pool_index].ranges.allocate(size, &offset)) {
+		Ranges const &ranges = pools[pool_index].ranges;
+		//no free range is big enough; packing will make one if there is enough space in total, otherwise grow:
+		uint32_t capacity = ranges.capacity;
+		if (uint64_t(ranges.used) + size > capacity) {
+			uint64_t wanted = std::max< uint64_t >(2 * uint64_t(capacity), uint64_t(ranges.used) + size);
+			wanted = std::max< uint64_t >(wanted, MinPoolBytes / pools[pool_index].stride);
+			if (wanted > 0xffffffffULL) {
+				throw std::runtime_error("Geometry pool '" + pools[pool_index].format + "' is out of space.");
+			}
+			capacity = uint32_t(wanted);
+		}
+		rebuild(pool_index, capacity);
+		bool allocated = pools[pool_index].ranges.allocate(size, &offset);
+		assert(allocated);
+		(void)allocated;
+	}
+
+	Handle handle;
+	if (!free_handles.empty()) {
+		handle = free_handles.back();
+		free_handles.pop_back();
+	} else {
+		handle = Handle(allocations.size());
+		allocations.emplace_back();
+	}
+	Allocation &allocation = allocations[handle];
+	allocation.pool = pool_index;
+	allocation.offset = offset;
+	allocation.count = count;
+
+	if (data) update(handle, 0, count, data);
+
+	return handle;
+}
+
+void GeometryArena::update(Handle handle, uint32_t first, uint32_t count, void const *data) {
+	char const *bytes = static_cast< char const * >(data);
+	write(handle, first, count, [bytes](char *to, size_t offset, size_t size) {
+		std::memcpy(to, bytes + offset, size);
+	});
+}
+
+void GeometryArena::write(Handle handle, uint32_t first, uint32_t count, Writer const &writer) {
+	assert(handle < allocations.size() && allocations[handle].count != 0);
+	Allocation const &allocation = allocations[handle];
+	if (!(first <= allocation.count && count <= allocation.count - first)) {
+		throw std::runtime_error("Geometry update past the end of its range.");
+	}
+	Pool &pool = pools[allocation.pool];
+	GLintptr begin = GLintptr(allocation.offset + first) * pool.stride;
+	GLsizeiptr size = GLsizeiptr(count) * pool.stride;
+
+	//fill the buffer through mapped slices (so the driver stages at most a slice at once);
+	// space that has never been written can't be in use by the GPU, so it is mapped unsynchronized:
+	GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT;
+	if (allocation.offset + first >= pool.fresh) access |= GL_MAP_UNSYNCHRONIZED_BIT;
+	//(treated as written even if the writer fails part way, so later writes there are synchronized)
+	pool.fresh = std::max(pool.fresh, allocation.offset + first + count);
+	//(using the copy-write target so no VAO's element buffer binding is disturbed)
+	glBindBuffer(GL_COPY_WRITE_BUFFER, pool.buffer);
+	std::vector< char > staged; //(only used if mapping fails)
+	for (GLsizeiptr at = 0; at < size; at += UploadSliceBytes) {
+		GLsizeiptr slice = std::min< GLsizeiptr >(UploadSliceBytes, size - at);
+		void *mapped = glMapBufferRange(GL_COPY_WRITE_BUFFER, begin + at, slice, access);
+		if (mapped) {
+			try {
+				writer(static_cast< char * >(mapped), size_t(at), size_t(slice));
+			} catch (...) {
+				glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+				glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+				throw;
+			}
+			if (glUnmapBuffer(GL_COPY_WRITE_BUFFER)) continue;
+		}
+		//(mapping failed, or the mapped data was lost; write it the slow way)
+		staged.resize(size_t(slice));
+		try {
+			writer(staged.data(), size_t(at), size_t(slice));
+		} catch (...) {
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			throw;
+		}
+		glBufferSubData(GL_COPY_WRITE_BUFFER, begin + at, slice, staged.data());
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void GeometryArena::free(Handle handle) {
+	if (handle == InvalidHandle) return;
+	assert(handle < allocations.size() && allocations[handle].count != 0);
+	Allocation &allocation = allocations[handle];
+	Pool &pool = pools[allocation.pool];
+	pool.ranges.release(allocation.offset, reserved(pool, allocation.count));
+	allocation = Allocation();
+	free_handles.emplace_back(handle);
+}
+
+uint32_t GeometryArena::offset(Handle handle) const {
+	assert(handle < allocations.size() && allocations[handle].count != 0);
+	return allocations[handle].offset;
+}
+
+uint32_t GeometryArena::count(Handle handle) const {
+	assert(handle < allocations.size() && allocations[handle].count != 0);
+	return allocations[handle].count;
+}
+
+GLuint GeometryArena::vao(uint32_t pool) const {
+	assert(pool < pools.size());
+	return pools[pool].vao;
+}
+
+void GeometryArena::compact() {
+	for (uint32_t i = 0; i < pools.size(); ++i) {
+		Ranges const &ranges = pools[i].ranges;
+		//already packed if all free space is one range at the end:
+		if (ranges.free.empty()) continue;
+		if (ranges.free.size() == 1 && ranges.free.begin()->first + ranges.free.begin()->second == ranges.capacity) continue;
+		rebuild(i, ranges.capacity);
+	}
+}
+
+void GeometryArena::report(std::ostream &out) const {
+	for (Pool const &pool : pools) {
+		Ranges const &ranges = pool.ranges;
+		uint32_t live = 0;
+		for (Allocation const &allocation : allocations) {
+			if (allocation.count != 0 && &pools[allocation.pool] == &pool) ++live;
+		}
+		uint32_t free_total = ranges.capacity - ranges.used;
+		uint32_t largest = ranges.largest_free();
+		//fragmentation: fraction of free space not in the largest free range:
+		float fragmentation = (free_total ? 1.0f - float(largest) / float(free_total) : 0.0f);
+		out << "Geometry pool '" << pool.format << "': "
+			<< size_t(ranges.used) * pool.stride << " of " << size_t(ranges.capacity) * pool.stride << " bytes used by " << live << " ranges; "
+			<< ranges.free.size() << " free ranges, largest " << size_t(largest) * pool.stride << " bytes "
+			<< "(" << 100.0f * fragmentation << "% fragmented)." << std::endl;
+	}
+}
+
+void GeometryArena::rebuild(uint32_t pool_index, uint32_t capacity) {
+	Pool &pool = pools[pool_index];
+
+	GLuint buffer = 0;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, GLsizeiptr(capacity) * pool.stride, NULL, GL_STATIC_DRAW);
+
+	//live ranges, in the order they are in now:
+	std::vector< Allocation * > live;
+	for (Allocation &allocation : allocations) {
+		if (allocation.count != 0 && allocation.pool == pool_index) live.emplace_back(&allocation);
+	}
+	std::sort(live.begin(), live.end(), [](Allocation const *a, Allocation const *b) {
+		return a->offset < b->offset;
+	});
+
+	//copy them down to the start of the new buffer, merging runs of neighbouring ranges into one copy:
+	uint32_t end = 0;
+	bool moved = false;
+	if (pool.buffer) {
+		glBindBuffer(GL_COPY_READ_BUFFER, pool.buffer);
+		uint32_t run_from = 0, run_to = 0, run_size = 0;
+		auto flush = [&]() {
+			if (run_size == 0) return;
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, GLintptr(run_from) * pool.stride, GLintptr(run_to) * pool.stride, GLsizeiptr(run_size) * pool.stride);
+			run_size = 0;
+		};
+		for (Allocation *allocation : live) {
+			uint32_t size = reserved(pool, allocation->count);
+			if (run_size == 0 || allocation->offset != run_from + run_size) {
+				flush();
+				run_from = allocation->offset;
+				run_to = end;
+			}
+			run_size += size;
+			if (allocation->offset != end) moved = true;
+			allocation->offset = end;
+			end += size;
+		}
+		flush();
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glDeleteBuffers(1, &pool.buffer);
+	}
+	assert(end <= capacity);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	pool.buffer = buffer;
+	pool.ranges = Ranges();
+	pool.ranges.capacity = capacity;
+	pool.ranges.used = end;
+	if (end < capacity) pool.ranges.free.emplace(end, capacity - end);
+	pool.fresh = end;
+
+	if (moved) ++generation;
+
+	//point VAOs at the new buffer:
+	if (pool_index == IndexPool) {
+		for (Pool &other : pools) {
+			if (other.vao) bind_vao(other);
+		}
+	} else {
+		bind_vao(pool);
+	}
+}
+
+void GeometryArena::bind_vao(Pool &pool) {
+	assert(pool.vao);
+	glBindVertexArray(pool.vao);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_pool().buffer);
+	if (pool.buffer) {
+		glBindBuffer(GL_ARRAY_BUFFER, pool.buffer);
+		pool.set_attributes();
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	glBindVertexArray(0);
+}
+
+//------------ free ranges ------------
+
+bool GeometryArena::Ranges::allocate(uint32_t size, uint32_t *offset) {
+	assert(offset);
+	for (auto f = free.begin(); f != free.end(); ++f) {
+		if (f->second < size) continue;
+		*offset = f->first;
+		uint32_t left = f->second - size;
+		free.erase(f);
+		if (left) free.emplace(*offset + size, left);
+		used += size;
+		return true;
+	}
+	return false;
+}
+
+void GeometryArena::Ranges::release(uint32_t offset, uint32_t size) {
+	assert(size <= used);
+	used -= size;
+	auto next = free.lower_bound(offset);
+	assert(next == free.end() || offset + size <= next->first);
+	//merge with following free range:
+	if (next != free.end() && next->first == offset + size) {
+		size += next->second;
+		next = free.erase(next);
+	}
+	//merge with preceding free range:
+	if (next != free.begin()) {
+		auto prev = std::prev(next);
+		assert(prev->first + prev->second <= offset);
+		if (prev->first + prev->second == offset) {
+			prev->second += size;
+			return;
+		}
+	}
+	free.emplace_hint(next, offset, size);
+}
+
+uint32_t GeometryArena::Ranges::largest_free() const {
+	uint32_t largest = 0;
+	for (auto const &f : free) {
+		largest = std::max(largest, f.second);
+	}
+	return largest;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "GL.hpp"
+#include <vector>
+#include <map>
+#include <string>
+#include <functional>
+#include <ostream>
+#include <cstdint>
+
+//"GeometryArena" sub-allocates vertex and index ranges from a few large buffers:
+// - every vertex format gets one pool (one vertex buffer + one VAO),
+// - all indices share one element buffer (bound to every pool's VAO),
+// so meshes loaded from different files can be drawn without switching VAOs.
+//
+// Buffers are allocated once with glBufferData(NULL) and never re-specified
+// (GL 3.3 has no glBufferStorage); growing or compacting a pool copies its live
+// ranges into a fresh buffer with glCopyBufferSubData. Allocation offsets change
+// when that happens, so callers should keep Handles and re-read offset() after
+// compact() (or whenever generation changes).
+//
+// Data is written through glMapBufferRange in fixed-size slices rather than staged
+// whole; space a pool has never written is mapped unsynchronized. With write(), the
+// caller fills each mapped slice itself (e.g., reading it from a file), so the data
+// needn't be in memory at all.
+
+struct GeometryArena {
+	GeometryArena() = default;
+	GeometryArena(GeometryArena const &) = delete;
+	GeometryArena &operator=(GeometryArena const &) = delete;
+	//(like other GL objects in this code, pool buffers and VAOs live as long as the context)
+
+	typedef uint32_t Handle;
+	static constexpr Handle InvalidHandle = -1U;
+
+	//pool that holds indices (all other pools are vertex pools):
+	static constexpr uint32_t IndexPool = 0;
+
+	//get (or create) the vertex pool for a format:
+	// 'set_attributes' is called with the pool's VAO and vertex buffer bound, to (re)point attributes at the buffer.
+	uint32_t vertex_pool(std::string const &format, GLsizei stride, std::function< void() > const &set_attributes);
+
+	//copy 'count' (> 0) elements (vertices, or bytes for IndexPool) into a new range:
+	// (index ranges are 4-byte aligned, so both 16- and 32-bit indices may be stored)
+	// may grow or compact the pool if it has no free range big enough.
+	Handle allocate(uint32_t pool, uint32_t count, void const *data);
+	//overwrite (part of) an existing range:
+	// note: will throw if [first, first+count) is past the end of the range.
+	void update(Handle handle, uint32_t first, uint32_t count, void const *data);
+	//overwrite (part of) an existing range with whatever writer(to, offset, bytes) puts at 'to' -- called
+	// for each mapped slice in order, 'offset' bytes past the start of element 'first':
+	// note: will throw if [first, first+count) is past the end of the range, or rethrow what writer throws.
+	typedef std::function< void(char *to, size_t offset, size_t bytes) > Writer;
+	void write(Handle handle, uint32_t first, uint32_t count, Writer const &writer);
+	void free(Handle handle);
+
+	//where a range currently lives (in elements of its pool):
+	uint32_t offset(Handle handle) const;
+	uint32_t count(Handle handle) const;
+	GLuint vao(uint32_t pool) const;
+
+	//pack every pool's live ranges together, removing all free space between them:
+	void compact();
+	//incremented whenever allocations move (compact() or a pool growing):
+	uint32_t generation = 0;
+
+	//print capacity, use, and fragmentation of each pool:
+	void report(std::ostream &out) const;
+
+	//internals:
+	//first-fit free-range allocator (in elements):
+	struct Ranges {
+		uint32_t capacity = 0;
+		uint32_t used = 0;
+		std::map< uint32_t, uint32_t > free; //offset -> size, never adjacent
+		bool allocate(uint32_t size, uint32_t *offset);
+		void release(uint32_t offset, uint32_t size);
+		uint32_t largest_free() const;
+	};
+	struct Pool {
+		std::string format;
+		GLsizei stride = 1; //bytes per element
+		uint32_t align = 1; //range sizes are rounded up to this (in elements), so offsets stay aligned
+		GLuint buffer = 0;
+		GLuint vao = 0; //(0 for the index pool)
+		std::function< void() > set_attributes;
+		Ranges ranges;
+		uint32_t fresh = 0; //elements at and past this offset haven't been written since the buffer was made
+	};
+	std::vector< Pool > pools; //pools[IndexPool] is the index pool
+	struct Allocation {
+		uint32_t pool = 0;
+		uint32_t offset = 0;
+		uint32_t count = 0; //0 marks an unused handle
+	};
+	std::vector< Allocation > allocations; //indexed by Handle
+	std::vector< Handle > free_handles;
+
+	//minimum pool size (bytes):
+	static constexpr uint32_t MinPoolBytes = 4 << 20;
+	//write() maps and fills at most this many bytes at a time:
+	static constexpr uint32_t UploadSliceBytes = 1 << 20;
+
+	Pool &index_pool();
+	uint32_t reserved(Pool const &pool, uint32_t count) const { return (count + pool.align - 1) / pool.align * pool.align; }
+	//move 'pool's live ranges, packed, into a new buffer of 'capacity' elements:
+	void rebuild(uint32_t pool, uint32_t capacity);
+	//(re)bind the index buffer and pool's buffer to a pool's VAO:
+	void bind_vao(Pool &pool);
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+//MeshId names a mesh by the 64-bit FNV-1a hash of its name, so that mesh lookups
+// need no string allocation or comparison. Ids for string literals can be
+// computed at compile time, e.g.:
+//   constexpr MeshId sphere = MeshId("Sphere");
+
+struct MeshId {
+	constexpr MeshId() : hash(0) { }
+
+	//from a string literal (constexpr):
+	template< size_t N >
+	constexpr MeshId(char const (&name)[N]) : hash(hash_literal(name, name + N - 1, Basis)) { }
+
+	//from a range of characters (e.g., in a strings chunk):
+	MeshId(char const *begin, char const *end) : hash(hash_range(begin, end)) { }
+
+	explicit MeshId(std::string const &name) : hash(hash_range(name.data(), name.data() + name.size())) { }
+
+	bool operator==(MeshId const &other) const { return hash == other.hash; }
+	bool operator!=(MeshId const &other) const { return hash != other.hash; }
+
+	uint64_t hash;
+
+	//internals:
+	static constexpr uint64_t Basis = 14695981039346656037ULL;
+	static constexpr uint64_t Prime = 1099511628211ULL;
+
+	static constexpr uint64_t hash_literal(char const *begin, char const *end, uint64_t h) {
+		return (begin == end ? h : hash_literal(begin + 1, end, (h ^ uint8_t(*begin)) * Prime));
+	}
+	static uint64_t hash_range(char const *begin, char const *end) {
+		uint64_t h = Basis;
+		for (char const *c = begin; c != end; ++c) {
+			h = (h ^ uint8_t(*c)) * Prime;
+		}
+		return h;
+	}
+};
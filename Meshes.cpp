@@ -1,94 +1,685 @@
 #include "Meshes.hpp"
-#include "read_chunk.hpp"
 
 #include <glm/glm.hpp>
 
 #include <stdexcept>
-#include <fstream>
 #include <iostream>
-#include <vector>
 #include <string>
+#include <algorithm>
+#include <limits>
+#include <cstddef>
+#include <cassert>
+
+//vertex formats:
+struct v3n3 { //float position and normal
+	glm::vec3 v;
+	glm::vec3 n;
+};
+static_assert(sizeof(v3n3) == 24, "v3n3 is packed");
+struct v3nq { //float position, normal packed as GL_INT_2_10_10_10_REV
+	glm::vec3 v;
+	uint32_t n;
+};
+static_assert(sizeof(v3nq) == 16, "v3nq is packed");
+struct p16n { //16-bit normalized position (dequantized by per-mesh 'qnt0' entries), packed normal
+	uint16_t v[3];
+	uint16_t pad;
+	uint32_t n;
+};
+static_assert(sizeof(p16n) == 12, "p16n is packed");
+
+//64-bit FNV-1a (as MeshId), continuing from 'hash':
+static uint64_t hash_bytes(void const *data, size_t size, uint64_t hash = MeshId::Basis) {
+	for (uint8_t const *b = static_cast< uint8_t const * >(data), *end = b + size; b != end; ++b) {
+		hash = (hash ^ *b) * MeshId::Prime;
+	}
+	return hash;
+}
 
 void Meshes::load(std::string const &filename, Attributes const &attributes) {
-	std::ifstream file(filename, std::ios::binary);
+	MeshBatch batch;
+	parse(filename, &batch);
+	upload(batch, attributes);
+}
+
+void Meshes::parse(std::string const &filename, MeshBatch *batch) {
+	parse(std::unique_ptr< ChunkFile >(new ChunkFile(filename)), batch);
+}
+
+void Meshes::parse(std::unique_ptr< ChunkFile > &&file_, MeshBatch *batch_) {
+	assert(file_);
+	assert(batch_);
+	MeshBatch &batch = *batch_;
+	batch.file = std::move(file_);
+	std::string const &filename = batch.filename = batch.file->filename;
+
+	//chunks are fetched by magic, so their order in the file doesn't matter and unknown chunks are skipped:
+	ChunkFile &file = *batch.file;
 
-	GLuint vao = 0;
 	GLuint total = 0;
-	{ //read + upload data chunk:
-		struct v3n3 {
-			glm::vec3 v;
-			glm::vec3 n;
-		};
-		static_assert(sizeof(v3n3) == 24, "v3n3 is packed");
-		std::vector< v3n3 > data;
-		read_chunk(file, "v3n3", &data);
-
-		//upload data:
-		GLuint buffer = 0;
-		glGenBuffers(1, &buffer);
-		glBindBuffer(GL_ARRAY_BUFFER, buffer);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(v3n3) * data.size(), &data[0], GL_STATIC_DRAW);
-
-		total = data.size(); //store total for later checks on index
-
-		//store binding:
-		glGenVertexArrays(1, &vao);
-		glBindVertexArray(vao);
-		if (attributes.Position != -1U) {
-			glVertexAttribPointer(attributes.Position, 3, GL_FLOAT, GL_FALSE, sizeof(v3n3), (GLbyte *)0);
-			glEnableVertexAttribArray(attributes.Position);
+	std::string &format = batch.format;
+	{ //find data chunk (its payload is read on upload, straight into the arena):
+		GLsizei &stride = batch.stride;
+		if (file.has("v3n3")) {
+			format = "v3n3";
+			stride = sizeof(v3n3);
+		} else if (file.has("v3nq")) {
+			format = "v3nq";
+			stride = sizeof(v3nq);
+		} else if (file.has("p16n")) {
+			format = "p16n";
+			stride = sizeof(p16n);
 		} else {
-			std::cerr << "WARNING: loading v3n3 data from '" << filename << "', but not using the Position attribute." << std::endl;
+			throw std::runtime_error("No vertex data chunk in '" + filename + "'");
 		}
-		if (attributes.Normal != -1U) {
-			glVertexAttribPointer(attributes.Normal, 3, GL_FLOAT, GL_FALSE, sizeof(v3n3), (GLbyte *)0 + sizeof(glm::vec3));
-			glEnableVertexAttribArray(attributes.Normal);
-		} else {
-			std::cerr << "WARNING: loading v3n3 data from '" << filename << "', but not using the Normal attribute." << std::endl;
+		batch.vertex_chunk = *file.find(format);
+
+		uint64_t bytes = file.payload_size(batch.vertex_chunk);
+		if (bytes % stride != 0) {
+			throw std::runtime_error("Size of chunk not divisible by element size");
+		}
+		if (bytes / stride > 0xffffffffULL) {
+			throw std::runtime_error("Too many vertices in '" + filename + "'");
 		}
+		total = GLuint(bytes / stride);
+		batch.vertex_count = total;
 	}
 
-	std::vector< char > strings;
-	read_chunk(file, "str0", &strings);
+	//per-mesh position dequantization (parallel to the index chunk):
+	struct Quantization {
+		glm::vec3 offset;
+		glm::vec3 scale;
+	};
+	static_assert(sizeof(Quantization) == 24, "Quantization entry should be packed");
+	ChunkSpan< Quantization > quantization;
+	if (format == "p16n") {
+		quantization = file.get< Quantization >("qnt0");
+	}
+
+	ChunkSpan< char > strings = file.get< char >("str0");
+
+	//add mesh to the batch:
+	auto add_mesh = [&](uint32_t entry_index, uint32_t name_begin, uint32_t name_end, MeshBatch::Entry &&mesh) {
+		if (!(name_begin <= name_end && name_end <= strings.size())) {
+			throw std::runtime_error("index entry has out-of-range name begin/end");
+		}
+		if (!quantization.empty()) {
+			mesh.mesh.position_offset = quantization[entry_index].offset;
+			mesh.mesh.position_scale = quantization[entry_index].scale;
+		}
+		mesh.name = std::string(strings.begin() + name_begin, strings.begin() + name_end);
+		batch.meshes.emplace_back(std::move(mesh));
+	};
+
+	if (file.has("idx1")) { //indexed meshes: read index chunks, add to meshes:
+		ChunkSpan< uint16_t > indices16;
+		if (file.has("ix16")) indices16 = file.get< uint16_t >("ix16");
+		ChunkSpan< uint32_t > indices32;
+		if (file.has("ix32")) indices32 = file.get< uint32_t >("ix32");
 
-	{ //read index chunk, add to meshes:
 		struct IndexEntry {
 			uint32_t name_begin, name_end;
 			uint32_t vertex_start, vertex_count;
+			uint32_t index_start, index_count; //indices are relative to vertex_start
 		};
-		static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+		static_assert(sizeof(IndexEntry) == 24, "Index entry should be packed");
+
+		ChunkSpan< IndexEntry > index = file.get< IndexEntry >("idx1");
+		if (!quantization.empty() && quantization.size() != index.size()) {
+			throw std::runtime_error("qnt0 chunk doesn't match index chunk");
+		}
+
+		for (uint32_t i = 0; i < index.size(); ++i) {
+			IndexEntry const &entry = index[i];
+			if (!(entry.vertex_start < entry.vertex_start + entry.vertex_count && entry.vertex_start + entry.vertex_count <= total)) {
+				throw std::runtime_error("index entry has out-of-range vertex start/count");
+			}
+			if (entry.index_count % 3 != 0) {
+				throw std::runtime_error("index entry has index count that isn't a multiple of three");
+			}
+			//meshes with more than 2^16 vertices use 32-bit indices:
+			bool wide = (entry.vertex_count > 0x10000);
+			MeshBatch::Entry mesh;
+			uint32_t max_index = 0;
+			if (wide) {
+				ChunkSpan< uint32_t > indices = indices32.subspan(entry.index_start, entry.index_count);
+				for (uint32_t v : indices) max_index = std::max(max_index, v);
+				mesh.indices = indices.begin();
+			} else {
+				ChunkSpan< uint16_t > indices = indices16.subspan(entry.index_start, entry.index_count);
+				for (uint16_t v : indices) max_index = std::max< uint32_t >(max_index, v);
+				mesh.indices = indices.begin();
+			}
+			if (entry.index_count != 0 && max_index >= entry.vertex_count) {
+				throw std::runtime_error("index entry has indices past the end of its vertex range");
+			}
+			mesh.mesh.count = entry.index_count;
+			mesh.mesh.index_type = (wide ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT);
+			mesh.vertex_start = entry.vertex_start;
+			mesh.vertex_count = entry.vertex_count;
+			add_mesh(i, entry.name_begin, entry.name_end, std::move(mesh));
+		}
+
+		//levels of detail (optional) index more of the same chunks:
+		if (file.has("lod0")) {
+			struct LodEntry {
+				uint32_t mesh; //index of the mesh's idx1 entry
+				uint32_t index_start, index_count; //relative to the mesh's vertex_start
+				float error;
+			};
+			static_assert(sizeof(LodEntry) == 16, "Lod entry should be packed");
+
+			//(meshes are added in idx1 order, so batch.meshes[n - index.size() + m] is mesh m)
+			size_t first_mesh = batch.meshes.size() - index.size();
+			for (LodEntry const &lod : file.get< LodEntry >("lod0")) {
+				if (lod.mesh >= index.size()) {
+					throw std::runtime_error("lod entry refers to a mesh that doesn't exist");
+				}
+				IndexEntry const &entry = index[lod.mesh];
+				MeshBatch::Entry &mesh = batch.meshes[first_mesh + lod.mesh];
+				if (mesh.mesh.lod_count == Mesh::MaxLods) {
+					throw std::runtime_error("mesh has more than " + std::to_string(Mesh::MaxLods) + " levels of detail");
+				}
+				if (lod.index_count % 3 != 0) {
+					throw std::runtime_error("lod entry has index count that isn't a multiple of three");
+				}
+				uint32_t max_index = 0;
+				void const *indices;
+				if (mesh.mesh.index_type == GL_UNSIGNED_INT) {
+					ChunkSpan< uint32_t > span = indices32.subspan(lod.index_start, lod.index_count);
+					for (uint32_t v : span) max_index = std::max(max_index, v);
+					indices = span.begin();
+				} else {
+					ChunkSpan< uint16_t > span = indices16.subspan(lod.index_start, lod.index_count);
+					for (uint16_t v : span) max_index = std::max< uint32_t >(max_index, v);
+					indices = span.begin();
+				}
+				if (lod.index_count != 0 && max_index >= entry.vertex_count) {
+					throw std::runtime_error("lod entry has indices past the end of its mesh's vertex range");
+				}
+				Mesh::Lod &level = mesh.mesh.lods[mesh.mesh.lod_count];
+				level.count = lod.index_count;
+				level.error = lod.error;
+				mesh.lod_indices[mesh.mesh.lod_count] = indices;
+				mesh.mesh.lod_count += 1;
+			}
+		}
 
-		std::vector< IndexEntry > index;
-		read_chunk(file, "idx0", &index);
+		//clusters (optional) split each mesh's full-detail index range:
+		if (file.has("cls0")) {
+			struct ClusterEntry {
+				uint32_t mesh; //index of the mesh's idx1 entry
+				uint32_t index_start, index_count; //within the mesh's full-detail range
+				glm::vec3 center;
+				float radius;
+				glm::vec3 cone_axis;
+				float cone_cutoff;
+			};
+			static_assert(sizeof(ClusterEntry) == 44, "Cluster entry should be packed");
 
-		for (auto const &entry : index) {
-			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
-				throw std::runtime_error("index entry has out-of-range name begin/end");
+			std::vector< std::shared_ptr< MeshClusters > > clusters(index.size());
+			for (ClusterEntry const &cluster : file.get< ClusterEntry >("cls0")) {
+				if (cluster.mesh >= index.size()) {
+					throw std::runtime_error("cluster entry refers to a mesh that doesn't exist");
+				}
+				IndexEntry const &entry = index[cluster.mesh];
+				if (!(entry.index_start <= cluster.index_start && cluster.index_start - entry.index_start <= entry.index_count && cluster.index_count <= entry.index_count - (cluster.index_start - entry.index_start))) {
+					throw std::runtime_error("cluster entry has index range outside its mesh's range");
+				}
+				if (cluster.index_count % 3 != 0) {
+					throw std::runtime_error("cluster entry has index count that isn't a multiple of three");
+				}
+				if (!clusters[cluster.mesh]) clusters[cluster.mesh].reset(new MeshClusters);
+				MeshClusters &to = *clusters[cluster.mesh];
+				to.size += 1;
+				to.center_x.emplace_back(cluster.center.x);
+				to.center_y.emplace_back(cluster.center.y);
+				to.center_z.emplace_back(cluster.center.z);
+				to.radius.emplace_back(cluster.radius);
+				to.axis_x.emplace_back(cluster.cone_axis.x);
+				to.axis_y.emplace_back(cluster.cone_axis.y);
+				to.axis_z.emplace_back(cluster.cone_axis.z);
+				to.cutoff.emplace_back(cluster.cone_cutoff);
+				to.start.emplace_back(cluster.index_start - entry.index_start);
+				to.count.emplace_back(cluster.index_count);
 			}
+			size_t first_mesh = batch.meshes.size() - index.size();
+			for (uint32_t m = 0; m < clusters.size(); ++m) {
+				if (!clusters[m]) continue;
+				MeshClusters &to = *clusters[m];
+				//pad to a multiple of four with clusters that never pass the frustum test:
+				size_t padded = (to.size + 3) / 4 * 4;
+				to.center_x.resize(padded, 0.0f);
+				to.center_y.resize(padded, 0.0f);
+				to.center_z.resize(padded, 0.0f);
+				to.radius.resize(padded, -std::numeric_limits< float >::infinity());
+				to.axis_x.resize(padded, 0.0f);
+				to.axis_y.resize(padded, 0.0f);
+				to.axis_z.resize(padded, 1.0f);
+				to.cutoff.resize(padded, 1.0f);
+				to.start.resize(padded, 0);
+				to.count.resize(padded, 0);
+				batch.meshes[first_mesh + m].mesh.clusters = clusters[m];
+			}
+		}
+	} else { //unindexed meshes (older exporters): read index chunk, add to meshes:
+		struct IndexEntry {
+			uint32_t name_begin, name_end;
+			uint32_t vertex_start, vertex_count;
+		};
+		static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+
+		ChunkSpan< IndexEntry > index = file.get< IndexEntry >("idx0");
+		if (!quantization.empty() && quantization.size() != index.size()) {
+			throw std::runtime_error("qnt0 chunk doesn't match index chunk");
+		}
+
+		for (uint32_t i = 0; i < index.size(); ++i) {
+			IndexEntry const &entry = index[i];
 			if (!(entry.vertex_start < entry.vertex_start + entry.vertex_count && entry.vertex_start + entry.vertex_count <= total)) {
 				throw std::runtime_error("index entry has out-of-range vertex start/count");
 			}
-			std::string name(&strings[0] + entry.name_begin, &strings[0] + entry.name_end);
-			Mesh mesh;
-			mesh.vao = vao;
-			mesh.start = entry.vertex_start;
-			mesh.count = entry.vertex_count;
-			bool inserted = meshes.insert(std::make_pair(name, mesh)).second;
-			if (!inserted) {
-				std::cerr << "WARNING: mesh name '" + name + "' in filename '" + filename + "' collides with existing mesh." << std::endl;
+			MeshBatch::Entry mesh;
+			mesh.mesh.count = entry.vertex_count;
+			mesh.vertex_start = entry.vertex_start;
+			mesh.vertex_count = entry.vertex_count;
+			add_mesh(i, entry.name_begin, entry.name_end, std::move(mesh));
+		}
+	}
+
+	//bounds (optional) are parallel to the index chunk, so to the batch's meshes:
+	if (file.has("bnd0")) {
+		struct BoundsEntry {
+			glm::vec3 min, max;
+			glm::vec3 center;
+			float radius;
+			float area;
+			uint32_t triangles;
+			uint32_t vertex_start, vertex_count;
+		};
+		static_assert(sizeof(BoundsEntry) == 56, "Bounds entry should be packed");
+
+		ChunkSpan< BoundsEntry > bounds = file.get< BoundsEntry >("bnd0");
+		if (bounds.size() != batch.meshes.size()) {
+			throw std::runtime_error("bnd0 chunk doesn't match index chunk");
+		}
+		for (uint32_t i = 0; i < bounds.size(); ++i) {
+			BoundsEntry const &entry = bounds[i];
+			MeshBatch::Entry &mesh = batch.meshes[i];
+			if (entry.vertex_start != mesh.vertex_start || entry.vertex_count != mesh.vertex_count) {
+				throw std::runtime_error("bounds entry has a different vertex range than its index entry");
+			}
+			Mesh::Bounds &to = mesh.mesh.bounds;
+			to.min = entry.min;
+			to.max = entry.max;
+			to.center = entry.center;
+			to.radius = entry.radius;
+			to.area = entry.area;
+			to.triangles = entry.triangles;
+			to.vertex_start = entry.vertex_start;
+			to.vertex_count = entry.vertex_count;
+			mesh.mesh.has_bounds = true;
+		}
+	}
+
+	//hash each mesh's data here (on the loading thread) so reload() can tell what changed:
+	// (vertices are read a piece at a time, so they never need to be resident; this also brings
+	//  them into the OS's file cache, so reading them again on upload doesn't wait on the disk)
+	std::vector< char > piece;
+	for (auto &mesh : batch.meshes) {
+		uint64_t begin = uint64_t(batch.stride) * mesh.vertex_start;
+		uint64_t bytes = uint64_t(batch.stride) * mesh.vertex_count;
+		uint64_t hash = MeshId::Basis;
+		for (uint64_t at = 0; at < bytes; at += piece.size()) {
+			piece.resize(size_t(std::min< uint64_t >(GeometryArena::UploadSliceBytes, bytes - at)));
+			file.read_payload(batch.vertex_chunk, begin + at, piece.size(), piece.data());
+			hash = hash_bytes(piece.data(), piece.size(), hash);
+		}
+		mesh.vertices_hash = hash;
+		if (mesh.indices) {
+			size_t index_size = (mesh.mesh.index_type == GL_UNSIGNED_INT ? 4 : 2);
+			uint64_t hash = hash_bytes(mesh.indices, index_size * mesh.mesh.count);
+			for (uint32_t l = 0; l < mesh.mesh.lod_count; ++l) {
+				hash = hash_bytes(mesh.lod_indices[l], index_size * mesh.mesh.lods[l].count, hash);
+			}
+			mesh.indices_hash = hash;
+		}
+	}
+}
+
+constexpr uint32_t Mesh::MaxLods;
+constexpr uint32_t Meshes::DrawIDCount;
+
+//point a VAO's attributes at (the currently bound) vertex buffer of a given format:
+static void set_attributes(std::string const &format, GLsizei stride, Meshes::Attributes const &attributes, GLuint draw_ids) {
+	if (attributes.Position != -1U) {
+		if (format == "p16n") {
+			glVertexAttribPointer(attributes.Position, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (GLbyte *)0);
+		} else {
+			glVertexAttribPointer(attributes.Position, 3, GL_FLOAT, GL_FALSE, stride, (GLbyte *)0);
+		}
+		glEnableVertexAttribArray(attributes.Position);
+	}
+	if (attributes.Normal != -1U) {
+		if (format == "v3n3") {
+			glVertexAttribPointer(attributes.Normal, 3, GL_FLOAT, GL_FALSE, stride, (GLbyte *)0 + offsetof(v3n3, n));
+		} else if (format == "v3nq") {
+			glVertexAttribPointer(attributes.Normal, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (GLbyte *)0 + offsetof(v3nq, n));
+		} else {
+			glVertexAttribPointer(attributes.Normal, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (GLbyte *)0 + offsetof(p16n, n));
+		}
+		glEnableVertexAttribArray(attributes.Normal);
+	}
+	if (attributes.DrawID != -1U) {
+		//one value per instance, so baseInstance (or gl_InstanceID plus a uniform) picks the draw:
+		glBindBuffer(GL_ARRAY_BUFFER, draw_ids);
+		glVertexAttribIPointer(attributes.DrawID, 1, GL_UNSIGNED_INT, sizeof(uint32_t), (GLbyte *)0);
+		glVertexAttribDivisor(attributes.DrawID, 1);
+		glEnableVertexAttribArray(attributes.DrawID);
+	}
+}
+
+uint32_t Meshes::batch_pool(MeshBatch const &batch, Attributes const &attributes) {
+	if (attributes.Position == -1U) {
+		std::cerr << "WARNING: loading " << batch.format << " data from '" << batch.filename << "', but not using the Position attribute." << std::endl;
+	}
+	if (attributes.Normal == -1U) {
+		std::cerr << "WARNING: loading " << batch.format << " data from '" << batch.filename << "', but not using the Normal attribute." << std::endl;
+	}
+
+	if (attributes.DrawID != -1U && draw_ids == 0) {
+		std::vector< uint32_t > ids(DrawIDCount);
+		for (uint32_t i = 0; i < DrawIDCount; ++i) ids[i] = i;
+		glGenBuffers(1, &draw_ids);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, draw_ids);
+		glBufferData(GL_COPY_WRITE_BUFFER, sizeof(uint32_t) * ids.size(), ids.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+
+	//all meshes with this vertex format share one pool (and so one VAO):
+	std::string format = batch.format;
+	GLsizei stride = batch.stride;
+	GLuint ids = draw_ids;
+	return arena.vertex_pool(format, stride, [format, stride, attributes, ids]() {
+		set_attributes(format, stride, attributes, ids);
+	});
+}
+
+//vertex data is read from the batch's file on upload, so it may have changed since the batch was parsed:
+// (the rewrite will be reloaded in turn, if the file is being watched)
+static void warn_if_rewritten(MeshBatch const &batch) {
+	if (batch.file->changed()) {
+		std::cerr << "WARNING: '" << batch.filename << "' was rewritten in place while being loaded; its meshes may be a mix of old and new data." << std::endl;
+	}
+}
+
+bool Meshes::write_geometry(Slot &slot, uint32_t pool, MeshBatch const &batch, MeshBatch::Entry const &entry) {
+	bool moved = false;
+
+	//vertices (read from the batch's file straight into the arena's mapped slices):
+	uint64_t begin = uint64_t(batch.stride) * entry.vertex_start;
+	auto read_vertices = [&batch, begin](char *to, size_t offset, size_t bytes) {
+		batch.file->read_payload(batch.vertex_chunk, begin + offset, bytes, to);
+	};
+	if (slot.vertices != GeometryArena::InvalidHandle && slot.pool == pool && arena.count(slot.vertices) == entry.vertex_count) {
+		if (slot.vertices_hash != entry.vertices_hash) {
+			slot.vertices_hash = 0; //(until written, in case reading fails part way)
+			arena.write(slot.vertices, 0, entry.vertex_count, read_vertices);
+		}
+	} else {
+		arena.free(slot.vertices);
+		slot.vertices = arena.allocate(pool, entry.vertex_count, nullptr);
+		slot.vertices_hash = 0;
+		arena.write(slot.vertices, 0, entry.vertex_count, read_vertices);
+		moved = true;
+	}
+	slot.pool = pool;
+	slot.vertices_hash = entry.vertices_hash;
+
+	//full-detail indices then each level of detail's, in one range:
+	GLuint index_size = (entry.mesh.index_type == GL_UNSIGNED_INT ? 4 : 2);
+	GLuint total = 0;
+	if (entry.indices) {
+		total = entry.mesh.count;
+		for (uint32_t l = 0; l < entry.mesh.lod_count; ++l) total += entry.mesh.lods[l].count;
+	}
+	if (total == 0) {
+		if (slot.indices != GeometryArena::InvalidHandle) moved = true;
+		arena.free(slot.indices);
+		slot.indices = GeometryArena::InvalidHandle;
+	} else {
+		if (slot.indices != GeometryArena::InvalidHandle && arena.count(slot.indices) == index_size * total) {
+			if (slot.indices_hash == entry.indices_hash) total = 0; //(nothing to write)
+		} else {
+			arena.free(slot.indices);
+			slot.indices = arena.allocate(GeometryArena::IndexPool, index_size * total, nullptr);
+			moved = true;
+		}
+		if (total != 0) {
+			GLuint at = 0;
+			arena.update(slot.indices, at, index_size * entry.mesh.count, entry.indices);
+			at += index_size * entry.mesh.count;
+			for (uint32_t l = 0; l < entry.mesh.lod_count; ++l) {
+				arena.update(slot.indices, at, index_size * entry.mesh.lods[l].count, entry.lod_indices[l]);
+				at += index_size * entry.mesh.lods[l].count;
+			}
+		}
+	}
+	slot.indices_hash = entry.indices_hash;
+
+	return moved;
+}
+
+void Meshes::upload(MeshBatch const &batch, Attributes const &attributes) {
+	uint32_t pool = batch_pool(batch, attributes);
+
+	//copy each mesh's vertices and indices into the arena, and add to database:
+	for (auto const &entry : batch.meshes) {
+		Slot slot;
+		slot.name = entry.name;
+		slot.mesh = entry.mesh;
+		slot.filename = batch.filename;
+		try {
+			write_geometry(slot, pool, batch, entry);
+		} catch (...) {
+			//(don't leave ranges that no mesh owns, or loaded meshes where they were before the arena moved them)
+			arena.free(slot.vertices);
+			arena.free(slot.indices);
+			locate_all();
+			throw;
+		}
+		GeometryArena::Handle vertices = slot.vertices;
+		GeometryArena::Handle indices = slot.indices;
+		bool inserted = insert(std::move(slot));
+		if (!inserted) {
+			arena.free(vertices);
+			arena.free(indices);
+			std::cerr << "WARNING: mesh name '" + entry.name + "' in filename '" + batch.filename + "' collides with existing mesh." << std::endl;
+		}
+	}
+	warn_if_rewritten(batch);
+
+	//(allocation may have moved meshes that were already loaded)
+	locate_all();
+}
+
+Meshes::Changes Meshes::reload(MeshBatch const &batch, Attributes const &attributes) {
+	Changes changes;
+	uint32_t pool = batch_pool(batch, attributes);
+
+	std::vector< uint64_t > present; //ids of the batch's meshes
+	try {
+		for (auto const &entry : batch.meshes) {
+			MeshId id(entry.name);
+			Slot *slot = find_slot(id);
+			if (!slot) {
+				Slot added;
+				added.name = entry.name;
+				added.mesh = entry.mesh;
+				added.filename = batch.filename;
+				try {
+					write_geometry(added, pool, batch, entry);
+				} catch (...) {
+					arena.free(added.vertices);
+					arena.free(added.indices);
+					throw;
+				}
+				insert(std::move(added));
+				changes.added += 1;
+			} else if (slot->name != entry.name || slot->filename != batch.filename) {
+				std::cerr << "WARNING: mesh name '" + entry.name + "' in filename '" + batch.filename + "' collides with existing mesh." << std::endl;
+				continue;
+			} else {
+				//(vao, start, and base_vertex are restored by locate_all below)
+				slot->mesh = entry.mesh;
+				if (slot->pool == pool && slot->vertices_hash == entry.vertices_hash && slot->indices_hash == entry.indices_hash) {
+					changes.unchanged += 1;
+				} else {
+					bool moved = false;
+					try {
+						moved = write_geometry(*slot, pool, batch, entry);
+					} catch (...) {
+						//(its geometry is now part old, part unwritten, so drop it until the file reloads)
+						unload(id);
+						throw;
+					}
+					if (moved) changes.resized += 1;
+					else changes.updated += 1;
+				}
 			}
+			present.emplace_back(id.hash);
 		}
+	} catch (...) {
+		//(meshes updated so far stay updated, but none should be left where the arena moved them from)
+		locate_all();
+		throw;
 	}
 
-	if (file.peek() != EOF) {
-		std::cerr << "WARNING: trailing data in mesh file '" + filename + "'" << std::endl;
+	//unload meshes that are no longer in the file:
+	std::sort(present.begin(), present.end());
+	std::vector< MeshId > removed;
+	for (Slot const &slot : slots) {
+		if (slot.id.hash == 0 || slot.filename != batch.filename) continue;
+		if (!std::binary_search(present.begin(), present.end(), slot.id.hash)) removed.emplace_back(slot.id);
+	}
+	for (MeshId const &id : removed) {
+		unload(id);
+		changes.removed += 1;
 	}
+	warn_if_rewritten(batch);
+
+	locate_all();
+	return changes;
+}
+
+bool Meshes::unload(MeshId const &id) {
+	Slot const *slot = find_slot(id);
+	if (!slot) return false;
+	arena.free(slot->vertices);
+	arena.free(slot->indices);
+	erase(uint32_t(slot - &slots[0]));
+	return true;
+}
+
+void Meshes::compact() {
+	arena.compact();
+	locate_all();
+}
+
+void Meshes::locate_all() {
+	for (Slot &slot : slots) {
+		if (slot.id.hash == 0) continue;
+		Mesh &mesh = slot.mesh;
+		mesh.vao = arena.vao(slot.pool);
+		GLuint first_vertex = arena.offset(slot.vertices);
+		if (mesh.index_type == GL_NONE) {
+			mesh.start = first_vertex;
+		} else {
+			GLuint index_size = (mesh.index_type == GL_UNSIGNED_INT ? 4 : 2);
+			mesh.start = (slot.indices != GeometryArena::InvalidHandle ? arena.offset(slot.indices) / index_size : 0);
+			mesh.base_vertex = first_vertex;
+			//levels of detail follow the full mesh's indices:
+			GLuint start = mesh.start + mesh.count;
+			for (uint32_t l = 0; l < mesh.lod_count; ++l) {
+				mesh.lods[l].start = start;
+				start += mesh.lods[l].count;
+			}
+		}
+	}
+}
+
+//slot to start probing from for an id:
+static uint32_t probe_start(MeshId const &id, size_t slot_count) {
+	return uint32_t((id.hash ^ (id.hash >> 32)) & (slot_count - 1));
+}
+
+Meshes::Slot const *Meshes::find_slot(MeshId const &id) const {
+	if (slots.empty() || id.hash == 0) return nullptr;
+	for (uint32_t i = probe_start(id, slots.size()); ; i = (i + 1) & (slots.size() - 1)) {
+		if (slots[i].id == id) return &slots[i];
+		if (slots[i].id.hash == 0) return nullptr; //table is never full, so probing always stops
+	}
+}
+
+bool Meshes::insert(Slot &&new_slot) {
+	std::string const &name = new_slot.name;
+	MeshId id(name);
+	if (id.hash == 0) {
+		throw std::runtime_error("Mesh name '" + name + "' hashes to the empty-slot id.");
+	}
+	if (Slot const *slot = find_slot(id)) {
+		if (slot->name != name) {
+			throw std::runtime_error("Mesh names '" + name + "' and '" + slot->name + "' have the same id.");
+		}
+		return false;
+	}
+
+	//keep load factor at most 1/2, so probe sequences stay short:
+	if (2 * (used + 1) > slots.size()) {
+		std::vector< Slot > old(std::max< size_t >(16, 2 * slots.size()));
+		old.swap(slots);
+		for (auto &slot : old) {
+			if (slot.id.hash == 0) continue;
+			uint32_t i = probe_start(slot.id, slots.size());
+			while (slots[i].id.hash != 0) i = (i + 1) & (slots.size() - 1);
+			slots[i] = std::move(slot);
+		}
+	}
+
+	uint32_t i = probe_start(id, slots.size());
+	while (slots[i].id.hash != 0) i = (i + 1) & (slots.size() - 1);
+	new_slot.id = id;
+	slots[i] = std::move(new_slot);
+	++used;
+	return true;
+}
+
+void Meshes::erase(uint32_t i) {
+	assert(i < slots.size() && slots[i].id.hash != 0);
+	uint32_t mask = uint32_t(slots.size() - 1);
+	slots[i] = Slot();
+	--used;
+	//shift later members of the probe sequence back into the hole, so lookups don't stop early:
+	for (uint32_t j = (i + 1) & mask; slots[j].id.hash != 0; j = (j + 1) & mask) {
+		uint32_t start = probe_start(slots[j].id, slots.size());
+		//slot j can stay if its probe start lies cyclically in (i, j]:
+		bool stays = (i <= j ? (i < start && start <= j) : (i < start || start <= j));
+		if (stays) continue;
+		slots[i] = std::move(slots[j]);
+		slots[j] = Slot();
+		i = j;
+	}
+}
+
+Mesh const *Meshes::find(MeshId const &id) const {
+	Slot const *slot = find_slot(id);
+	return (slot ? &slot->mesh : nullptr);
 }
 
-Mesh const &Meshes::get(std::string const &name) const {
-	auto f = meshes.find(name);
-	if (f == meshes.end()) {
+Mesh const &Meshes::get(MeshId const &id) const {
+	Mesh const *mesh = find(id);
+	if (!mesh) {
 		throw std::runtime_error("Looking up mesh that doesn't exist.");
 	}
-	return f->second;
+	return *mesh;
 }
@@ -1,31 +1,171 @@
 #pragma once
 
 #include "GL.hpp"
-#include <map>
+#include "MeshId.hpp"
+#include "ChunkFile.hpp"
+#include "GeometryArena.hpp"
+#include <glm/glm.hpp>
+#include <vector>
+#include <string>
+#include <memory>
+
+//clusters of a mesh's full-detail triangles ('cls0' chunk), so parts of a mesh can be culled:
+// stored as structure-of-arrays, padded to a multiple of four with clusters that are never
+// visible (radius -infinity), so culling can test four at a time.
+struct MeshClusters {
+	uint32_t size = 0; //clusters (before padding)
+	std::vector< float > center_x, center_y, center_z, radius; //object-space bounding sphere
+	std::vector< float > axis_x, axis_y, axis_z, cutoff; //normal cone (see mesh_clusters.hpp)
+	std::vector< GLuint > start, count; //index range, relative to the mesh's start
+};
 
 //Mesh is a lightweight handle to some OpenGL vertex data:
+// (meshes with the same vertex format share a vao; start and base_vertex change if the arena moves the mesh)
 struct Mesh {
 	GLuint vao = 0;
-	GLuint start = 0;
+	GLuint start = 0; //first vertex, or (for indexed meshes) first index
 	GLuint count = 0;
+	GLenum index_type = GL_NONE; //GL_UNSIGNED_SHORT or GL_UNSIGNED_INT for indexed meshes
+	GLint base_vertex = 0; //added to indices (indexed meshes only)
+	//object-space position is position_offset + position_scale * (stored position):
+	// (only quantized formats store positions relative to the mesh's bounds)
+	glm::vec3 position_offset = glm::vec3(0.0f);
+	glm::vec3 position_scale = glm::vec3(1.0f);
+	//coarser levels of detail (indexed meshes only), finest first; each draws a different
+	// index range over the same vertices and strays about 'error' (object space) from the full mesh:
+	static constexpr uint32_t MaxLods = 3;
+	struct Lod {
+		GLuint start = 0; //first index
+		GLuint count = 0;
+		float error = 0.0f;
+	};
+	uint32_t lod_count = 0;
+	Lod lods[MaxLods];
+	//object-space bounds and statistics, precomputed by the exporter ('bnd0' chunk):
+	// (all zero for blobs without bounds; check has_bounds)
+	struct Bounds {
+		glm::vec3 min = glm::vec3(0.0f), max = glm::vec3(0.0f); //axis-aligned box
+		glm::vec3 center = glm::vec3(0.0f); //bounding sphere
+		float radius = 0.0f;
+		float area = 0.0f; //surface area (full detail)
+		uint32_t triangles = 0; //(full detail)
+		uint32_t vertex_start = 0, vertex_count = 0; //vertex range in the blob
+	};
+	Bounds bounds;
+	bool has_bounds = false;
+	//full-detail triangle clusters (indexed meshes from blobs with a 'cls0' chunk; null otherwise):
+	std::shared_ptr< MeshClusters const > clusters;
 };
 
-//"Meshes" loads a collection of meshes and builds VAOs for 'em
+//"MeshBatch" holds the validated contents of a mesh file, ready to upload:
+// (parsing one touches no OpenGL state, so it can happen on a loader thread)
+// Vertex data isn't kept in memory: upload reads it from the file straight into the arena.
+struct MeshBatch {
+	std::string filename;
+	std::unique_ptr< ChunkFile > file; //keeps the file (and the index data below, which points into it) alive
+	std::string format; //vertex format (magic of the vertex data chunk)
+	ChunkFile::Entry vertex_chunk; //(in 'file')
+	GLsizei stride = 0;
+	GLuint vertex_count = 0;
+	struct Entry {
+		std::string name;
+		Mesh mesh; //count, index_type, and dequantization (vao, start, base_vertex are set on upload)
+		GLuint vertex_start = 0; //vertex range in the vertex data chunk
+		GLuint vertex_count = 0;
+		void const *indices = nullptr; //(indexed meshes) mesh.count indices, relative to vertex_start
+		void const *lod_indices[Mesh::MaxLods] = {nullptr}; //mesh.lods[i].count indices for each level of detail
+		//hashes of the vertex and (all levels') index data, so a reload can skip data that didn't change:
+		uint64_t vertices_hash = 0;
+		uint64_t indices_hash = 0;
+	};
+	std::vector< Entry > meshes;
+};
+
+//"Meshes" loads a collection of meshes into a shared geometry arena
 // you pass in a 'Bindings' object to specify which attributes to bind where
+// (attribute locations are fixed by the first upload of each vertex format)
 
 struct Meshes {
 	struct Attributes {
 		GLuint Position = -1U;
 		GLuint Normal = -1U;
+		GLuint DrawID = -1U; //per-instance uint (0, 1, 2, ...) for multi-draw submission
 	};
+	//number of DrawID values (i.e., instances that can be told apart in one draw):
+	static constexpr uint32_t DrawIDCount = 65536;
 	//add meshes from a file; use the indicated indices for attribute locations:
 	// note: will throw if file fails to read.
 	void load(std::string const &filename, Attributes const &attributes);
 
+	//load() in two steps: parse (any thread) then upload (GL thread):
+	// note: parse will throw if file fails to read.
+	static void parse(std::string const &filename, MeshBatch *batch);
+	//parse from an already-open file (e.g., one opened on demand by AssetLoader); the batch keeps it:
+	static void parse(std::unique_ptr< ChunkFile > &&file, MeshBatch *batch);
+	// note: upload and reload will throw if the batch's vertex data fails to read.
+	void upload(MeshBatch const &batch, Attributes const &attributes);
+
+	//replace the meshes previously uploaded from batch.filename with the batch's meshes:
+	// meshes are matched by name; only changed vertex and index data is re-uploaded (in place,
+	// if its size didn't change), and meshes missing from the batch are unloaded.
+	struct Changes {
+		uint32_t unchanged = 0;
+		uint32_t updated = 0; //rewritten in place
+		uint32_t resized = 0; //moved to a new range
+		uint32_t added = 0;
+		uint32_t removed = 0;
+	};
+	Changes reload(MeshBatch const &batch, Attributes const &attributes);
+
 	//look up a particular mesh in the DB:
 	// note: will throw if mesh not found.
-	Mesh const &get(std::string const &name) const;
+	Mesh const &get(MeshId const &id) const;
+	Mesh const &get(std::string const &name) const { return get(MeshId(name)); }
+
+	//look up a mesh that might not be loaded (yet); returns nullptr if not found:
+	Mesh const *find(MeshId const &id) const;
+
+	//free a mesh's geometry; returns false if it wasn't loaded:
+	bool unload(MeshId const &id);
+
+	//pack the arena's free space together:
+	// note: upload() may also move meshes; Mesh values copied out of the DB should be re-fetched after either.
+	void compact();
+
+	//all geometry lives here:
+	GeometryArena arena;
+	//buffer of DrawID values (created on first upload that uses them):
+	GLuint draw_ids = 0;
 
 	//internals:
-	std::map< std::string, Mesh > meshes;
+	// open-addressed (linear probing) table of meshes; size is zero or a power of two:
+	struct Slot {
+		MeshId id; //id.hash == 0 marks an empty slot
+		Mesh mesh;
+		std::string name; //kept to detect hash collisions on insert
+		//where the mesh's geometry lives in the arena:
+		uint32_t pool = 0;
+		GeometryArena::Handle vertices = GeometryArena::InvalidHandle;
+		GeometryArena::Handle indices = GeometryArena::InvalidHandle; //(unindexed or empty meshes have none)
+		//where it was loaded from, and what was uploaded (for reload):
+		std::string filename;
+		uint64_t vertices_hash = 0;
+		uint64_t indices_hash = 0;
+	};
+	std::vector< Slot > slots;
+	uint32_t used = 0;
+	Slot const *find_slot(MeshId const &id) const;
+	Slot *find_slot(MeshId const &id) { return const_cast< Slot * >(static_cast< Meshes const & >(*this).find_slot(id)); }
+	//add a slot (id is computed from slot.name; returns false if the name was already present):
+	// note: will throw if two different names hash to the same id.
+	bool insert(Slot &&new_slot);
+	//remove the (full) slot at index i:
+	void erase(uint32_t i);
+	//get the vertex pool for a batch's format (creating it, and the DrawID buffer, if needed):
+	uint32_t batch_pool(MeshBatch const &batch, Attributes const &attributes);
+	//copy an entry's vertices and indices into the slot's ranges (reallocating them if their sizes or pool differ):
+	// returns true if any range was reallocated.
+	bool write_geometry(Slot &slot, uint32_t pool, MeshBatch const &batch, MeshBatch::Entry const &entry);
+	//update every mesh's vao/start/base_vertex from the arena:
+	void locate_all();
 };
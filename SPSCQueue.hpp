@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <cstddef>
+
+//"SPSCQueue" is a bounded, lock-free queue for handing values from exactly one
+// producer thread to exactly one consumer thread.
+
+template< typename T >
+struct SPSCQueue {
+	SPSCQueue(size_t capacity) : slots(capacity + 1) { }
+	SPSCQueue(SPSCQueue const &) = delete;
+	SPSCQueue &operator=(SPSCQueue const &) = delete;
+
+	//producer: returns false (and leaves value alone) if the queue is full:
+	bool try_push(T &&value) {
+		size_t t = tail.load(std::memory_order_relaxed);
+		size_t next = (t + 1 == slots.size() ? 0 : t + 1);
+		if (next == head.load(std::memory_order_acquire)) return false;
+		slots[t] = std::move(value);
+		tail.store(next, std::memory_order_release);
+		return true;
+	}
+
+	//consumer: returns false if the queue is empty:
+	bool try_pop(T *value) {
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire)) return false;
+		*value = std::move(slots[h]);
+		head.store((h + 1 == slots.size() ? 0 : h + 1), std::memory_order_release);
+		return true;
+	}
+
+	//consumer: true if there is nothing to pop right now:
+	bool empty() const {
+		return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_acquire);
+	}
+
+	//internals:
+	std::vector< T > slots; //one slot always stays empty to tell 'full' from 'empty'
+	alignas(64) std::atomic< size_t > head{0}; //next slot to pop (written by consumer)
+	alignas(64) std::atomic< size_t > tail{0}; //next slot to push (written by producer)
+};
@@ -1,9 +1,20 @@
 #include "Scene.hpp"
+#include "Meshes.hpp"
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <SDL.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCENE_SSE2
+#include <emmintrin.h>
+#endif
+
 #include <iostream>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
 
 glm::mat4 Scene::Transform::make_local_to_parent() const {
 	return glm::mat4( //translate
@@ -107,6 +118,157 @@ glm::mat4 Scene::Camera::make_projection() const {
 
 //---------------------------
 
+constexpr uint32_t Scene::TexelsPerDraw;
+constexpr uint32_t Scene::Object::MaxLods;
+
+//stored position to clip space (mvp) and normal to camera space (itmv) matrices for an object:
+static void object_matrices(Scene::Object const &object, glm::mat4 const &local_to_world, glm::mat4 const &world_to_camera, glm::mat4 const &world_to_clip, glm::mat4 *mvp_, glm::mat3 *itmv_) {
+	//compute modelview+projection (stored position to clip space) matrix for this object:
+	glm::mat4 dequantize = glm::mat4(
+		glm::vec4(object.position_scale.x, 0.0f, 0.0f, 0.0f),
+		glm::vec4(0.0f, object.position_scale.y, 0.0f, 0.0f),
+		glm::vec4(0.0f, 0.0f, object.position_scale.z, 0.0f),
+		glm::vec4(object.position_offset, 1.0f)
+	);
+	*mvp_ = world_to_clip * local_to_world * dequantize;
+
+	//compute modelview (object space to camera local space) matrix for this object:
+	glm::mat4 mv = world_to_camera * local_to_world;
+
+	//NOTE: inverse cancels out transpose unless there is scale involved
+	*itmv_ = glm::inverse(glm::transpose(glm::mat3(mv)));
+}
+
+//index (or vertex) range of the object's current level of detail:
+static void lod_range(Scene::Object const &object, GLuint *start, GLuint *count) {
+	if (object.lod == 0 || object.lod > object.lod_count) {
+		*start = object.start;
+		*count = object.count;
+	} else {
+		*start = object.lods[object.lod - 1].start;
+		*count = object.lods[object.lod - 1].count;
+	}
+}
+
+//what cluster culling needs to know about one draw, in the mesh's (dequantized) object space:
+struct ClusterView {
+	glm::vec4 planes[5]; //left, right, bottom, top, near (normalized; the far plane is at infinity)
+	glm::vec3 eye; //camera position
+	bool cull_back; //also cull clusters facing away from the eye
+};
+
+static ClusterView cluster_view(glm::mat4 const &local_to_world, glm::mat4 const &world_to_clip, glm::vec3 const &camera_position, bool back_faces_culled) {
+	ClusterView view;
+	//planes of the object-space-to-clip matrix (Gribb & Hartmann), from its rows:
+	glm::mat4 m = world_to_clip * local_to_world;
+	auto row = [&m](uint32_t r) { return glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]); };
+	view.planes[0] = row(3) + row(0);
+	view.planes[1] = row(3) - row(0);
+	view.planes[2] = row(3) + row(1);
+	view.planes[3] = row(3) - row(1);
+	view.planes[4] = row(3) + row(2);
+	for (glm::vec4 &plane : view.planes) {
+		//(scaled to object-space distances, so spheres in object space can be tested directly)
+		float length = glm::length(glm::vec3(plane));
+		if (length > 0.0f) plane = plane * (1.0f / length);
+	}
+	//whether a triangle faces the eye doesn't change under an affine transform, so the cone
+	// test works in object space -- unless the transform mirrors, which swaps front and back:
+	view.eye = glm::vec3(glm::inverse(local_to_world) * glm::vec4(camera_position, 1.0f));
+	view.cull_back = back_faces_culled && glm::determinant(glm::mat3(local_to_world)) > 0.0f;
+	return view;
+}
+
+//append the index ranges of the visible clusters (merging neighbours) to *ranges; returns how many were visible:
+static uint32_t cull_clusters(MeshClusters const &clusters, ClusterView const &view, std::vector< Scene::MultiDrawState::Range > *ranges_) {
+	assert(ranges_);
+	auto &ranges = *ranges_;
+	uint32_t visible_count = 0;
+	auto emit = [&](uint32_t c) {
+		visible_count += 1;
+		if (!ranges.empty() && ranges.back().start + ranges.back().count == clusters.start[c]) {
+			ranges.back().count += clusters.count[c];
+		} else {
+			ranges.emplace_back(Scene::MultiDrawState::Range{clusters.start[c], clusters.count[c]});
+		}
+	};
+	//(padding clusters have radius -infinity, so they are never visible)
+	for (uint32_t c = 0; c < clusters.size; c += 4) {
+		#ifdef SCENE_SSE2
+		__m128 x = _mm_loadu_ps(&clusters.center_x[c]);
+		__m128 y = _mm_loadu_ps(&clusters.center_y[c]);
+		__m128 z = _mm_loadu_ps(&clusters.center_z[c]);
+		__m128 radius = _mm_loadu_ps(&clusters.radius[c]);
+		__m128 neg_radius = _mm_sub_ps(_mm_setzero_ps(), radius);
+		//inside (or touching) every plane:
+		__m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (glm::vec4 const &plane : view.planes) {
+			__m128 distance = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_mul_ps(y, _mm_set1_ps(plane.y))),
+				_mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+			visible = _mm_and_ps(visible, _mm_cmpgt_ps(distance, neg_radius));
+		}
+		if (view.cull_back) {
+			//back-facing if dot(center - eye, axis) >= cutoff * length(center - eye) + radius:
+			__m128 dx = _mm_sub_ps(x, _mm_set1_ps(view.eye.x));
+			__m128 dy = _mm_sub_ps(y, _mm_set1_ps(view.eye.y));
+			__m128 dz = _mm_sub_ps(z, _mm_set1_ps(view.eye.z));
+			__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+			__m128 along = _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(dx, _mm_loadu_ps(&clusters.axis_x[c])),
+				_mm_mul_ps(dy, _mm_loadu_ps(&clusters.axis_y[c]))),
+				_mm_mul_ps(dz, _mm_loadu_ps(&clusters.axis_z[c])));
+			__m128 back = _mm_cmpge_ps(along, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&clusters.cutoff[c]), length), radius));
+			visible = _mm_andnot_ps(back, visible);
+		}
+		int mask = _mm_movemask_ps(visible);
+		for (uint32_t i = 0; i < 4; ++i) {
+			if (mask & (1 << i)) emit(c + i);
+		}
+		#else
+		for (uint32_t i = c; i < c + 4; ++i) {
+			glm::vec3 center(clusters.center_x[i], clusters.center_y[i], clusters.center_z[i]);
+			float radius = clusters.radius[i];
+			bool visible = true;
+			for (glm::vec4 const &plane : view.planes) {
+				if (!(glm::dot(glm::vec3(plane), center) + plane.w > -radius)) visible = false;
+			}
+			if (visible && view.cull_back) {
+				glm::vec3 to = center - view.eye;
+				glm::vec3 axis(clusters.axis_x[i], clusters.axis_y[i], clusters.axis_z[i]);
+				if (glm::dot(to, axis) >= clusters.cutoff[i] * glm::length(to) + radius) visible = false;
+			}
+			if (visible) emit(i);
+		}
+		#endif
+	}
+	return visible_count;
+}
+
+void Scene::select_lod(Object &object, glm::mat4 const &local_to_world, glm::vec3 const &camera_position) const {
+	if (object.lod_count == 0) {
+		object.lod = 0;
+		return;
+	}
+	//screen-height fraction covered by one object-space unit at the object's distance:
+	float scale = std::max(glm::length(glm::vec3(local_to_world[0])), std::max(glm::length(glm::vec3(local_to_world[1])), glm::length(glm::vec3(local_to_world[2]))));
+	float distance = std::max(glm::length(glm::vec3(local_to_world[3]) - camera_position), camera.near);
+	float to_screen = scale / (distance * 2.0f * std::tan(0.5f * camera.fovy));
+	auto screen_error = [&](uint32_t lod) {
+		return (lod == 0 ? 0.0f : object.lods[lod - 1].error * to_screen);
+	};
+
+	uint32_t lod = std::min(object.lod, object.lod_count);
+	if (screen_error(lod) > lod_tolerance * (1.0f + lod_hysteresis)) {
+		//current level is clearly too coarse; refine until it isn't:
+		while (lod > 0 && screen_error(lod) > lod_tolerance) --lod;
+	} else {
+		//coarsen while the next level is clearly fine:
+		while (lod < object.lod_count && screen_error(lod + 1) < lod_tolerance * (1.0f - lod_hysteresis)) ++lod;
+	}
+	object.lod = lod;
+}
+
 void Scene::render() {
 	glm::mat4 world_to_camera = camera.transform.make_world_to_local();
 	glm::mat4 world_to_clip = camera.make_projection() * world_to_camera;
@@ -117,20 +279,39 @@ void Scene::render() {
 		(void)mv;
 	}
 
-	for (auto const &object : objects) {
-		glm::mat4 local_to_world = object.transform.make_local_to_world();
+	glm::vec3 camera_position = glm::vec3(camera.transform.make_local_to_world()[3]);
 
-		//compute modelview+projection (object space to clip space) matrix for this object:
-		glm::mat4 mvp = world_to_clip * local_to_world;
+	draw_calls = 0;
+	triangles = 0;
+	clusters_culled = 0;
+
+	if (submission == MultiDraw) {
+		render_multidraw(camera_position, world_to_camera, world_to_clip);
+		return;
+	}
 
-		//compute modelview (object space to camera local space) matrix for this object:
-		glm::mat4 mv = world_to_camera * local_to_world;
+	//objects often share programs and (since meshes of a format share one) VAOs, so only bind on change:
+	GLuint bound_program = 0;
+	GLuint bound_vao = 0;
 
-		//NOTE: inverse cancels out transpose unless there is scale involved
-		glm::mat3 itmv = glm::inverse(glm::transpose(glm::mat3(mv)));
+	for (auto &object : objects) {
+		if (object.count == 0) continue; //e.g., mesh not loaded yet
+
+		glm::mat4 local_to_world = object.transform.make_local_to_world();
+		select_lod(object, local_to_world, camera_position);
+		GLuint start, count;
+		lod_range(object, &start, &count);
+		if (count == 0) continue;
+
+		glm::mat4 mvp;
+		glm::mat3 itmv;
+		object_matrices(object, local_to_world, world_to_camera, world_to_clip, &mvp, &itmv);
 
 		//set up program uniforms:
-		glUseProgram(object.program);
+		if (object.program != bound_program) {
+			glUseProgram(object.program);
+			bound_program = object.program;
+		}
 		if (object.program_mvp != -1U) {
 			glUniformMatrix4fv(object.program_mvp, 1, GL_FALSE, glm::value_ptr(mvp));
 		}
@@ -138,9 +319,255 @@ void Scene::render() {
 			glUniformMatrix3fv(object.program_itmv, 1, GL_FALSE, glm::value_ptr(itmv));
 		}
 
-		glBindVertexArray(object.vao);
+		if (object.vao != bound_vao) {
+			glBindVertexArray(object.vao);
+			bound_vao = object.vao;
+		}
 
 		//draw the object:
-		glDrawArrays(GL_TRIANGLES, object.start, object.count);
+		if (object.index_type == GL_NONE) {
+			glDrawArrays(GL_TRIANGLES, start, count);
+		} else {
+			GLuint index_size = (object.index_type == GL_UNSIGNED_INT ? 4 : 2);
+			glDrawElementsBaseVertex(GL_TRIANGLES, count, object.index_type, (GLbyte *)0 + index_size * start, object.base_vertex);
+		}
+		++draw_calls;
+		triangles += count / 3;
+	}
+}
+
+void Scene::render_multidraw(glm::vec3 const &camera_position, glm::mat4 const &world_to_camera, glm::mat4 const &world_to_clip) {
+	MultiDrawState &state = multidraw_state;
+	if (!state.initialized) {
+		state.initialized = true;
+		//multi-draw-indirect with baseInstance is core in 4.3; the context may be newer than the 3.3 asked for:
+		GLint major = 0, minor = 0;
+		glGetIntegerv(GL_MAJOR_VERSION, &major);
+		glGetIntegerv(GL_MINOR_VERSION, &minor);
+		if (major > 4 || (major == 4 && minor >= 3)) {
+			state.MultiDrawElementsIndirect = (PFNGLMULTIDRAWELEMENTSINDIRECTPROC)SDL_GL_GetProcAddress("glMultiDrawElementsIndirect");
+			state.MultiDrawArraysIndirect = (PFNGLMULTIDRAWARRAYSINDIRECTPROC)SDL_GL_GetProcAddress("glMultiDrawArraysIndirect");
+			state.indirect = (state.MultiDrawElementsIndirect && state.MultiDrawArraysIndirect);
+		}
+		if (!state.indirect) {
+			std::cerr << "NOTE: OpenGL " << major << "." << minor << " has no multi-draw-indirect; multi-draw will use one instanced draw per mesh." << std::endl;
+		}
+		glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &state.max_texels);
+
+		glGenBuffers(1, &state.draws_buffer);
+		glGenTextures(1, &state.draws_texture);
+		glBindBuffer(GL_TEXTURE_BUFFER, state.draws_buffer);
+		glBufferData(GL_TEXTURE_BUFFER, 0, NULL, GL_STREAM_DRAW);
+		glBindTexture(GL_TEXTURE_BUFFER, state.draws_texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, state.draws_buffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+		if (state.indirect) {
+			glGenBuffers(1, &state.commands_buffer);
+		}
+		state.workers.reset(new ThreadPool());
+	}
+
+	//draw order: grouped by vao and index type (one multi-draw each), then by mesh (one instanced command each):
+	typedef MultiDrawState::Draw Draw;
+	typedef MultiDrawState::Range Range;
+	std::vector< Draw > &order = state.order;
+	order.clear();
+	std::vector< uint32_t > &clustered = state.clustered;
+	clustered.clear();
+	uint32_t cluster_count = 0;
+	for (auto &object : objects) {
+		if (object.count == 0) continue; //e.g., mesh not loaded yet
+		Draw draw;
+		draw.object = &object;
+		draw.local_to_world = object.transform.make_local_to_world();
+		select_lod(object, draw.local_to_world, camera_position);
+		lod_range(object, &draw.start, &draw.count);
+		if (draw.count == 0) continue;
+		draw.clustered = -1U;
+		if (cluster_culling && object.lod == 0 && object.clusters && object.index_type != GL_NONE) {
+			draw.clustered = uint32_t(clustered.size());
+			clustered.emplace_back(uint32_t(order.size()));
+			cluster_count += object.clusters->size;
+		}
+		order.emplace_back(draw);
+	}
+
+	{ //cull clusters (on the workers if there are enough to be worth it):
+		std::vector< std::vector< Range > > &cluster_ranges = state.cluster_ranges;
+		cluster_ranges.resize(clustered.size());
+		state.clusters_culled.resize(clustered.size());
+		auto cull = [&](uint32_t k) {
+			Draw const &draw = order[clustered[k]];
+			cluster_ranges[k].clear();
+			uint32_t visible = cull_clusters(*draw.object->clusters, cluster_view(draw.local_to_world, world_to_clip, camera_position, back_faces_culled), &cluster_ranges[k]);
+			state.clusters_culled[k] = draw.object->clusters->size - visible;
+		};
+		static constexpr uint32_t ParallelClusters = 4096;
+		if (cluster_count >= ParallelClusters && state.workers->size() > 1) {
+			uint32_t jobs = std::min< uint32_t >(uint32_t(clustered.size()), 4 * state.workers->size());
+			state.workers->parallel_for(jobs, [&](uint32_t job) {
+				for (uint32_t k = job; k < clustered.size(); k += jobs) cull(k);
+			});
+		} else {
+			for (uint32_t k = 0; k < clustered.size(); ++k) cull(k);
+		}
+
+		//drop draws with no visible clusters, and count what is left:
+		uint32_t kept = 0;
+		for (Draw const &draw : order) {
+			uint32_t count = draw.count;
+			if (draw.clustered != -1U) {
+				count = 0;
+				for (Range const &range : cluster_ranges[draw.clustered]) count += range.count;
+				clusters_culled += state.clusters_culled[draw.clustered];
+				if (count == 0) continue;
+			}
+			order[kept++] = draw;
+			triangles += count / 3;
+		}
+		order.resize(kept);
+	}
+
+	auto same_mesh = [](Draw const &a, Draw const &b) {
+		return a.clustered == -1U && b.clustered == -1U
+		    && a.object->vao == b.object->vao && a.object->index_type == b.object->index_type && a.start == b.start && a.count == b.count && a.object->base_vertex == b.object->base_vertex;
+	};
+	std::sort(order.begin(), order.end(), [](Draw const &a, Draw const &b) {
+		if (a.object->vao != b.object->vao) return a.object->vao < b.object->vao;
+		if (a.object->index_type != b.object->index_type) return a.object->index_type < b.object->index_type;
+		if (a.start != b.start) return a.start < b.start;
+		if (a.count != b.count) return a.count < b.count;
+		return a.object->base_vertex < b.object->base_vertex;
+	});
+
+	glUseProgram(multidraw.program);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_BUFFER, state.draws_texture);
+	if (multidraw.program_draws != -1U) {
+		glUniform1i(multidraw.program_draws, 0);
+	}
+	if (multidraw.program_draw_base != -1U) {
+		glUniform1i(multidraw.program_draw_base, 0);
+	}
+	if (state.indirect) {
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, state.commands_buffer);
+	}
+
+	//draws in one pass are limited by the DrawID values in the VAOs and by the buffer texture size:
+	uint32_t pass_size = std::min< uint32_t >(multidraw.max_draws, uint32_t(state.max_texels) / TexelsPerDraw);
+	assert(pass_size > 0 && "multidraw.max_draws should be set to the number of DrawID values");
+
+	for (uint32_t pass_begin = 0; pass_begin < order.size(); pass_begin += pass_size) {
+		uint32_t pass_end = std::min< uint32_t >(uint32_t(order.size()), pass_begin + pass_size);
+
+		{ //upload per-draw matrices:
+			std::vector< glm::vec4 > &draws = state.draws;
+			draws.resize(TexelsPerDraw * (pass_end - pass_begin));
+			for (uint32_t i = pass_begin; i < pass_end; ++i) {
+				glm::mat4 mvp;
+				glm::mat3 itmv;
+				object_matrices(*order[i].object, order[i].local_to_world, world_to_camera, world_to_clip, &mvp, &itmv);
+				glm::vec4 *texel = &draws[TexelsPerDraw * (i - pass_begin)];
+				texel[0] = mvp[0]; texel[1] = mvp[1]; texel[2] = mvp[2]; texel[3] = mvp[3];
+				texel[4] = glm::vec4(itmv[0], 0.0f); texel[5] = glm::vec4(itmv[1], 0.0f); texel[6] = glm::vec4(itmv[2], 0.0f);
+			}
+			glBindBuffer(GL_TEXTURE_BUFFER, state.draws_buffer);
+			//(orphan last pass's storage rather than waiting for it to be read)
+			glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::vec4) * draws.size(), NULL, GL_STREAM_DRAW);
+			glBufferSubData(GL_TEXTURE_BUFFER, 0, sizeof(glm::vec4) * draws.size(), draws.data());
+			glBindBuffer(GL_TEXTURE_BUFFER, 0);
+		}
+
+		//runs of objects that use the same mesh become one instanced command:
+		// (DrawID is baseInstance + instance for indirect draws, and draw_base + instance otherwise)
+		struct Group {
+			Object const *first; //(vao and index type)
+			uint32_t command_begin, command_end; //in commands (indirect) or order (instanced)
+		};
+		std::vector< Group > groups;
+		std::vector< GLuint > &commands = state.commands;
+		commands.clear();
+		for (uint32_t i = pass_begin; i < pass_end; ) {
+			Draw const &draw = order[i];
+			Object const &object = *draw.object;
+			uint32_t run = 1;
+			while (i + run < pass_end && same_mesh(order[i], order[i + run])) ++run;
+
+			if (groups.empty() || groups.back().first->vao != object.vao || groups.back().first->index_type != object.index_type) {
+				uint32_t begin = (state.indirect ? uint32_t(commands.size()) : i);
+				groups.emplace_back(Group{&object, begin, begin});
+			}
+			if (state.indirect) {
+				if (draw.clustered != -1U) { //DrawElementsIndirectCommand per run of visible clusters:
+					for (Range const &range : state.cluster_ranges[draw.clustered]) {
+						commands.insert(commands.end(), {range.count, 1, draw.start + range.start, GLuint(object.base_vertex), i - pass_begin});
+					}
+				} else if (object.index_type == GL_NONE) { //DrawArraysIndirectCommand:
+					commands.insert(commands.end(), {draw.count, run, draw.start, i - pass_begin});
+				} else { //DrawElementsIndirectCommand:
+					commands.insert(commands.end(), {draw.count, run, draw.start, GLuint(object.base_vertex), i - pass_begin});
+				}
+				groups.back().command_end = uint32_t(commands.size());
+			} else {
+				groups.back().command_end = i + run;
+			}
+			i += run;
+		}
+
+		if (state.indirect) {
+			glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(GLuint) * commands.size(), commands.data(), GL_STREAM_DRAW);
+		}
+
+		for (Group const &group : groups) {
+			glBindVertexArray(group.first->vao);
+			GLenum index_type = group.first->index_type;
+			if (state.indirect) {
+				GLsizei stride = (index_type == GL_NONE ? 4 : 5) * sizeof(GLuint);
+				GLsizei count = (group.command_end - group.command_begin) * sizeof(GLuint) / stride;
+				GLbyte const *offset = (GLbyte *)0 + sizeof(GLuint) * group.command_begin;
+				if (index_type == GL_NONE) {
+					state.MultiDrawArraysIndirect(GL_TRIANGLES, offset, count, stride);
+				} else {
+					state.MultiDrawElementsIndirect(GL_TRIANGLES, index_type, offset, count, stride);
+				}
+				++draw_calls;
+			} else {
+				for (uint32_t i = group.command_begin; i < group.command_end; ) {
+					Draw const &draw = order[i];
+					uint32_t run = 1;
+					while (i + run < group.command_end && same_mesh(order[i], order[i + run])) ++run;
+					if (multidraw.program_draw_base != -1U) {
+						glUniform1i(multidraw.program_draw_base, i - pass_begin);
+					}
+					if (draw.clustered != -1U) {
+						//visible clusters in one call (not instanced, so DrawID is draw_base):
+						GLuint index_size = (index_type == GL_UNSIGNED_INT ? 4 : 2);
+						state.range_counts.clear();
+						state.range_offsets.clear();
+						state.range_base_vertices.clear();
+						for (Range const &range : state.cluster_ranges[draw.clustered]) {
+							state.range_counts.emplace_back(GLsizei(range.count));
+							state.range_offsets.emplace_back((GLbyte *)0 + index_size * (draw.start + range.start));
+							state.range_base_vertices.emplace_back(draw.object->base_vertex);
+						}
+						glMultiDrawElementsBaseVertex(GL_TRIANGLES, state.range_counts.data(), index_type, state.range_offsets.data(), GLsizei(state.range_counts.size()), state.range_base_vertices.data());
+					} else if (index_type == GL_NONE) {
+						glDrawArraysInstanced(GL_TRIANGLES, draw.start, draw.count, run);
+					} else {
+						GLuint index_size = (index_type == GL_UNSIGNED_INT ? 4 : 2);
+						glDrawElementsInstancedBaseVertex(GL_TRIANGLES, draw.count, index_type, (GLbyte *)0 + index_size * draw.start, run, draw.object->base_vertex);
+					}
+					++draw_calls;
+					i += run;
+				}
+			}
+		}
+	}
+
+	if (state.indirect) {
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
 	}
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindVertexArray(0);
 }
@@ -1,13 +1,19 @@
 #pragma once
 
 #include "GL.hpp"
+#include "MeshId.hpp"
+#include "ThreadPool.hpp"
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <vector>
 #include <list>
+#include <memory>
+#include <cstdint>
 
 #undef near //windows.h steps on this
 
+struct MeshClusters; //(Meshes.hpp)
+
 //Describes a 3D scene for rendering:
 struct Scene {
 	struct Transform {
@@ -58,9 +64,26 @@ struct Scene {
 	struct Object {
 		Transform transform;
 		//geometric info:
+		MeshId mesh; //mesh the info below was copied from (so it can be re-fetched if the mesh moves)
 		GLuint vao = 0;
-		GLuint start = 0;
+		GLuint start = 0; //first vertex, or (for indexed meshes) first index
 		GLuint count = 0;
+		GLenum index_type = GL_NONE; //GL_UNSIGNED_SHORT or GL_UNSIGNED_INT for indexed meshes
+		GLint base_vertex = 0;
+		glm::vec3 position_offset = glm::vec3(0.0f); //dequantization of stored positions
+		glm::vec3 position_scale = glm::vec3(1.0f);
+		//coarser levels of detail (as in Mesh), and the level currently drawn (0 is the full mesh):
+		static constexpr uint32_t MaxLods = 3;
+		struct Lod {
+			GLuint start = 0;
+			GLuint count = 0;
+			float error = 0.0f;
+		};
+		uint32_t lod_count = 0;
+		Lod lods[MaxLods];
+		uint32_t lod = 0;
+		//clusters of the full-detail triangles (as in Mesh; may be null):
+		std::shared_ptr< MeshClusters const > clusters;
 		//program info:
 		GLuint program = 0;
 		GLuint program_mvp = -1U; //uniform index for MVP matrix
@@ -76,5 +99,74 @@ struct Scene {
 	std::list< Object > objects;
 	std::list< Light > lights;
 
+	//how render() submits objects:
+	// PerObject draws each object with its own program and uniforms.
+	// MultiDraw draws every object with 'multidraw.program', grouping objects by vao and mesh into
+	//  a few multi-draw-indirect calls (GL 4.3+) or one instanced draw per mesh (GL 3.3):
+	enum Submission { PerObject, MultiDraw };
+	Submission submission = PerObject;
+	struct {
+		GLuint program = 0;
+		GLuint program_draws = -1U; //uniform index for samplerBuffer of per-draw data (TexelsPerDraw texels per draw)
+		GLuint program_draw_base = -1U; //uniform index for int added to the DrawID attribute
+		uint32_t max_draws = 0; //DrawID attribute values available in VAOs (limits draws per pass)
+	} multidraw;
+	//per-draw data is mvp (four columns) then itmv (three columns, w unused):
+	static constexpr uint32_t TexelsPerDraw = 7;
+
+	//level of detail selection: draw the coarsest level whose error covers at most 'lod_tolerance'
+	// of the screen's height, but only switch levels once the error is 'lod_hysteresis' (as a
+	// fraction of the tolerance) past it, so objects near a switching distance don't flicker:
+	float lod_tolerance = 1.0f / 600.0f;
+	float lod_hysteresis = 0.25f;
+
+	//(MultiDraw only) objects drawn at full detail with mesh clusters draw just the clusters that
+	// overlap the view frustum and -- when 'back_faces_culled' says GL_CULL_FACE is discarding
+	// GL_BACK faces (with GL_CCW front faces) -- don't face away from the camera:
+	// (clusters are tested four at a time, spread over worker threads when there are many)
+	bool cluster_culling = true;
+	bool back_faces_culled = false;
+
+	//draw calls issued, triangles drawn, and clusters culled by the last render():
+	uint32_t draw_calls = 0;
+	uint32_t triangles = 0;
+	uint32_t clusters_culled = 0;
+
 	void render();
+
+	//internals:
+	void select_lod(Object &object, glm::mat4 const &local_to_world, glm::vec3 const &camera_position) const;
+	void render_multidraw(glm::vec3 const &camera_position, glm::mat4 const &world_to_camera, glm::mat4 const &world_to_clip);
+	struct MultiDrawState {
+		bool initialized = false;
+		bool indirect = false; //glMultiDraw*Indirect (with baseInstance) available
+		PFNGLMULTIDRAWELEMENTSINDIRECTPROC MultiDrawElementsIndirect = nullptr;
+		PFNGLMULTIDRAWARRAYSINDIRECTPROC MultiDrawArraysIndirect = nullptr;
+		GLint max_texels = 0;
+		GLuint draws_buffer = 0; //per-draw data
+		GLuint draws_texture = 0; //(buffer texture view of draws_buffer)
+		GLuint commands_buffer = 0; //indirect commands
+		//scratch space, kept to avoid per-frame allocation:
+		struct Draw {
+			Object const *object;
+			GLuint start, count; //(of the selected level of detail)
+			glm::mat4 local_to_world;
+			uint32_t clustered; //index in cluster_ranges, or -1U if drawn whole
+		};
+		std::vector< Draw > order;
+		std::vector< glm::vec4 > draws;
+		std::vector< GLuint > commands;
+		//clustered draws (indices in order), then index ranges (relative to the object's start)
+		// of each one's visible clusters, and how many of its clusters were culled:
+		std::vector< uint32_t > clustered;
+		struct Range {
+			GLuint start, count;
+		};
+		std::vector< std::vector< Range > > cluster_ranges;
+		std::vector< uint32_t > clusters_culled;
+		std::vector< GLsizei > range_counts; //(glMultiDrawElementsBaseVertex arguments)
+		std::vector< void const * > range_offsets;
+		std::vector< GLint > range_base_vertices;
+		std::unique_ptr< ThreadPool > workers; //(for cluster culling)
+	} multidraw_state;
 };
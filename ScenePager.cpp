@@ -0,0 +1,199 @@
+#include "ScenePager.hpp"
+#include "FileWatcher.hpp"
+
+#include <chrono>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <cassert>
+
+ScenePager::ScenePager(std::string const &filename_, Limits const &limits_, bool watch) : resident_pages(0), resident_entries(0), filename(filename_), limits(limits_), changes(64), quit(false) {
+	open();
+	thread = std::thread(&ScenePager::run, this, watch);
+}
+
+ScenePager::~ScenePager() {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	thread.join();
+}
+
+void ScenePager::set_focus(glm::vec3 const &focus_) {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		if (focus_ == focus) return; //(e.g., the camera didn't move this frame)
+		focus = focus_;
+		focus_changed = true;
+	}
+	wake.notify_one();
+}
+
+void ScenePager::open() {
+	//(all or nothing, so a failed reopen leaves the old blob in use)
+	std::unique_ptr< ChunkFile > opened(new ChunkFile(filename, ChunkFile::OnDemand()));
+	std::vector< PageEntry > opened_pages;
+	if (opened->has("pag0")) {
+		for (PageEntry const &page : opened->get< PageEntry >("pag0")) {
+			if (!(page.min.x <= page.max.x && page.min.y <= page.max.y && page.min.z <= page.max.z)) {
+				throw std::runtime_error("page entry has an inside-out box");
+			}
+			opened_pages.emplace_back(page);
+		}
+	} else {
+		//one page with every entry (its count is only known once it is read):
+		PageEntry everything;
+		everything.min = glm::vec3(-std::numeric_limits< float >::infinity());
+		everything.max = glm::vec3(std::numeric_limits< float >::infinity());
+		everything.entry_start = 0;
+		everything.entry_count = -1U;
+		opened_pages.emplace_back(everything);
+	}
+	file = std::move(opened);
+	pages = std::move(opened_pages);
+}
+
+void ScenePager::run(bool watch) {
+	//hand a change to the GL thread, waiting for room in the queue:
+	auto push = [this](std::unique_ptr< Change > &&change) {
+		while (!changes.try_push(std::move(change))) {
+			if (quit) return false;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		return true;
+	};
+
+	std::unique_ptr< FileWatcher > watcher;
+	if (watch) watcher.reset(new FileWatcher({filename}));
+
+	//pager's view of what is resident:
+	std::vector< uint32_t > loaded; //entries of each resident page (-1U if not resident)
+	std::vector< bool > failed; //pages that failed to load (not retried until the blob changes)
+	uint32_t loaded_entries = 0;
+	auto reset = [&]() {
+		loaded.assign(pages.size(), -1U);
+		failed.assign(pages.size(), false);
+		loaded_entries = 0;
+		resident_pages = 0;
+		resident_entries = 0;
+	};
+	reset();
+
+	//(once the blob has changed, no more pages are loaded from the old contents)
+	bool changed = false;
+	//(a blob rewritten in place that failed to reopen: no pages are loaded from it until it changes again)
+	bool stale = false;
+	auto check_changed = [&]() {
+		if (watcher && !changed && !watcher->poll(std::chrono::milliseconds(0)).empty()) changed = true;
+		return changed;
+	};
+
+	std::vector< float > distance;
+	std::vector< uint32_t > near;
+	while (!quit) {
+		glm::vec3 at;
+		{ //wait for the focus to move (or, now and then, to check the blob):
+			std::unique_lock< std::mutex > lock(mutex);
+			if (!changed) wake.wait_for(lock, std::chrono::milliseconds(100), [this](){ return quit || focus_changed; });
+			if (quit) return;
+			at = focus;
+			focus_changed = false;
+		}
+
+		if (check_changed()) {
+			changed = false;
+			try {
+				open();
+			} catch (std::exception &e) {
+				stale = file->changed();
+				std::unique_ptr< Change > change(new Change);
+				change->type = Change::Error;
+				change->error = "Failed to reload '" + filename + "': " + e.what();
+				if (!push(std::move(change))) return;
+				continue;
+			}
+			std::unique_ptr< Change > change(new Change);
+			change->type = Change::Clear;
+			if (!push(std::move(change))) return;
+			reset();
+			stale = false;
+		}
+
+		//distance from the focus to each page's box:
+		distance.resize(pages.size());
+		for (uint32_t p = 0; p < pages.size(); ++p) {
+			glm::vec3 closest = glm::clamp(at, pages[p].min, pages[p].max);
+			distance[p] = glm::length(closest - at);
+		}
+
+		auto unload = [&](uint32_t p) {
+			std::unique_ptr< Change > change(new Change);
+			change->type = Change::Unload;
+			change->page = p;
+			if (!push(std::move(change))) return false;
+			loaded_entries -= loaded[p];
+			loaded[p] = -1U;
+			resident_pages -= 1;
+			resident_entries = loaded_entries;
+			return true;
+		};
+
+		//unload pages that are too far away:
+		for (uint32_t p = 0; p < pages.size(); ++p) {
+			if (loaded[p] != -1U && distance[p] > limits.unload_distance) {
+				if (!unload(p)) return;
+			}
+		}
+
+		//load pages that are close enough, nearest first:
+		near.clear();
+		for (uint32_t p = 0; p < pages.size(); ++p) {
+			if (loaded[p] == -1U && !failed[p] && distance[p] <= limits.load_distance) near.emplace_back(p);
+		}
+		std::sort(near.begin(), near.end(), [&distance](uint32_t a, uint32_t b) { return distance[a] < distance[b]; });
+		for (uint32_t p : near) {
+			PageEntry const &page = pages[p];
+			//make room by unloading farther pages, farthest first:
+			while (loaded_entries != 0 && uint64_t(loaded_entries) + page.entry_count > limits.max_entries) {
+				uint32_t farthest = -1U;
+				for (uint32_t q = 0; q < pages.size(); ++q) {
+					if (loaded[q] != -1U && distance[q] > distance[p] && (farthest == -1U || distance[q] > distance[farthest])) farthest = q;
+				}
+				if (farthest == -1U) break;
+				if (!unload(farthest)) return;
+			}
+			if (loaded_entries != 0 && uint64_t(loaded_entries) + page.entry_count > limits.max_entries) break; //(over budget; wait for the focus to move)
+			if (check_changed() || stale) break; //(reopen before loading more)
+
+			std::unique_ptr< Change > change(new Change);
+			change->page = p;
+			try {
+				uint32_t end = (page.entry_count == -1U ? -1U : page.entry_start + page.entry_count);
+				if (end < page.entry_start) throw std::runtime_error("page entry has out-of-range entry start/count");
+				AssetLoader::parse_scene(*file, page.entry_start, end, &change->entries);
+			} catch (std::exception &e) {
+				if (watcher && file->changed()) { changed = true; break; } //(read across a rewrite; reopen and retry)
+				change->type = Change::Error;
+				change->entries.clear();
+				change->error = "Failed to load page " + std::to_string(p) + " of '" + filename + "': " + e.what();
+				failed[p] = true;
+				if (!push(std::move(change))) return;
+				continue;
+			}
+			if (watcher && file->changed()) { changed = true; break; } //(entries may mix old and new contents; reopen and reload)
+			change->type = Change::Load;
+			uint32_t count = uint32_t(change->entries.size());
+			if (!push(std::move(change))) return;
+			loaded[p] = count;
+			loaded_entries += count;
+			resident_pages += 1;
+			resident_entries = loaded_entries;
+
+			//the focus moved while loading? re-plan from there:
+			std::unique_lock< std::mutex > lock(mutex);
+			if (focus_changed || quit) break;
+		}
+	}
+}
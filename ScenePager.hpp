@@ -0,0 +1,103 @@
+#pragma once
+
+#include "AssetLoader.hpp"
+#include "ChunkFile.hpp"
+#include "SPSCQueue.hpp"
+
+#include <glm/glm.hpp>
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+//"ScenePager" streams a scene blob's entries in and out around a moving focus (e.g., the camera),
+// so only the part of a huge level near the player is ever decoded or instantiated.
+//
+// A paged scene blob has a 'pag0' chunk (written by scene_pages) of PageEntry: the 'scn0' (or
+// quantized 'scq0') entries of each grid cell are contiguous, and each page lists their range and the box around their
+// positions. A blob without pages is treated as one page that is always near.
+//
+// Pages within 'load_distance' of the focus are loaded (decoded on the pager's thread) nearest
+// first; pages beyond 'unload_distance' are unloaded. At most 'max_entries' entries are resident:
+// a nearer page evicts farther ones to fit, and otherwise waits (the nearest page always loads).
+// Loads and unloads are handed to the GL thread -- in order -- through a lock-free queue; call
+// poll() once per frame to apply them. If asked to watch, a rewritten blob unloads every page
+// and pages back in from the new contents.
+//
+// The blob is opened on demand (see ChunkFile::OnDemand): only the directory and the small tables
+// ('pag0', 'str0', 'scm0', 'scs0') stay resident, and each page's range of entries is read from the
+// file when the page loads, so memory follows the pages near the focus rather than the size of the
+// level. The file stays open, so a blob replaced by rename keeps paging from the old file until
+// reopened; a blob rewritten in place is caught by ChunkFile::changed(), and any page read across
+// the rewrite is thrown away rather than mixing old and new entries.
+
+struct ScenePager {
+	//'pag0' entry format:
+	struct PageEntry {
+		glm::vec3 min; //box around the page's entry positions
+		uint32_t entry_start; //range of 'scn0' entries
+		glm::vec3 max;
+		uint32_t entry_count;
+	};
+	static_assert(sizeof(PageEntry) == 32, "PageEntry is packed");
+
+	struct Limits {
+		float load_distance = 100.0f;
+		float unload_distance = 120.0f; //(past load_distance, so pages at the edge don't thrash)
+		uint32_t max_entries = 1000000;
+	};
+
+	//open the blob and start paging (around the origin, until set_focus is called):
+	// note: will throw if the blob fails to open or its pages are malformed.
+	ScenePager(std::string const &filename, Limits const &limits, bool watch = false);
+	//stops paging and joins the thread:
+	~ScenePager();
+	ScenePager(ScenePager const &) = delete;
+	ScenePager &operator=(ScenePager const &) = delete;
+
+	//one change to apply:
+	struct Change {
+		enum Type {
+			Load, //add 'entries' as page 'page'
+			Unload, //remove page 'page'
+			Clear, //remove every page (the blob was rewritten)
+			Error, //a page (or a rewritten blob) failed to load; 'error' says why
+		} type = Load;
+		uint32_t page = 0;
+		std::vector< AssetLoader::SceneEntry > entries;
+		std::string error;
+	};
+
+	//GL thread: page around this point from now on:
+	void set_focus(glm::vec3 const &focus);
+
+	//GL thread: take the next change, if there is one:
+	bool poll(std::unique_ptr< Change > *change) { return changes.try_pop(change); }
+
+	//pages and entries resident (i.e., loaded and not yet unloaded, as of the pager's last decision):
+	std::atomic< uint32_t > resident_pages;
+	std::atomic< uint32_t > resident_entries;
+
+	//internals:
+	void run(bool watch);
+	//open the blob and read its pages (one covering everything, if it has none):
+	// note: will throw if the blob fails to open or its pages are malformed.
+	void open();
+	std::string filename;
+	Limits limits;
+	std::unique_ptr< ChunkFile > file; //(pager thread only, after construction)
+	std::vector< PageEntry > pages;
+
+	std::mutex mutex;
+	std::condition_variable wake; //focus changed, or quitting
+	glm::vec3 focus = glm::vec3(0.0f);
+	bool focus_changed = true;
+
+	SPSCQueue< std::unique_ptr< Change > > changes;
+	std::atomic< bool > quit;
+	std::thread thread;
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <algorithm>
+#include <cstdint>
+
+//"ThreadPool" runs jobs on a fixed set of worker threads.
+// If a job throws, the first exception is rethrown by the next wait().
+
+struct ThreadPool {
+	//start 'threads' workers (by default, one per hardware thread):
+	ThreadPool(uint32_t threads = 0) {
+		if (threads == 0) threads = std::max(1U, std::thread::hardware_concurrency());
+		for (uint32_t i = 0; i < threads; ++i) {
+			workers.emplace_back(&ThreadPool::work, this);
+		}
+	}
+	//finishes queued jobs, then joins the workers:
+	~ThreadPool() {
+		{
+			std::unique_lock< std::mutex > lock(mutex);
+			quit = true;
+		}
+		job_ready.notify_all();
+		for (auto &worker : workers) {
+			worker.join();
+		}
+	}
+	ThreadPool(ThreadPool const &) = delete;
+	ThreadPool &operator=(ThreadPool const &) = delete;
+
+	//queue a job:
+	void run(std::function< void() > const &job) {
+		{
+			std::unique_lock< std::mutex > lock(mutex);
+			jobs.emplace_back(job);
+			++unfinished;
+		}
+		job_ready.notify_one();
+	}
+
+	//wait for every queued job to finish:
+	// note: will rethrow the first exception thrown by a job since the last wait.
+	void wait() {
+		std::unique_lock< std::mutex > lock(mutex);
+		all_done.wait(lock, [this](){ return unfinished == 0; });
+		if (error) {
+			std::exception_ptr e = error;
+			error = nullptr;
+			std::rethrow_exception(e);
+		}
+	}
+
+	//call fn(i) for every i in [0, count), spread over the workers, and wait for them all:
+	void parallel_for(uint32_t count, std::function< void(uint32_t) > const &fn) {
+		for (uint32_t i = 0; i < count; ++i) {
+			run([&fn, i](){ fn(i); });
+		}
+		wait();
+	}
+
+	uint32_t size() const { return uint32_t(workers.size()); }
+
+	//internals:
+	void work() {
+		std::unique_lock< std::mutex > lock(mutex);
+		while (true) {
+			job_ready.wait(lock, [this](){ return quit || !jobs.empty(); });
+			if (jobs.empty()) return; //(quit, and nothing left to do)
+			std::function< void() > job = std::move(jobs.front());
+			jobs.pop_front();
+			lock.unlock();
+			std::exception_ptr thrown;
+			try {
+				job();
+			} catch (...) {
+				thrown = std::current_exception();
+			}
+			lock.lock();
+			if (thrown && !error) error = thrown;
+			if (--unfinished == 0) all_done.notify_all();
+		}
+	}
+
+	std::vector< std::thread > workers;
+	std::mutex mutex;
+	std::condition_variable job_ready;
+	std::condition_variable all_done;
+	std::deque< std::function< void() > > jobs;
+	uint32_t unfinished = 0; //jobs queued or running
+	std::exception_ptr error;
+	bool quit = false;
+};
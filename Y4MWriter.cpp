@@ -0,0 +1,148 @@
+#include "Y4MWriter.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define Y4MWRITER_SSE2
+#include <emmintrin.h>
+#endif
+
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <cassert>
+
+Y4MWriter::Y4MWriter(std::string const &filename_, glm::uvec2 const &size_, uint32_t fps, FrameRecorder::Policy policy, uint32_t capacity, uint32_t threads) : filename(filename_), size(size_), written(0), busy_ns(0),
+	recorder([this](std::string const &, FrameCapture::Frame const &frame) { encode(frame); }, policy, capacity, threads) {
+	out.open(filename, std::ios::binary);
+	out << "YUV4MPEG2 W" << size.x << " H" << size.y << " F" << fps << ":1 Ip A1:1 C420jpeg\n";
+	if (!out) {
+		throw std::runtime_error("Failed to open '" + filename + "' for writing");
+	}
+}
+
+Y4MWriter::~Y4MWriter() {
+}
+
+bool Y4MWriter::push(FrameCapture::Frame &&frame) {
+	assert(frame.size == size);
+	uint32_t tag = frame.tag;
+	if (recorder.push("", std::move(frame))) return true;
+	finish(tag, std::vector< uint8_t >());
+	return false;
+}
+
+void Y4MWriter::encode(FrameCapture::Frame const &frame) {
+	auto before = std::chrono::steady_clock::now();
+	size_t luma = size_t(size.x) * size.y;
+	size_t chroma = size_t((size.x + 1) / 2) * ((size.y + 1) / 2);
+	std::vector< uint8_t > planes(luma + 2 * chroma);
+	convert(frame.pixels.data(), size, &planes[0], &planes[luma], &planes[luma + chroma]);
+	finish(frame.tag, std::move(planes));
+	busy_ns += uint64_t(std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now() - before).count());
+}
+
+void Y4MWriter::finish(uint32_t tag, std::vector< uint8_t > &&planes) {
+	std::unique_lock< std::mutex > lock(order_mutex);
+	ready.emplace(tag, std::move(planes));
+	//(writing under the lock keeps frames in order; other threads keep converting meanwhile)
+	while (!ready.empty() && ready.begin()->first == next_write) {
+		std::vector< uint8_t > const &next = ready.begin()->second;
+		if (!next.empty()) {
+			out << "FRAME\n";
+			out.write(reinterpret_cast< char const * >(next.data()), next.size());
+			written += 1;
+		}
+		ready.erase(ready.begin());
+		next_write += 1;
+	}
+}
+
+//BT.601 video range, in 8.8 fixed point (+0.5 to round; chroma is offset by +128 first, so nothing goes negative):
+static inline uint8_t luma(uint32_t r, uint32_t g, uint32_t b) {
+	return uint8_t(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+static inline uint8_t chroma_u(uint32_t r, uint32_t g, uint32_t b) {
+	return uint8_t((112 * b + 32896 - 38 * r - 74 * g) >> 8);
+}
+static inline uint8_t chroma_v(uint32_t r, uint32_t g, uint32_t b) {
+	return uint8_t((112 * r + 32896 - 94 * g - 18 * b) >> 8);
+}
+
+void Y4MWriter::convert(uint32_t const *rgba, glm::uvec2 const &size, uint8_t *y, uint8_t *u, uint8_t *v) {
+	uint32_t const w = size.x, h = size.y;
+	uint32_t const cw = (w + 1) / 2;
+	for (uint32_t cy = 0; cy < (h + 1) / 2; ++cy) {
+		//the two (top-to-bottom) rows of this chroma row, flipped (the last repeats the first if the height is odd):
+		uint32_t row0 = 2 * cy, row1 = std::min(2 * cy + 1, h - 1);
+		uint32_t const *src0 = rgba + size_t(h - 1 - row0) * w;
+		uint32_t const *src1 = rgba + size_t(h - 1 - row1) * w;
+		uint8_t *y0 = y + size_t(row0) * w;
+		uint8_t *y1 = y + size_t(row1) * w;
+		uint8_t *u_row = u + size_t(cy) * cw;
+		uint8_t *v_row = v + size_t(cy) * cw;
+
+		uint32_t x = 0;
+		#ifdef Y4MWRITER_SSE2
+		//eight pixels from each row at a time:
+		__m128i const Mask = _mm_set1_epi32(0xff);
+		auto channels = [&Mask](uint32_t const *src, __m128i *r, __m128i *g, __m128i *b) {
+			__m128i p0 = _mm_loadu_si128(reinterpret_cast< __m128i const * >(src));
+			__m128i p1 = _mm_loadu_si128(reinterpret_cast< __m128i const * >(src + 4));
+			*r = _mm_packs_epi32(_mm_and_si128(p0, Mask), _mm_and_si128(p1, Mask));
+			*g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 8), Mask), _mm_and_si128(_mm_srli_epi32(p1, 8), Mask));
+			*b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), Mask), _mm_and_si128(_mm_srli_epi32(p1, 16), Mask));
+		};
+		//(sums stay below 65536, so wrapping 16-bit products and a logical shift give exact results)
+		auto weigh = [](__m128i r, __m128i g, __m128i b, int16_t wr, int16_t wg, int16_t wb, int16_t bias) {
+			__m128i sum = _mm_add_epi16(
+				_mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(wr)), _mm_mullo_epi16(g, _mm_set1_epi16(wg))),
+				_mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(wb)), _mm_set1_epi16(bias)));
+			return _mm_srli_epi16(sum, 8);
+		};
+		for (; x + 8 <= w; x += 8) {
+			__m128i r0, g0, b0, r1, g1, b1;
+			channels(src0 + x, &r0, &g0, &b0);
+			channels(src1 + x, &r1, &g1, &b1);
+			__m128i l0 = _mm_add_epi16(weigh(r0, g0, b0, 66, 129, 25, 128), _mm_set1_epi16(16));
+			__m128i l1 = _mm_add_epi16(weigh(r1, g1, b1, 66, 129, 25, 128), _mm_set1_epi16(16));
+			_mm_storel_epi64(reinterpret_cast< __m128i * >(y0 + x), _mm_packus_epi16(l0, l0));
+			_mm_storel_epi64(reinterpret_cast< __m128i * >(y1 + x), _mm_packus_epi16(l1, l1));
+
+			//average each 2x2 block (rounding), then weigh:
+			auto average = [](__m128i a, __m128i b) {
+				__m128i sum = _mm_madd_epi16(_mm_add_epi16(a, b), _mm_set1_epi16(1));
+				sum = _mm_srli_epi32(_mm_add_epi32(sum, _mm_set1_epi32(2)), 2);
+				return _mm_packs_epi32(sum, sum);
+			};
+			__m128i r = average(r0, r1), g = average(g0, g1), b = average(b0, b1);
+			__m128i cu = weigh(r, g, b, -38, -74, 112, int16_t(32896));
+			__m128i cv = weigh(r, g, b, 112, -94, -18, int16_t(32896));
+			int32_t u4 = _mm_cvtsi128_si32(_mm_packus_epi16(cu, cu));
+			int32_t v4 = _mm_cvtsi128_si32(_mm_packus_epi16(cv, cv));
+			std::copy(reinterpret_cast< uint8_t const * >(&u4), reinterpret_cast< uint8_t const * >(&u4) + 4, u_row + x / 2);
+			std::copy(reinterpret_cast< uint8_t const * >(&v4), reinterpret_cast< uint8_t const * >(&v4) + 4, v_row + x / 2);
+		}
+		#endif
+
+		//remaining pixels (all of them, without SSE2):
+		for (; x < w; x += 2) {
+			uint32_t x1 = std::min(x + 1, w - 1);
+			uint32_t const block[4] = {src0[x], src0[x1], src1[x], src1[x1]};
+			uint32_t r = 0, g = 0, b = 0;
+			for (uint32_t i = 0; i < 4; ++i) {
+				r += block[i] & 0xff;
+				g += (block[i] >> 8) & 0xff;
+				b += (block[i] >> 16) & 0xff;
+			}
+			r = (r + 2) >> 2;
+			g = (g + 2) >> 2;
+			b = (b + 2) >> 2;
+			u_row[x / 2] = chroma_u(r, g, b);
+			v_row[x / 2] = chroma_v(r, g, b);
+			for (uint32_t i = 0; i < 2 && x + i < w; ++i) {
+				uint32_t p0 = src0[x + i], p1 = src1[x + i];
+				y0[x + i] = luma(p0 & 0xff, (p0 >> 8) & 0xff, (p0 >> 16) & 0xff);
+				y1[x + i] = luma(p1 & 0xff, (p1 >> 8) & 0xff, (p1 >> 16) & 0xff);
+			}
+		}
+	}
+}
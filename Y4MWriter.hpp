@@ -0,0 +1,53 @@
+#pragma once
+
+#include "FrameCapture.hpp"
+#include "FrameRecorder.hpp"
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <fstream>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+//"Y4MWriter" streams captured frames into a raw YUV4MPEG2 (.y4m) video, which any encoder
+// (e.g., ffmpeg or x264) can compress offline. Frames are converted from RGBA to YUV 4:2:0
+// (BT.601, video range) on a FrameRecorder's encoder threads -- with SSE2 where available --
+// and appended in order by whichever thread finishes the next one.
+//
+// Frames must be pushed with tags 0, 1, 2, ... (frames the recorder drops are left out).
+
+struct Y4MWriter {
+	//start a video of 'size' frames at 'fps' frames per second:
+	// note: will throw if the file can't be opened.
+	Y4MWriter(std::string const &filename, glm::uvec2 const &size, uint32_t fps, FrameRecorder::Policy policy, uint32_t capacity = 16, uint32_t threads = 0);
+	//converts and writes every queued frame, then closes the file:
+	~Y4MWriter();
+	Y4MWriter(Y4MWriter const &) = delete;
+	Y4MWriter &operator=(Y4MWriter const &) = delete;
+
+	//queue a frame (of the video's size):
+	// returns false if the frame was dropped.
+	bool push(FrameCapture::Frame &&frame);
+
+	//convert a frame to 4:2:0 planes: 'y' is width x height; 'u' and 'v' are half that (rounded up) on each side:
+	// (rows of 'rgba' are bottom-to-top, as FrameCapture reads them; planes are top-to-bottom)
+	static void convert(uint32_t const *rgba, glm::uvec2 const &size, uint8_t *y, uint8_t *u, uint8_t *v);
+
+	std::string filename;
+	glm::uvec2 size;
+	std::atomic< uint32_t > written; //frames appended to the file
+	std::atomic< uint64_t > busy_ns; //time encoder threads spent converting and writing (for frames/sec per core)
+
+	//internals:
+	void encode(FrameCapture::Frame const &frame);
+	void finish(uint32_t tag, std::vector< uint8_t > &&planes); //hand over a frame's planes (empty if dropped); writes any now in order
+	std::ofstream out;
+	std::mutex order_mutex;
+	std::map< uint32_t, std::vector< uint8_t > > ready; //converted (or dropped) frames waiting for earlier ones
+	uint32_t next_write = 0;
+	FrameRecorder recorder; //(last, so its threads stop before the rest is torn down)
+};
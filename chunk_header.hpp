@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+#include <stdexcept>
+#include <cstdint>
+
+//Chunk headers:
+// Every chunk starts with a ChunkHeader. Its 'size' is the (padded) size of the payload that
+// follows, with ChunkSizeCompressed set if the payload is a compressed chunk body (see chunk_zlib.hpp).
+// Chunks too big for that (2GB and up) set 'size' to ChunkSizeExtended instead, and a
+// ChunkHeaderExtension with a 64-bit size follows the header.
+// (ChunkSizeExtended can't be a legacy size, since legacy sizes are padded to a multiple of four)
+
+struct ChunkHeader {
+	char magic[4] = {'\0', '\0', '\0', '\0'};
+	uint32_t size = 0;
+};
+static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+
+struct ChunkHeaderExtension {
+	uint32_t version = 1;
+	uint32_t flags = 0; //ChunkFlagCompressed, or zero
+	uint64_t size = 0; //size of the (padded) payload
+};
+static_assert(sizeof(ChunkHeaderExtension) == 16, "header extension is packed");
+
+constexpr uint32_t ChunkSizeCompressed = 0x80000000;
+constexpr uint32_t ChunkSizeExtended = 0xffffffff;
+constexpr uint32_t ChunkHeaderVersion = 1; //newest ChunkHeaderExtension version understood
+
+//flags shared by header extensions and table-of-contents entries:
+constexpr uint32_t ChunkFlagCompressed = 1;
+
+//what a chunk header says about the chunk:
+struct ChunkInfo {
+	uint64_t size = 0; //of the payload (as stored)
+	uint32_t flags = 0;
+	uint32_t header_size = sizeof(ChunkHeader); //bytes from start of header to start of payload
+};
+
+//decode a header; 'extension' is read only if header.size is ChunkSizeExtended:
+// note: will throw if the extension's version is too new.
+inline ChunkInfo chunk_info(ChunkHeader const &header, ChunkHeaderExtension const &extension) {
+	ChunkInfo info;
+	if (header.size == ChunkSizeExtended) {
+		if (extension.version == 0 || extension.version > ChunkHeaderVersion) {
+			throw std::runtime_error("Chunk header version " + std::to_string(extension.version) + " isn't supported.");
+		}
+		info.size = extension.size;
+		info.flags = extension.flags;
+		info.header_size = sizeof(ChunkHeader) + sizeof(ChunkHeaderExtension);
+	} else {
+		info.size = header.size & ~ChunkSizeCompressed;
+		info.flags = ((header.size & ChunkSizeCompressed) ? ChunkFlagCompressed : 0);
+	}
+	return info;
+}
@@ -0,0 +1,137 @@
+#include "chunk_zlib.hpp"
+#include "ThreadPool.hpp"
+
+#include <zlib.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <cstring>
+#include <cassert>
+
+//one pool for every chunk's blocks (rather than threads started per chunk):
+static ThreadPool &block_pool() {
+	static ThreadPool pool;
+	return pool;
+}
+
+//run fn(b) for every block, on several threads if there is more than one:
+// (the calling thread takes blocks too, and waits only for its own helpers -- not the pool --
+//  so chunks inflated at once, e.g. on different loader tasks, don't wait on each other)
+static void for_each_block(uint32_t count, std::function< void(uint32_t) > const &fn) {
+	if (count <= 1) {
+		for (uint32_t b = 0; b < count; ++b) fn(b);
+		return;
+	}
+	ThreadPool &pool = block_pool();
+
+	std::atomic< uint32_t > next(0);
+	std::mutex mutex;
+	std::condition_variable helped;
+	uint32_t helpers = std::min(count - 1, pool.size());
+	std::exception_ptr error;
+	auto work = [&]() {
+		for (uint32_t b = next++; b < count; b = next++) {
+			try {
+				fn(b);
+			} catch (...) {
+				std::unique_lock< std::mutex > lock(mutex);
+				if (!error) error = std::current_exception();
+				next = count; //(stop handing out blocks)
+			}
+		}
+	};
+	for (uint32_t h = 0, start = helpers; h < start; ++h) {
+		pool.run([&]() {
+			work();
+			std::unique_lock< std::mutex > lock(mutex);
+			if (--helpers == 0) helped.notify_all();
+		});
+	}
+	work();
+	std::unique_lock< std::mutex > lock(mutex);
+	helped.wait(lock, [&helpers](){ return helpers == 0; });
+	if (error) std::rethrow_exception(error);
+}
+
+void deflate_chunk(void const *data_, size_t size, std::vector< char > *body_, uint32_t block_size) {
+	assert(body_);
+	auto &body = *body_;
+	assert(block_size > 0);
+	char const *data = static_cast< char const * >(data_);
+
+	CompressedChunkHeader header;
+	header.size = size;
+	header.block_size = block_size;
+	if ((size + block_size - 1) / block_size > 0xffffffffULL) {
+		throw std::runtime_error("Chunk has too many blocks to compress.");
+	}
+	header.block_count = uint32_t((size + block_size - 1) / block_size);
+
+	std::vector< std::vector< Bytef > > blocks(header.block_count);
+	for_each_block(header.block_count, [&](uint32_t b) {
+		size_t begin = size_t(b) * block_size;
+		uLong bytes = uLong(std::min< size_t >(block_size, size - begin));
+		uLongf compressed = compressBound(bytes);
+		blocks[b].resize(compressed);
+		if (compress2(blocks[b].data(), &compressed, reinterpret_cast< Bytef const * >(data + begin), bytes, Z_DEFAULT_COMPRESSION) != Z_OK) {
+			throw std::runtime_error("Failed to compress chunk.");
+		}
+		blocks[b].resize(compressed);
+	});
+
+	body.assign(reinterpret_cast< char const * >(&header), reinterpret_cast< char const * >(&header) + sizeof(header));
+	for (auto const &block : blocks) {
+		uint32_t compressed = uint32_t(block.size());
+		body.insert(body.end(), reinterpret_cast< char const * >(&compressed), reinterpret_cast< char const * >(&compressed) + sizeof(compressed));
+	}
+	for (auto const &block : blocks) {
+		body.insert(body.end(), block.begin(), block.end());
+	}
+}
+
+uint64_t inflated_size(char const *body, size_t body_size) {
+	CompressedChunkHeader header;
+	if (body_size < sizeof(header)) {
+		throw std::runtime_error("Compressed chunk is too small for its header.");
+	}
+	std::memcpy(&header, body, sizeof(header));
+	if (header.block_size == 0 || (header.size + header.block_size - 1) / header.block_size != header.block_count) {
+		throw std::runtime_error("Compressed chunk has inconsistent block count.");
+	}
+	if ((body_size - sizeof(header)) / sizeof(uint32_t) < header.block_count) {
+		throw std::runtime_error("Compressed chunk is too small for its block sizes.");
+	}
+	return header.size;
+}
+
+void inflate_chunk(char const *body, size_t body_size, char *out) {
+	uint64_t size = inflated_size(body, body_size);
+	CompressedChunkHeader header;
+	std::memcpy(&header, body, sizeof(header));
+
+	//find each block (and check they fit in the body):
+	std::vector< size_t > offsets(header.block_count + 1);
+	offsets[0] = sizeof(header) + sizeof(uint32_t) * size_t(header.block_count);
+	for (uint32_t b = 0; b < header.block_count; ++b) {
+		uint32_t compressed;
+		std::memcpy(&compressed, body + sizeof(header) + sizeof(uint32_t) * b, sizeof(compressed));
+		offsets[b + 1] = offsets[b] + compressed;
+		if (offsets[b + 1] > body_size) {
+			throw std::runtime_error("Compressed chunk block runs past end of chunk.");
+		}
+	}
+
+	for_each_block(header.block_count, [&](uint32_t b) {
+		uint64_t begin = uint64_t(b) * header.block_size;
+		size_t bytes = size_t(std::min< uint64_t >(header.block_size, size - begin));
+		inflate_block(body + offsets[b], offsets[b + 1] - offsets[b], out + begin, bytes);
+	});
+}
+
+void inflate_block(char const *block, size_t block_size, char *out, size_t out_size) {
+	uLongf bytes = uLongf(out_size);
+	int result = uncompress(reinterpret_cast< Bytef * >(out), &bytes, reinterpret_cast< Bytef const * >(block), uLong(block_size));
+	if (result != Z_OK || bytes != out_size) {
+		throw std::runtime_error("Failed to inflate compressed chunk block.");
+	}
+}
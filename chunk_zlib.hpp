@@ -0,0 +1,42 @@
+#pragma once
+
+#include "chunk_header.hpp"
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+//Compressed chunks:
+// A chunk flagged compressed in its header (see chunk_header.hpp) holds a compressed body
+// instead of its payload (and its table-of-contents entry, if any, has ChunkFlagCompressed
+// set and the body's size). The body is:
+//   CompressedChunkHeader
+//   uint32_t compressed_size[block_count]
+//   block_count zlib streams, back to back
+// Every block but the last inflates to block_size bytes; blocks are independent,
+// so they can be inflated in parallel (or one at a time, as a stream).
+
+struct CompressedChunkHeader {
+	uint64_t size; //of the inflated payload
+	uint32_t block_size;
+	uint32_t block_count;
+};
+static_assert(sizeof(CompressedChunkHeader) == 16, "CompressedChunkHeader is packed");
+
+//default block size: big enough to compress well, small enough to spread over threads:
+constexpr uint32_t ChunkBlockSize = 1 << 20;
+
+//compress a payload into a compressed chunk body (blocks compressed in parallel):
+void deflate_chunk(void const *data, size_t size, std::vector< char > *body, uint32_t block_size = ChunkBlockSize);
+
+//size of the payload a compressed chunk body inflates to:
+// note: will throw if the body's headers are malformed.
+uint64_t inflated_size(char const *body, size_t body_size);
+
+//inflate a compressed chunk body into 'out' (which has room for inflated_size() bytes), blocks in parallel:
+// note: will throw if the body is malformed.
+void inflate_chunk(char const *body, size_t body_size, char *out);
+
+//inflate one block (a single zlib stream) into exactly 'out_size' bytes at 'out':
+// note: will throw if the block is malformed or inflates to a different size.
+void inflate_block(char const *block, size_t block_size, char *out, size_t out_size);
@@ -1,10 +1,13 @@
 #include "load_save_png.hpp"
+#include "ThreadPool.hpp"
 
 #include <png.h>
+#include <zlib.h>
 
 #include <iostream>
 #include <fstream>
 #include <cassert>
+#include <cstdlib>
 #include <vector>
 
 #define LOG_ERROR( X ) std::cerr << X << std::endl
@@ -20,9 +23,46 @@ bool load_png(std::string filename, unsigned int *width, unsigned int *height, s
 	return load_png(file, width, height, data, origin);
 }
 
-void save_png(std::string filename, unsigned int width, unsigned int height, uint32_t const *data, OriginLocation origin) {
+void save_png(std::string filename, unsigned int width, unsigned int height, uint32_t const *data, OriginLocation origin, PngOptions const &options) {
 	std::ofstream file(filename.c_str(), std::ios::binary);
-	save_png(file, width, height, data, origin);
+	save_png(file, width, height, data, origin, options);
+}
+
+PngOptions PngOptions::fastest() {
+	PngOptions options;
+	options.level = 1;
+	options.filters = FilterSub; //(a single cheap filter; RLE strategy is no faster here, and much bigger)
+	options.strategy = FilteredStrategy;
+	options.memory_level = 9;
+	return options;
+}
+
+PngOptions PngOptions::balanced() {
+	PngOptions options;
+	options.level = 4;
+	options.filters = FilterSub | FilterUp;
+	options.strategy = FilteredStrategy;
+	options.memory_level = 9;
+	return options;
+}
+
+PngOptions PngOptions::smallest() {
+	PngOptions options;
+	options.level = 9;
+	options.filters = AllFilters;
+	options.strategy = FilteredStrategy;
+	options.memory_level = 9;
+	return options;
+}
+
+bool PngOptions::preset(std::string const &name, PngOptions *options) {
+	assert(options);
+	if (name == "default") *options = PngOptions();
+	else if (name == "fastest") *options = fastest();
+	else if (name == "balanced") *options = balanced();
+	else if (name == "smallest") *options = smallest();
+	else return false;
+	return true;
 }
 
 
@@ -122,7 +162,7 @@ bool load_png(std::istream &from, unsigned int *width, unsigned int *height, vec
 }
 
 
-void save_png(std::ostream &to, unsigned int width, unsigned int height, uint32_t const *data, OriginLocation origin) {
+void save_png(std::ostream &to, unsigned int width, unsigned int height, uint32_t const *data, OriginLocation origin, PngOptions const &options) {
 //After the libpng example.c
 	png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
 
@@ -149,6 +189,18 @@ void save_png(std::ostream &to, unsigned int width, unsigned int height, uint32_
 	//Not needed with custom read/write functions: png_init_io(png_ptr, fp);
 	png_set_IHDR(png_ptr, info_ptr, width, height, 8, PNG_COLOR_TYPE_RGB_ALPHA, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
 
+	png_set_compression_level(png_ptr, options.level);
+	int filters = 0;
+	if (options.filters & PngOptions::FilterNone) filters |= PNG_FILTER_NONE;
+	if (options.filters & PngOptions::FilterSub) filters |= PNG_FILTER_SUB;
+	if (options.filters & PngOptions::FilterUp) filters |= PNG_FILTER_UP;
+	if (options.filters & PngOptions::FilterAverage) filters |= PNG_FILTER_AVG;
+	if (options.filters & PngOptions::FilterPaeth) filters |= PNG_FILTER_PAETH;
+	png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, (filters ? filters : PNG_FILTER_NONE));
+	static int const Strategies[] = {Z_DEFAULT_STRATEGY, Z_FILTERED, Z_HUFFMAN_ONLY, Z_RLE, Z_FIXED};
+	png_set_compression_strategy(png_ptr, Strategies[options.strategy]);
+	png_set_compression_mem_level(png_ptr, options.memory_level);
+
 	png_write_info(png_ptr, info_ptr);
 	//png_set_swap_alpha(png_ptr) // might need?
 	vector< png_bytep > row_pointers(height);
@@ -167,3 +219,193 @@ void save_png(std::ostream &to, unsigned int width, unsigned int height, uint32_
 
 	return;
 }
+
+
+void save_png_parallel(std::string filename, unsigned int width, unsigned int height, uint32_t const *data, ThreadPool &pool, OriginLocation origin, PngOptions const &options) {
+	std::ofstream file(filename.c_str(), std::ios::binary);
+	save_png_parallel(file, width, height, data, pool, origin, options);
+}
+
+//filter one row of RGBA pixels ('above' is the unfiltered row before it, or zeros), picking the
+// allowed filter with the smallest sum of absolute (signed) bytes, as libpng does:
+static void filter_row(uint8_t const *row, uint8_t const *above, size_t bytes, unsigned int allowed, uint8_t *out, vector< uint8_t > *scratch) {
+	if (allowed == 0) allowed = PngOptions::FilterNone;
+	vector< uint8_t > &trial = *scratch;
+	trial.resize(bytes + 1);
+	size_t best_sum = size_t(-1);
+	for (uint8_t type = 0; type < 5; ++type) {
+		if (!(allowed & (1U << type))) continue;
+		trial[0] = type;
+		uint8_t *f = &trial[1];
+		//(the first pixel has no left neighbours, so a and c are zero there)
+		if (type == 0) {
+			std::copy(row, row + bytes, f);
+		} else if (type == 1) {
+			for (size_t i = 0; i < bytes; ++i) f[i] = uint8_t(row[i] - (i >= 4 ? row[i - 4] : 0));
+		} else if (type == 2) {
+			for (size_t i = 0; i < bytes; ++i) f[i] = uint8_t(row[i] - above[i]);
+		} else if (type == 3) {
+			for (size_t i = 0; i < 4 && i < bytes; ++i) f[i] = uint8_t(row[i] - above[i] / 2);
+			for (size_t i = 4; i < bytes; ++i) f[i] = uint8_t(row[i] - (row[i - 4] + above[i]) / 2);
+		} else {
+			for (size_t i = 0; i < 4 && i < bytes; ++i) f[i] = uint8_t(row[i] - above[i]);
+			for (size_t i = 4; i < bytes; ++i) {
+				int a = row[i - 4], b = above[i], c = above[i - 4];
+				int pa = std::abs(b - c), pb = std::abs(a - c), pc = std::abs(a + b - 2 * c);
+				f[i] = uint8_t(row[i] - (pa <= pb && pa <= pc ? a : pb <= pc ? b : c));
+			}
+		}
+		if (allowed == (1U << type)) {
+			std::copy(trial.begin(), trial.end(), out);
+			return;
+		}
+		size_t sum = 0;
+		for (size_t i = 1; i <= bytes; ++i) {
+			sum += (trial[i] < 128 ? trial[i] : 256 - trial[i]);
+		}
+		if (sum < best_sum) {
+			best_sum = sum;
+			std::copy(trial.begin(), trial.end(), out);
+		}
+	}
+}
+
+void save_png_parallel(std::ostream &to, unsigned int width, unsigned int height, uint32_t const *data, ThreadPool &pool, OriginLocation origin, PngOptions const &options) {
+	size_t row_bytes = 4 * size_t(width);
+	auto image_row = [&](unsigned int r) -> uint8_t const * {
+		return reinterpret_cast< uint8_t const * >(&data[size_t(origin == UpperLeftOrigin ? r : height - 1 - r) * width]);
+	};
+
+	//strips: a few per thread (so uneven strips balance out), but not so thin that compression suffers:
+	unsigned int strip_rows = std::max(16U, (height + 4 * pool.size() - 1) / (4 * pool.size()));
+	unsigned int strip_count = std::max(1U, (height + strip_rows - 1) / strip_rows);
+
+	struct Strip {
+		vector< uint8_t > deflated;
+		uLong adler = 0; //of the filtered rows
+		size_t raw_bytes = 0;
+		uLong crc = 0; //of 'deflated'
+		bool ok = false;
+	};
+	vector< Strip > strips(strip_count);
+	static int const Strategies[] = {Z_DEFAULT_STRATEGY, Z_FILTERED, Z_HUFFMAN_ONLY, Z_RLE, Z_FIXED};
+	pool.parallel_for(strip_count, [&](uint32_t s) {
+		Strip &strip = strips[s];
+		unsigned int begin = s * strip_rows, end = std::min(height, begin + strip_rows);
+
+		//filter:
+		vector< uint8_t > filtered((row_bytes + 1) * (end - begin));
+		vector< uint8_t > zeros(row_bytes, 0), scratch;
+		for (unsigned int r = begin; r < end; ++r) {
+			filter_row(image_row(r), (r == 0 ? zeros.data() : image_row(r - 1)), row_bytes, options.filters, &filtered[(row_bytes + 1) * (r - begin)], &scratch);
+		}
+		strip.raw_bytes = filtered.size();
+		strip.adler = adler32(adler32(0L, Z_NULL, 0), filtered.data(), uInt(filtered.size()));
+
+		//deflate (raw -- the zlib header and checksum are written around all the strips), ending
+		// on a byte boundary with a full flush, or with the final block for the last strip:
+		z_stream z;
+		z.zalloc = Z_NULL;
+		z.zfree = Z_NULL;
+		z.opaque = Z_NULL;
+		if (deflateInit2(&z, options.level, Z_DEFLATED, -15, options.memory_level, Strategies[options.strategy]) != Z_OK) return;
+		strip.deflated.resize(deflateBound(&z, uLong(filtered.size())) + 16);
+		z.next_in = filtered.data();
+		z.avail_in = uInt(filtered.size());
+		z.next_out = strip.deflated.data();
+		z.avail_out = uInt(strip.deflated.size());
+		bool last = (s + 1 == strip_count);
+		//(deflate must be called again -- with more room -- for as long as it fills the output)
+		while (true) {
+			if (z.avail_out == 0) {
+				size_t used = size_t(z.total_out);
+				strip.deflated.resize(2 * strip.deflated.size());
+				z.next_out = strip.deflated.data() + used;
+				z.avail_out = uInt(strip.deflated.size() - used);
+			}
+			int result = deflate(&z, (last ? Z_FINISH : Z_FULL_FLUSH));
+			if (last ? result == Z_STREAM_END : result == Z_OK && z.avail_in == 0 && z.avail_out != 0) {
+				strip.ok = true;
+				break;
+			}
+			if (result != Z_OK && result != Z_BUF_ERROR) break;
+			if (result == Z_BUF_ERROR && z.avail_out != 0) break; //(no progress possible)
+		}
+		strip.deflated.resize(z.total_out);
+		deflateEnd(&z);
+		strip.crc = crc32(crc32(0L, Z_NULL, 0), strip.deflated.data(), uInt(strip.deflated.size()));
+	});
+
+	//the zlib stream: header, strips, then the Adler-32 of all the filtered rows (combined from the strips'):
+	int level = (options.level < 0 ? Z_DEFAULT_COMPRESSION : options.level);
+	uint8_t flevel = (level == Z_DEFAULT_COMPRESSION || level == 6 ? 2 : level <= 1 ? 0 : level <= 5 ? 1 : 3);
+	uint8_t header[2] = {0x78, uint8_t(flevel << 6)};
+	header[1] |= uint8_t(31 - (header[0] * 256 + header[1]) % 31);
+	uLong adler = adler32(0L, Z_NULL, 0);
+	uint64_t idat_bytes = sizeof(header) + 4;
+	for (Strip const &strip : strips) {
+		if (!strip.ok) {
+			LOG_ERROR("Error compressing png.");
+			return;
+		}
+		adler = adler32_combine(adler, strip.adler, z_off_t(strip.raw_bytes));
+		idat_bytes += strip.deflated.size();
+	}
+	if (idat_bytes > 0x7fffffff) {
+		LOG_ERROR("Png too large to write in one IDAT chunk.");
+		return;
+	}
+	uint8_t trailer[4] = {uint8_t(adler >> 24), uint8_t(adler >> 16), uint8_t(adler >> 8), uint8_t(adler)};
+
+	//write chunks (lengths and CRCs are big-endian; each CRC covers the chunk's type and data):
+	auto be32 = [](uint32_t v, uint8_t *out) {
+		out[0] = uint8_t(v >> 24); out[1] = uint8_t(v >> 16); out[2] = uint8_t(v >> 8); out[3] = uint8_t(v);
+	};
+	auto write_chunk = [&](char const *type, uint8_t const *bytes, uint32_t size) {
+		uint8_t word[4];
+		be32(size, word);
+		to.write(reinterpret_cast< char const * >(word), 4);
+		to.write(type, 4);
+		if (size) to.write(reinterpret_cast< char const * >(bytes), size);
+		uLong crc = crc32(crc32(0L, Z_NULL, 0), reinterpret_cast< Bytef const * >(type), 4);
+		if (size) crc = crc32(crc, bytes, size);
+		be32(uint32_t(crc), word);
+		to.write(reinterpret_cast< char const * >(word), 4);
+	};
+
+	static uint8_t const Signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+	to.write(reinterpret_cast< char const * >(Signature), 8);
+
+	uint8_t ihdr[13];
+	be32(width, ihdr);
+	be32(height, ihdr + 4);
+	ihdr[8] = 8; //bit depth
+	ihdr[9] = 6; //RGBA
+	ihdr[10] = 0; //deflate
+	ihdr[11] = 0; //adaptive filtering
+	ihdr[12] = 0; //not interlaced
+	write_chunk("IHDR", ihdr, sizeof(ihdr));
+
+	{ //IDAT, streamed strip by strip (its CRC combined from the strips'):
+		uint8_t word[4];
+		be32(uint32_t(idat_bytes), word);
+		to.write(reinterpret_cast< char const * >(word), 4);
+		to.write("IDAT", 4);
+		uLong crc = crc32(crc32(0L, Z_NULL, 0), reinterpret_cast< Bytef const * >("IDAT"), 4);
+		to.write(reinterpret_cast< char const * >(header), sizeof(header));
+		crc = crc32(crc, header, sizeof(header));
+		for (Strip const &strip : strips) {
+			to.write(reinterpret_cast< char const * >(strip.deflated.data()), strip.deflated.size());
+			crc = crc32_combine(crc, strip.crc, z_off_t(strip.deflated.size()));
+		}
+		to.write(reinterpret_cast< char const * >(trailer), sizeof(trailer));
+		crc = crc32(crc, trailer, sizeof(trailer));
+		be32(uint32_t(crc), word);
+		to.write(reinterpret_cast< char const * >(word), 4);
+	}
+
+	write_chunk("IEND", nullptr, 0);
+	if (!to) {
+		LOG_ERROR("Error writing png.");
+	}
+}
@@ -13,8 +13,49 @@ enum OriginLocation {
 	UpperLeftOrigin,
 };
 
+/*
+ * Encoder settings for save_png; the defaults are libpng's own.
+ * Presets trade speed for size (see png_bench for numbers on real frames).
+ */
+struct PngOptions {
+	int level = -1; //zlib compression level, 0 (store) to 9 (smallest); -1 is zlib's default (6)
+	enum Filter {
+		FilterNone = 1,
+		FilterSub = 2,
+		FilterUp = 4,
+		FilterAverage = 8,
+		FilterPaeth = 16,
+		AllFilters = 31,
+	};
+	unsigned int filters = AllFilters; //row filters libpng may choose among (per row); fewer is faster
+	enum Strategy {
+		DefaultStrategy,
+		FilteredStrategy,
+		HuffmanOnlyStrategy,
+		RLEStrategy,
+		FixedStrategy,
+	};
+	Strategy strategy = FilteredStrategy; //zlib strategy
+	int memory_level = 8; //zlib memory level, 1 to 9; more is a little faster and smaller
+
+	static PngOptions fastest();
+	static PngOptions balanced();
+	static PngOptions smallest();
+	//look up "default", "fastest", "balanced", or "smallest"; returns false for any other name:
+	static bool preset(std::string const &name, PngOptions *options);
+};
+
 bool load_png(std::string filename, unsigned int *width, unsigned int *height, std::vector< uint32_t > *data, OriginLocation origin);
-void save_png(std::string filename, unsigned int width, unsigned int height, uint32_t const *data, OriginLocation origin);
+void save_png(std::string filename, unsigned int width, unsigned int height, uint32_t const *data, OriginLocation origin, PngOptions const &options = PngOptions());
 
 bool load_png(std::istream &from, unsigned int *width, unsigned int *height, std::vector< uint32_t > *data, OriginLocation origin = UpperLeftOrigin);
-void save_png(std::ostream &to, unsigned int width, unsigned int height, uint32_t const *data, OriginLocation origin = UpperLeftOrigin);
+void save_png(std::ostream &to, unsigned int width, unsigned int height, uint32_t const *data, OriginLocation origin = UpperLeftOrigin, PngOptions const &options = PngOptions());
+
+/*
+ * Save a PNG using several cores: horizontal strips of rows are filtered and deflated
+ * independently on 'pool', then joined (at zlib full flushes) into one ordinary IDAT stream.
+ * Output is a little larger than save_png's (strips don't share history) but otherwise standard.
+ */
+struct ThreadPool;
+void save_png_parallel(std::string filename, unsigned int width, unsigned int height, uint32_t const *data, ThreadPool &pool, OriginLocation origin, PngOptions const &options = PngOptions());
+void save_png_parallel(std::ostream &to, unsigned int width, unsigned int height, uint32_t const *data, ThreadPool &pool, OriginLocation origin = UpperLeftOrigin, PngOptions const &options = PngOptions());
@@ -2,7 +2,12 @@
 #include "GL.hpp"
 #include "Meshes.hpp"
 #include "Scene.hpp"
-#include "read_chunk.hpp"
+#include "AssetLoader.hpp"
+#include "ScenePager.hpp"
+#include "FrameCapture.hpp"
+#include "FrameRecorder.hpp"
+#include "Y4MWriter.hpp"
+#include "ThreadPool.hpp"
 
 #include <SDL.h>
 #include <glm/glm.hpp>
@@ -12,16 +17,30 @@
 #include <chrono>
 #include <iostream>
 #include <stdexcept>
-#include <fstream>
+#include <map>
+#include <list>
+#include <iterator>
+#include <memory>
+#include <ctime>
+#include <cstdio>
+#include <cassert>
 
 static GLuint compile_shader(GLenum type, std::string const &source);
 static GLuint link_program(GLuint vertex_shader, GLuint fragment_shader);
 
 int main(int argc, char **argv) {
+	auto startup_time = std::chrono::high_resolution_clock::now();
+
 	//Configuration:
 	struct {
 		std::string title = "Game2: Scene";
 		glm::uvec2 size = glm::uvec2(800, 600);
+		//recording ('F11' for PNGs, 'F10' for video): when the encoders fall behind, drop frames (Drop) or slow the game down (Block):
+		FrameRecorder::Policy record_policy = FrameRecorder::Drop;
+		uint32_t record_queue = 16; //frames waiting to be encoded
+		uint32_t record_threads = 0; //encoder threads (0: all but two hardware threads)
+		PngOptions record_png = PngOptions::fastest(); //(see png_bench for the speed and size of each preset)
+		PngOptions screenshot_png = PngOptions::balanced();
 	} config;
 
 	//------------	initialization ------------
@@ -93,13 +112,18 @@ int main(int argc, char **argv) {
 	GLuint program_mvp = 0;
 	GLuint program_itmv = 0;
 	GLuint program_to_light = 0;
+	GLuint program_DrawID = 0;
+	GLuint multidraw_program = 0;
+	GLuint multidraw_program_draws = 0;
+	GLuint multidraw_program_draw_base = 0;
+	GLuint multidraw_program_to_light = 0;
 	{ //compile shader program:
 		GLuint vertex_shader = compile_shader(GL_VERTEX_SHADER,
 			"#version 330\n"
 			"uniform mat4 mvp;\n"
 			"uniform mat3 itmv;\n"
-			"in vec4 Position;\n"
-			"in vec3 Normal;\n"
+			"layout(location = 0) in vec4 Position;\n"
+			"layout(location = 1) in vec3 Normal;\n"
 			"out vec3 normal;\n"
 			"void main() {\n"
 			"	gl_Position = mvp * Position;\n"
@@ -134,20 +158,58 @@ int main(int argc, char **argv) {
 
 		program_to_light = glGetUniformLocation(program, "to_light");
 		if (program_to_light == -1U) throw std::runtime_error("no uniform named to_light");
+
+		//multi-draw variant: same attribute locations (so it can share VAOs), matrices fetched per draw:
+		GLuint multidraw_vertex_shader = compile_shader(GL_VERTEX_SHADER,
+			"#version 330\n"
+			"uniform samplerBuffer draws;\n" //mvp columns, then itmv columns
+			"uniform int draw_base;\n"
+			"layout(location = 0) in vec4 Position;\n"
+			"layout(location = 1) in vec3 Normal;\n"
+			"layout(location = 2) in uint DrawID;\n"
+			"out vec3 normal;\n"
+			"void main() {\n"
+			"	int base = 7 * (draw_base + int(DrawID));\n"
+			"	mat4 mvp = mat4(texelFetch(draws, base), texelFetch(draws, base + 1), texelFetch(draws, base + 2), texelFetch(draws, base + 3));\n"
+			"	mat3 itmv = mat3(texelFetch(draws, base + 4).xyz, texelFetch(draws, base + 5).xyz, texelFetch(draws, base + 6).xyz);\n"
+			"	gl_Position = mvp * Position;\n"
+			"	normal = itmv * Normal;\n"
+			"}\n"
+		);
+
+		multidraw_program = link_program(fragment_shader, multidraw_vertex_shader);
+
+		program_DrawID = glGetAttribLocation(multidraw_program, "DrawID");
+		if (program_DrawID == -1U) throw std::runtime_error("no attribute named DrawID");
+		multidraw_program_draws = glGetUniformLocation(multidraw_program, "draws");
+		if (multidraw_program_draws == -1U) throw std::runtime_error("no uniform named draws");
+		multidraw_program_draw_base = glGetUniformLocation(multidraw_program, "draw_base");
+		if (multidraw_program_draw_base == -1U) throw std::runtime_error("no uniform named draw_base");
+		multidraw_program_to_light = glGetUniformLocation(multidraw_program, "to_light");
+		if (multidraw_program_to_light == -1U) throw std::runtime_error("no uniform named to_light");
 	}
 
 	//------------ meshes ------------
 
 	Meshes meshes;
 
-	{ //add meshes to database:
-		Meshes::Attributes attributes;
-		attributes.Position = program_Position;
-		attributes.Normal = program_Normal;
+	Meshes::Attributes mesh_attributes;
+	mesh_attributes.Position = program_Position;
+	mesh_attributes.Normal = program_Normal;
+	mesh_attributes.DrawID = program_DrawID;
+
+	//read blobs on a background thread; they are added to the database as they finish (in the game loop):
+	// (and re-read whenever they are re-exported, so edits show up without a restart)
+	AssetLoader loader({}, {"meshes.blob"}, true);
+	//stream scene.blob's entries in and out around the camera (also re-read when re-exported):
+	ScenePager::Limits page_limits;
+	page_limits.load_distance = 100.0f;
+	page_limits.unload_distance = 120.0f;
+	page_limits.max_entries = 100000;
+	ScenePager pager("scene.blob", page_limits, true);
+	bool assets_loaded = false;
+	bool first_frame = true;
 
-		meshes.load("meshes.blob", attributes);
-	}
-	
 	//------------ scene ------------
 
 	Scene scene;
@@ -155,58 +217,77 @@ int main(int argc, char **argv) {
 	scene.camera.fovy = glm::radians(60.0f);
 	scene.camera.aspect = float(config.size.x) / float(config.size.y);
 	scene.camera.near = 0.01f;
+	//submit all objects in a few multi-draws (press 'M' to switch to per-object draws to compare):
+	scene.submission = Scene::MultiDraw;
+	scene.multidraw.program = multidraw_program;
+	scene.multidraw.program_draws = multidraw_program_draws;
+	scene.multidraw.program_draw_base = multidraw_program_draw_base;
+	scene.multidraw.max_draws = Meshes::DrawIDCount;
+	//(press 'B' to cull back faces, which also lets multi-draw skip clusters facing away from the camera)
+	scene.back_faces_culled = false;
 	//(transform will be handled in the update function below)
 
+	//copy a mesh's geometric info to an object:
+	auto set_mesh = [](Scene::Object &object, Mesh const &mesh) {
+		object.vao = mesh.vao;
+		object.start = mesh.start;
+		object.count = mesh.count;
+		object.index_type = mesh.index_type;
+		object.base_vertex = mesh.base_vertex;
+		object.position_offset = mesh.position_offset;
+		object.position_scale = mesh.position_scale;
+		object.clusters = mesh.clusters;
+		static_assert(uint32_t(Scene::Object::MaxLods) == uint32_t(Mesh::MaxLods), "objects hold every mesh LOD");
+		object.lod_count = mesh.lod_count;
+		for (uint32_t l = 0; l < mesh.lod_count; ++l) {
+			object.lods[l].start = mesh.lods[l].start;
+			object.lods[l].count = mesh.lods[l].count;
+			object.lods[l].error = mesh.lods[l].error;
+		}
+	};
+
+	//re-fetch every object's mesh (after meshes arrive, move in the arena, or are reloaded):
+	// (objects whose meshes haven't been loaded yet -- or were removed -- draw nothing until they are)
+	auto refresh_objects = [&]() {
+		for (auto &object : scene.objects) {
+			if (Mesh const *mesh = meshes.find(object.mesh)) {
+				set_mesh(object, *mesh);
+			} else {
+				object.count = 0;
+				object.lod_count = 0;
+			}
+		}
+	};
+
 	//add some objects from the mesh library:
-	auto add_object = [&](std::string const &name, glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale) -> Scene::Object & {
-		Mesh const &mesh = meshes.get(name);
+	auto add_object = [&](MeshId const &mesh_id, glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale) -> Scene::Object & {
 		scene.objects.emplace_back();
 		Scene::Object &object = scene.objects.back();
 		object.transform.position = position;
 		object.transform.rotation = rotation;
 		object.transform.scale = scale;
-		object.vao = mesh.vao;
-		object.start = mesh.start;
-		object.count = mesh.count;
+		object.mesh = mesh_id;
+		if (Mesh const *mesh = meshes.find(mesh_id)) {
+			set_mesh(object, *mesh);
+		}
 		object.program = program;
 		object.program_mvp = program_mvp;
 		object.program_itmv = program_itmv;
 		return object;
 	};
 
-	{ //read objects to add from "scene.blob":
-		std::ifstream file("scene.blob", std::ios::binary);
-
-		std::vector< char > strings;
-		//read strings chunk:
-		read_chunk(file, "str0", &strings);
-
-		{ //read scene chunk, add meshes to scene:
-			struct SceneEntry {
-				uint32_t name_begin, name_end;
-				glm::vec3 position;
-				glm::quat rotation;
-				glm::vec3 scale;
-			};
-			static_assert(sizeof(SceneEntry) == 48, "Scene entry should be packed");
+	//objects created from each resident page of scene.blob:
+	std::map< uint32_t, std::vector< std::list< Scene::Object >::iterator > > page_objects;
 
-			std::vector< SceneEntry > data;
-			read_chunk(file, "scn0", &data);
-
-			for (auto const &entry : data) {
-				if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
-					throw std::runtime_error("index entry has out-of-range name begin/end");
-				}
-				std::string name(&strings[0] + entry.name_begin, &strings[0] + entry.name_end);
-				add_object(name, entry.position, entry.rotation, entry.scale);
-			}
-		}
-	}
+	//mesh ids used below (hashed at compile time):
+	constexpr MeshId Cube = MeshId("Cube");
+	constexpr MeshId Cube_001 = MeshId("Cube.001");
+	constexpr MeshId Sphere = MeshId("Sphere");
 
 	//create players and ball:
-	Scene::Object *player1 = &add_object("Cube", glm::vec3(0.0f, 3.0f, 0.6f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.6f));
-	Scene::Object *player2 = &add_object("Cube.001", glm::vec3(0.0f, -6.0f, 0.6f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.6f));
-	Scene::Object *ball = &add_object("Sphere", glm::vec3(0.0f, -1.7f, 5.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.4f));
+	Scene::Object *player1 = &add_object(Cube, glm::vec3(0.0f, 3.0f, 0.6f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.6f));
+	Scene::Object *player2 = &add_object(Cube_001, glm::vec3(0.0f, -6.0f, 0.6f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.6f));
+	Scene::Object *ball = &add_object(Sphere, glm::vec3(0.0f, -1.7f, 5.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.4f));
 
 	glm::vec3 player1_velocity = glm::vec3(0.0f, 0.0f, 0.0f);
 	glm::vec3 player2_velocity = glm::vec3(0.0f, 0.0f, 0.0f);
@@ -235,6 +316,53 @@ int main(int argc, char **argv) {
 	);
 	scene.camera.transform.scale = glm::vec3(1.0f, 1.0f, 1.0f);
 
+	//------------ capture ------------
+
+	//screenshots ('F12') are read back asynchronously and saved on a background thread, which
+	// deflates strips of each one on every core (a screenshot is a one-off burst of work):
+	// (png_strips is declared first, so it outlives the screenshots still queued on png_writer at exit)
+	FrameCapture capture(config.size);
+	ThreadPool png_strips;
+	ThreadPool png_writer(1);
+	bool screenshot_requested = false;
+	uint32_t screenshots_taken = 0;
+	std::string screenshot_prefix = "screenshot-" + std::to_string(std::time(nullptr)) + "-"; //(so runs don't overwrite each other)
+
+	//recordings ('F11' or 'F10' to start, either to stop) are read back the same way, then encoded on a pool of encoder
+	// threads -- as numbered PNGs, or (for video) converted to YUV and appended to a .y4m file:
+	FrameCapture recording_capture(config.size, 4);
+	PngOptions record_png = config.record_png;
+	FrameRecorder recorder([record_png](std::string const &filename, FrameCapture::Frame const &frame) {
+		save_png(filename, frame.size.x, frame.size.y, frame.pixels.data(), LowerLeftOrigin, record_png);
+	}, config.record_policy, config.record_queue, config.record_threads);
+	bool recording = false;
+	std::unique_ptr< Y4MWriter > video; //(set while recording video)
+	std::string recording_prefix;
+	uint32_t recording_frames = 0; //frames captured in this recording
+	uint32_t recording_skipped = 0; //frames not captured (every readback buffer in flight)
+	uint32_t recording_dropped = 0; //recorder.dropped when this recording started
+	//hand a finished readback to the current recording's encoders:
+	auto queue_recorded = [&](FrameCapture::Frame &&frame) {
+		if (video) {
+			video->push(std::move(frame));
+		} else {
+			char number[16];
+			std::snprintf(number, sizeof(number), "%06u", frame.tag);
+			recorder.push(recording_prefix + number + ".png", std::move(frame));
+		}
+	};
+	auto report_recording = [&]() {
+		FrameRecorder const &encoders = (video ? video->recorder : recorder);
+		uint32_t dropped = encoders.dropped - (video ? 0 : recording_dropped);
+		std::cout << "Recording '" << (video ? video->filename : recording_prefix + "*.png") << "': " << recording_frames << " frames captured, "
+			<< recording_skipped << " skipped at readback, " << dropped << " dropped;"
+			<< " encoder queue " << encoders.depth << "/" << config.record_queue << " (peak " << encoders.peak_depth << ") on " << encoders.size() << " threads";
+		if (video && video->busy_ns != 0) {
+			std::cout << "; converting at " << video->written / (video->busy_ns * 1e-9) << " frames/sec per core";
+		}
+		std::cout << "." << std::endl;
+	};
+
 	//------------ game loop ------------
 
 	bool should_quit = false;
@@ -263,6 +391,34 @@ int main(int argc, char **argv) {
 			//handle input:
 			if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_ESCAPE) {
 				should_quit = true;
+			} else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_m) {
+				scene.submission = (scene.submission == Scene::MultiDraw ? Scene::PerObject : Scene::MultiDraw);
+				std::cout << "Submission: " << (scene.submission == Scene::MultiDraw ? "multi-draw" : "per-object")
+					<< " (last frame: " << scene.objects.size() << " objects, " << scene.triangles << " triangles in " << scene.draw_calls << " draw calls, " << scene.clusters_culled << " clusters culled)." << std::endl;
+			} else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_b) {
+				scene.back_faces_culled = !scene.back_faces_culled;
+				std::cout << "Back faces: " << (scene.back_faces_culled ? "culled" : "drawn") << "." << std::endl;
+			} else if (evt.type == SDL_KEYDOWN && (evt.key.keysym.sym == SDLK_F11 || evt.key.keysym.sym == SDLK_F10)) {
+				recording = !recording;
+				if (recording) {
+					//the last recording's readbacks (if any are still in flight) go to it, not this one:
+					recording_capture.drain(queue_recorded);
+					video.reset();
+					recording_prefix = "recording-" + std::to_string(std::time(nullptr));
+					recording_frames = 0;
+					recording_skipped = 0;
+					recording_dropped = recorder.dropped;
+					if (evt.key.keysym.sym == SDLK_F10) {
+						video.reset(new Y4MWriter(recording_prefix + ".y4m", config.size, 60, config.record_policy, config.record_queue, config.record_threads));
+					} else {
+						recording_prefix += "-";
+					}
+					std::cout << "Recording to '" << (video ? video->filename : recording_prefix + "*.png") << "' (" << (config.record_policy == FrameRecorder::Drop ? "dropping" : "blocking") << " when the encoders fall behind)." << std::endl;
+				} else {
+					report_recording();
+				}
+			} else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_F12) {
+				screenshot_requested = true;
 			} else if (evt.type == SDL_QUIT) {
 				should_quit = true;
 				break;
@@ -310,6 +466,97 @@ int main(int argc, char **argv) {
 		}
 		if (should_quit) break;
 
+		//save screenshots whose readbacks have finished:
+		capture.poll([&](FrameCapture::Frame &&frame) {
+			std::string filename = screenshot_prefix + std::to_string(frame.tag) + ".png";
+			std::shared_ptr< FrameCapture::Frame > pending(new FrameCapture::Frame(std::move(frame)));
+			PngOptions options = config.screenshot_png;
+			png_writer.run([filename, pending, options, &png_strips](){
+				save_png_parallel(filename, pending->size.x, pending->size.y, pending->pixels.data(), png_strips, LowerLeftOrigin, options);
+				std::cout << "Saved '" << filename << "'." << std::endl;
+			});
+		});
+
+		//queue recorded frames whose readbacks have finished for encoding:
+		recording_capture.poll(queue_recorded);
+		//(a finished video is closed once its last frames have been read back)
+		if (video && !recording && recording_capture.in_flight() == 0) {
+			video.reset(); //(finishes the frames it has queued)
+		}
+
+		//pick up blobs the loader thread has finished:
+		std::unique_ptr< AssetLoader::Result > result;
+		while (loader.poll(&result)) {
+			if (!result->error.empty()) {
+				//(a broken re-export shouldn't end the game; the old data stays loaded)
+				if (result->reload) {
+					std::cerr << "WARNING: " << result->error << std::endl;
+					continue;
+				}
+				throw std::runtime_error(result->error);
+			}
+			assert(result->meshes);
+			if (result->reload) {
+				//(vertex data is read during the reload, so it can still fail -- e.g., if the file is being rewritten)
+				try {
+					Meshes::Changes changes = meshes.reload(*result->meshes, mesh_attributes);
+					std::cout << "Reloaded '" << result->filename << "': " << changes.updated << " meshes updated, "
+						<< changes.resized << " resized, " << changes.added << " added, " << changes.removed << " removed, "
+						<< changes.unchanged << " unchanged." << std::endl;
+				} catch (std::exception &e) {
+					std::cerr << "WARNING: Failed to reload '" << result->filename << "': " << e.what() << std::endl;
+				}
+			} else {
+				meshes.upload(*result->meshes, mesh_attributes);
+			}
+			//show objects whose meshes just arrived (and follow any that moved):
+			refresh_objects();
+		}
+
+		//add and remove scene.blob pages as the camera moves:
+		pager.set_focus(scene.camera.transform.position);
+		std::unique_ptr< ScenePager::Change > change;
+		while (pager.poll(&change)) {
+			if (change->type == ScenePager::Change::Error) {
+				//(a broken re-export shouldn't end the game; pages already resident stay)
+				std::cerr << "WARNING: " << change->error << std::endl;
+			} else if (change->type == ScenePager::Change::Clear) {
+				for (auto const &page : page_objects) {
+					for (auto const &object : page.second) {
+						scene.objects.erase(object);
+					}
+				}
+				page_objects.clear();
+				std::cout << "Reloaded 'scene.blob'; paging it back in." << std::endl;
+			} else if (change->type == ScenePager::Change::Unload) {
+				auto f = page_objects.find(change->page);
+				assert(f != page_objects.end());
+				for (auto const &object : f->second) {
+					scene.objects.erase(object);
+				}
+				page_objects.erase(f);
+			} else {
+				assert(change->type == ScenePager::Change::Load);
+				auto &objects = page_objects[change->page];
+				for (auto const &entry : change->entries) {
+					add_object(entry.mesh, entry.position, entry.rotation, entry.scale);
+					objects.emplace_back(std::prev(scene.objects.end()));
+				}
+			}
+		}
+		if (!assets_loaded && loader.done()) {
+			assets_loaded = true;
+			for (auto const &object : scene.objects) {
+				if (!meshes.find(object.mesh)) {
+					throw std::runtime_error("Looking up mesh that doesn't exist.");
+				}
+			}
+			meshes.compact();
+			refresh_objects();
+			meshes.arena.report(std::cout);
+			std::cout << "All assets loaded after " << std::chrono::duration< float, std::milli >(std::chrono::high_resolution_clock::now() - startup_time).count() << " ms." << std::endl;
+		}
+
 		auto current_time = std::chrono::high_resolution_clock::now();
 		static auto previous_time = current_time;
 		float elapsed = std::chrono::duration< float >(current_time - previous_time).count();
@@ -493,7 +740,7 @@ int main(int argc, char **argv) {
 				if (player1_getting_point) {
 					player1_score++;
 					ball_velocity = glm::vec3(0.0f, -5.0f, 0.0f);
-					add_object("Sphere", glm::vec3(0.0f, 8.0 - ((float)player1_score) * 0.5f, 7.5f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.1f));
+					add_object(Sphere, glm::vec3(0.0f, 8.0 - ((float)player1_score) * 0.5f, 7.5f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.1f));
 					if (player1_score == 10) {
 						game_over = true;
 						player1->transform.position.z = 5.0f;
@@ -502,7 +749,7 @@ int main(int argc, char **argv) {
 				} else {
 					player2_score++;
 					ball_velocity = glm::vec3(0.0f, 5.0f, 0.0f);
-					add_object("Sphere", glm::vec3(0.0f, -12.3 + ((float)player2_score) * 0.5f, 7.5f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.1f));
+					add_object(Sphere, glm::vec3(0.0f, -12.3 + ((float)player2_score) * 0.5f, 7.5f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.1f));
 					if (player2_score == 10) {
 						game_over = true;
 						player2->transform.position.z = 5.0f;
@@ -525,17 +772,44 @@ int main(int argc, char **argv) {
 		glClearColor(0.5, 0.5, 0.5, 0.0);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 		glEnable(GL_DEPTH_TEST);
+		if (scene.back_faces_culled) glEnable(GL_CULL_FACE);
+		else glDisable(GL_CULL_FACE);
 		glEnable(GL_BLEND);
 		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 
 		{ //draw game state:
+			glm::vec3 to_light = glm::normalize(glm::vec3(0.0f, 1.0f, 10.0f));
 			glUseProgram(program);
-			glUniform3fv(program_to_light, 1, glm::value_ptr(glm::normalize(glm::vec3(0.0f, 1.0f, 10.0f))));
+			glUniform3fv(program_to_light, 1, glm::value_ptr(to_light));
+			glUseProgram(multidraw_program);
+			glUniform3fv(multidraw_program_to_light, 1, glm::value_ptr(to_light));
 			scene.render();
 		}
 
+		if (screenshot_requested) {
+			//(queued behind this frame's drawing; picked up by capture.poll() once it is done)
+			if (capture.capture(screenshots_taken)) {
+				screenshots_taken += 1;
+				screenshot_requested = false;
+			}
+		}
+
+		if (recording) {
+			if (recording_capture.capture(recording_frames)) {
+				recording_frames += 1;
+				if (recording_frames % 600 == 0) report_recording();
+			} else {
+				recording_skipped += 1;
+			}
+		}
+
 		SDL_GL_SwapWindow(window);
+
+		if (first_frame) {
+			first_frame = false;
+			std::cout << "First frame after " << std::chrono::duration< float, std::milli >(std::chrono::high_resolution_clock::now() - startup_time).count() << " ms." << std::endl;
+		}
 	}
 
 
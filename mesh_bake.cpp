@@ -0,0 +1,322 @@
+#include "ChunkFile.hpp"
+#include "write_chunk.hpp"
+#include "ThreadPool.hpp"
+#include "mesh_bounds.hpp"
+#include "mesh_optimize.hpp"
+
+#include <glm/glm.hpp>
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cmath>
+#include <cassert>
+
+//"mesh_bake" turns a raw mesh dump into a meshes.blob:
+//   mesh_bake [--format p16n|v3nq|v3n3] in.blob out.blob
+// The input is an unindexed 'v3n3' / 'str0' / 'idx0' blob (every triangle corner written out,
+// as export-meshes.py does with --raw). Each mesh is encoded, deduplicated, and reordered for
+// the post-transform vertex cache on its own thread; the output has the same chunks that
+// export-meshes.py writes ('p16n' (or other format), 'qnt0', 'ix16', 'ix32', 'str0', 'idx1', 'bnd0').
+// After the cache reordering, patches of triangles are reordered to reduce overdraw (trading a
+// little cache efficiency), and vertices are renumbered in order of first use for fetch locality.
+// Per-mesh ACMR, ATVR, and overdraw (before and after) are printed to measure the savings.
+
+//vertex formats (as in Meshes.cpp):
+struct v3n3 {
+	glm::vec3 v;
+	glm::vec3 n;
+};
+static_assert(sizeof(v3n3) == 24, "v3n3 is packed");
+struct v3nq {
+	glm::vec3 v;
+	uint32_t n;
+};
+static_assert(sizeof(v3nq) == 16, "v3nq is packed");
+struct p16n {
+	uint16_t v[3];
+	uint16_t pad;
+	uint32_t n;
+};
+static_assert(sizeof(p16n) == 12, "p16n is packed");
+
+struct Quantization {
+	glm::vec3 offset;
+	glm::vec3 scale;
+};
+static_assert(sizeof(Quantization) == 24, "Quantization entry should be packed");
+
+struct IndexEntry0 {
+	uint32_t name_begin, name_end;
+	uint32_t vertex_start, vertex_count;
+};
+static_assert(sizeof(IndexEntry0) == 16, "Index entry should be packed");
+
+struct IndexEntry {
+	uint32_t name_begin, name_end;
+	uint32_t vertex_start, vertex_count;
+	uint32_t index_start, index_count; //indices are relative to vertex_start
+};
+static_assert(sizeof(IndexEntry) == 24, "Index entry should be packed");
+
+//pack a unit normal as a signed 2_10_10_10 integer (w = 0):
+static uint32_t pack_normal(glm::vec3 const &n) {
+	uint32_t packed = 0;
+	for (uint32_t c = 0; c < 3; ++c) {
+		int32_t bits = int32_t(std::lround(std::max(-1.0f, std::min(1.0f, n[c])) * 511.0f));
+		packed |= (uint32_t(bits) & 0x3ff) << (10 * c);
+	}
+	return packed;
+}
+
+static glm::vec3 unpack_normal(uint32_t packed) {
+	glm::vec3 n;
+	for (uint32_t c = 0; c < 3; ++c) {
+		int32_t bits = (packed >> (10 * c)) & 0x3ff;
+		if (bits & 0x200) bits -= 0x400;
+		n[c] = std::max(bits / 511.0f, -1.0f);
+	}
+	return n;
+}
+
+//one mesh, baked:
+struct Baked {
+	std::vector< char > vertices; //unique vertices, encoded
+	std::vector< uint32_t > indices;
+	Quantization quantization;
+	BoundsEntry bounds;
+	float position_error = 0.0f;
+	float normal_error = 0.0f; //(degrees)
+	float acmr_input = 0.0f;
+	float acmr_optimized = 0.0f;
+	float atvr_input = 0.0f;
+	float atvr_optimized = 0.0f;
+	float overdraw_input = 0.0f;
+	float overdraw_optimized = 0.0f;
+};
+
+static void bake(std::string const &format, v3n3 const *corners, uint32_t corner_count, Baked *baked_) {
+	assert(baked_);
+	Baked &baked = *baked_;
+
+	glm::vec3 lo = corners[0].v, hi = corners[0].v;
+	for (uint32_t i = 0; i < corner_count; ++i) {
+		lo = glm::min(lo, corners[i].v);
+		hi = glm::max(hi, corners[i].v);
+	}
+	if (format == "p16n") {
+		baked.quantization.offset = lo;
+		baked.quantization.scale = hi - lo;
+	} else {
+		baked.quantization.offset = glm::vec3(0.0f);
+		baked.quantization.scale = glm::vec3(1.0f);
+	}
+
+	//encode each corner:
+	size_t stride = (format == "v3n3" ? sizeof(v3n3) : format == "v3nq" ? sizeof(v3nq) : sizeof(p16n));
+	std::vector< char > encoded(stride * corner_count);
+	for (uint32_t i = 0; i < corner_count; ++i) {
+		v3n3 const &corner = corners[i];
+		char *to = &encoded[stride * i];
+		if (format == "v3n3") {
+			std::memcpy(to, &corner, sizeof(v3n3));
+			continue;
+		}
+		uint32_t packed = pack_normal(corner.n);
+		glm::vec3 decoded = unpack_normal(packed);
+		float length = glm::length(decoded) * glm::length(corner.n);
+		if (length > 0.0f) {
+			float cosine = glm::dot(decoded, corner.n) / length;
+			baked.normal_error = std::max(baked.normal_error, std::acos(std::max(-1.0f, std::min(1.0f, cosine))) * 57.2957795f);
+		}
+		if (format == "v3nq") {
+			v3nq v;
+			v.v = corner.v;
+			v.n = packed;
+			std::memcpy(to, &v, sizeof(v));
+			continue;
+		}
+		p16n v;
+		glm::vec3 const &offset = baked.quantization.offset, &scale = baked.quantization.scale;
+		for (uint32_t c = 0; c < 3; ++c) {
+			v.v[c] = uint16_t(scale[c] > 0.0f ? std::lround((corner.v[c] - offset[c]) / scale[c] * 65535.0f) : 0);
+			baked.position_error = std::max(baked.position_error, std::abs(offset[c] + scale[c] * (v.v[c] / 65535.0f) - corner.v[c]));
+		}
+		v.pad = 0;
+		v.n = packed;
+		std::memcpy(to, &v, sizeof(v));
+	}
+
+	//merge identical (encoded) vertices:
+	struct Key {
+		char const *bytes;
+		size_t size;
+		bool operator==(Key const &o) const { return std::memcmp(bytes, o.bytes, size) == 0; }
+	};
+	struct Hash {
+		size_t operator()(Key const &key) const {
+			uint64_t h = 14695981039346656037ULL; //(FNV-1a, as MeshId)
+			for (size_t i = 0; i < key.size; ++i) h = (h ^ uint8_t(key.bytes[i])) * 1099511628211ULL;
+			return size_t(h);
+		}
+	};
+	std::unordered_map< Key, uint32_t, Hash > index_of;
+	index_of.reserve(corner_count);
+	std::vector< uint32_t > indices;
+	indices.reserve(corner_count);
+	uint32_t unique = 0;
+	std::vector< glm::vec3 > positions; //(of unique vertices, before encoding)
+	for (uint32_t i = 0; i < corner_count; ++i) {
+		auto inserted = index_of.emplace(Key{&encoded[stride * i], stride}, unique);
+		if (inserted.second) {
+			baked.vertices.insert(baked.vertices.end(), &encoded[stride * i], &encoded[stride * i] + stride);
+			positions.emplace_back(corners[i].v);
+			++unique;
+		}
+		indices.emplace_back(inserted.first->second);
+	}
+
+	baked.acmr_input = mesh_acmr(indices, unique);
+	baked.atvr_input = mesh_atvr(indices, unique);
+	baked.overdraw_input = mesh_overdraw(indices, positions);
+
+	//reorder triangles for the post-transform cache, then patches of them for overdraw:
+	baked.indices = optimize_overdraw(optimize_vertex_cache(indices, unique), positions, OverdrawThreshold);
+
+	//reorder vertices for fetch locality:
+	std::vector< uint32_t > order = optimize_vertex_fetch(&baked.indices, unique);
+	{
+		std::vector< char > vertices(baked.vertices.size());
+		std::vector< glm::vec3 > ordered_positions(unique);
+		for (uint32_t v = 0; v < unique; ++v) {
+			std::memcpy(&vertices[stride * v], &baked.vertices[stride * order[v]], stride);
+			ordered_positions[v] = positions[order[v]];
+		}
+		baked.vertices.swap(vertices);
+		positions.swap(ordered_positions);
+	}
+
+	baked.acmr_optimized = mesh_acmr(baked.indices, unique);
+	baked.atvr_optimized = mesh_atvr(baked.indices, unique);
+	baked.overdraw_optimized = mesh_overdraw(baked.indices, positions);
+
+	//(decoded positions may stray from the originals by position_error on each axis)
+	baked.bounds = mesh_bounds(positions, baked.indices, baked.position_error * std::sqrt(3.0f));
+}
+
+int main(int argc, char **argv) {
+	std::string format = "p16n";
+	bool compress = false;
+	std::vector< std::string > args;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--format" && i + 1 < argc) {
+			format = argv[++i];
+		} else if (arg == "--compress") {
+			compress = true;
+		} else {
+			args.emplace_back(arg);
+		}
+	}
+	if (args.size() != 2 || !(format == "p16n" || format == "v3nq" || format == "v3n3")) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [--format p16n|v3nq|v3n3] [--compress] in.blob out.blob" << std::endl;
+		return 1;
+	}
+	std::string in_filename = args[0];
+	std::string out_filename = args[1];
+
+	try {
+		ChunkFile in(in_filename);
+		ChunkSpan< v3n3 > corners = in.get< v3n3 >("v3n3");
+		ChunkSpan< char > strings = in.get< char >("str0");
+		ChunkSpan< IndexEntry0 > index = in.get< IndexEntry0 >("idx0");
+		for (IndexEntry0 const &entry : index) {
+			if (!(entry.vertex_start < entry.vertex_start + entry.vertex_count && entry.vertex_start + entry.vertex_count <= corners.size())) {
+				throw std::runtime_error("index entry has out-of-range vertex start/count");
+			}
+			if (entry.vertex_count % 3 != 0) {
+				throw std::runtime_error("index entry has vertex count that isn't a multiple of three");
+			}
+			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
+				throw std::runtime_error("index entry has out-of-range name begin/end");
+			}
+		}
+
+		//bake meshes in parallel:
+		std::vector< Baked > baked(index.size());
+		ThreadPool pool;
+		pool.parallel_for(uint32_t(index.size()), [&](uint32_t m) {
+			bake(format, corners.begin() + index[m].vertex_start, index[m].vertex_count, &baked[m]);
+		});
+
+		//gather into chunks (in input order):
+		size_t stride = (format == "v3n3" ? sizeof(v3n3) : format == "v3nq" ? sizeof(v3nq) : sizeof(p16n));
+		std::vector< char > data;
+		std::vector< Quantization > quantization;
+		std::vector< uint16_t > indices16;
+		std::vector< uint32_t > indices32;
+		std::vector< IndexEntry > entries;
+		std::vector< BoundsEntry > bounds;
+		uint32_t vertex_count = 0;
+		for (uint32_t m = 0; m < index.size(); ++m) {
+			Baked const &b = baked[m];
+			uint32_t unique = uint32_t(b.vertices.size() / stride);
+			std::string name(strings.begin() + index[m].name_begin, strings.begin() + index[m].name_end);
+			float diagonal = glm::length(b.quantization.scale);
+			std::cout << "'" << name << "': " << b.indices.size() / 3 << " triangles, " << index[m].vertex_count << " -> " << unique << " vertices;"
+				<< " ACMR " << b.acmr_input << " -> " << b.acmr_optimized << ", ATVR " << b.atvr_input << " -> " << b.atvr_optimized
+				<< ", overdraw " << b.overdraw_input << " -> " << b.overdraw_optimized << " (input order -> optimized);"
+				<< " max position error " << b.position_error << " (" << (format == "p16n" && diagonal > 0.0f ? 100.0f * b.position_error / diagonal : 0.0f) << "% of bounds),"
+				<< " max normal error " << b.normal_error << " degrees" << std::endl;
+
+			IndexEntry entry;
+			entry.name_begin = index[m].name_begin;
+			entry.name_end = index[m].name_end;
+			entry.vertex_start = vertex_count;
+			entry.vertex_count = unique;
+			if (unique <= 0x10000) {
+				entry.index_start = uint32_t(indices16.size());
+				for (uint32_t i : b.indices) indices16.emplace_back(uint16_t(i));
+			} else {
+				entry.index_start = uint32_t(indices32.size());
+				indices32.insert(indices32.end(), b.indices.begin(), b.indices.end());
+			}
+			entry.index_count = uint32_t(b.indices.size());
+			entries.emplace_back(entry);
+
+			bounds.emplace_back(b.bounds);
+			bounds.back().vertex_start = entry.vertex_start;
+			bounds.back().vertex_count = entry.vertex_count;
+
+			data.insert(data.end(), b.vertices.begin(), b.vertices.end());
+			quantization.emplace_back(b.quantization);
+			vertex_count += unique;
+		}
+
+		std::vector< BlobChunk > chunks;
+		chunks.emplace_back(format, data);
+		if (format == "p16n") chunks.emplace_back("qnt0", quantization);
+		chunks.emplace_back("ix16", indices16);
+		chunks.emplace_back("ix32", indices32);
+		chunks.emplace_back("str0", strings.begin(), strings.size());
+		chunks.emplace_back("idx1", entries);
+		chunks.emplace_back("bnd0", bounds);
+
+		std::ofstream out(out_filename, std::ios::binary);
+		write_blob(out, chunks, (compress ? 4096 : 0)); //(small chunks aren't worth compressing)
+		if (!out) {
+			throw std::runtime_error("Failed to write '" + out_filename + "'");
+		}
+		std::cout << "Wrote " << out.tellp() << " bytes to '" << out_filename << "' (" << index.size() << " meshes on " << pool.size() << " threads)." << std::endl;
+	} catch (std::exception &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
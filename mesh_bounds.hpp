@@ -0,0 +1,48 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+//'bnd0' entry: object-space bounds and statistics of a mesh (parallel to the index chunk),
+// so runtime systems never have to scan vertex data for them:
+struct BoundsEntry {
+	glm::vec3 min, max; //axis-aligned bounding box
+	glm::vec3 center; //bounding sphere
+	float radius;
+	float area; //surface area (full detail)
+	uint32_t triangles; //(full detail)
+	uint32_t vertex_start, vertex_count; //as in the mesh's index entry
+};
+static_assert(sizeof(BoundsEntry) == 56, "Bounds entry should be packed");
+
+//bounds of the triangles 'indices' makes of 'positions' (vertex range is left for the caller):
+// 'slack' is added to the sphere's radius (e.g., to cover quantization error).
+inline BoundsEntry mesh_bounds(std::vector< glm::vec3 > const &positions, std::vector< uint32_t > const &indices, float slack = 0.0f) {
+	BoundsEntry bounds;
+	bounds.min = bounds.max = (positions.empty() ? glm::vec3(0.0f) : positions[0]);
+	for (glm::vec3 const &p : positions) {
+		bounds.min = glm::min(bounds.min, p);
+		bounds.max = glm::max(bounds.max, p);
+	}
+	//(sphere around the box's center: not the smallest sphere, but never far from it)
+	bounds.center = 0.5f * (bounds.min + bounds.max);
+	float radius2 = 0.0f;
+	for (glm::vec3 const &p : positions) {
+		glm::vec3 d = p - bounds.center;
+		radius2 = std::max(radius2, glm::dot(d, d));
+	}
+	bounds.radius = std::sqrt(radius2) + slack;
+
+	bounds.area = 0.0f;
+	for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+		glm::vec3 const &a = positions[indices[i]], &b = positions[indices[i+1]], &c = positions[indices[i+2]];
+		bounds.area += 0.5f * glm::length(glm::cross(b - a, c - a));
+	}
+	bounds.triangles = uint32_t(indices.size() / 3);
+	bounds.vertex_start = 0;
+	bounds.vertex_count = uint32_t(positions.size());
+	return bounds;
+}
@@ -0,0 +1,199 @@
+#include "mesh_clusters.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+#include <limits>
+#include <cmath>
+#include <cassert>
+
+void mesh_clusters(
+	std::vector< glm::vec3 > const &positions,
+	std::vector< uint32_t > const &indices,
+	uint32_t max_triangles,
+	std::vector< uint32_t > *reordered_,
+	std::vector< MeshCluster > *clusters_) {
+
+	assert(reordered_);
+	auto &reordered = *reordered_;
+	assert(clusters_);
+	auto &clusters = *clusters_;
+	assert(max_triangles > 0);
+	reordered.clear();
+	clusters.clear();
+
+	uint32_t triangle_count = uint32_t(indices.size() / 3);
+
+	//unit normal (zero if degenerate) and centroid of each triangle:
+	std::vector< glm::vec3 > normals(triangle_count), centroids(triangle_count);
+	float edge_sum = 0.0f;
+	for (uint32_t t = 0; t < triangle_count; ++t) {
+		glm::vec3 const &a = positions[indices[3*t+0]], &b = positions[indices[3*t+1]], &c = positions[indices[3*t+2]];
+		glm::vec3 n = glm::cross(b - a, c - a);
+		float length = glm::length(n);
+		normals[t] = (length > 0.0f ? n / length : glm::vec3(0.0f));
+		centroids[t] = (a + b + c) / 3.0f;
+		edge_sum += glm::length(b - a) + glm::length(c - b) + glm::length(a - c);
+	}
+	//distances are scored relative to the width a full cluster would have:
+	float cluster_width = (triangle_count ? edge_sum / (3.0f * triangle_count) : 1.0f) * std::sqrt(float(max_triangles));
+	if (!(cluster_width > 0.0f)) cluster_width = 1.0f;
+
+	//triangles around each vertex:
+	std::vector< uint32_t > first(positions.size() + 1, 0), around(indices.size());
+	for (uint32_t v : indices) ++first[v + 1];
+	for (uint32_t v = 0; v < positions.size(); ++v) first[v + 1] += first[v];
+	{
+		std::vector< uint32_t > fill(first.begin(), first.end() - 1);
+		for (uint32_t i = 0; i < indices.size(); ++i) around[fill[indices[i]]++] = i / 3;
+	}
+
+	//triangles bucketed by centroid into a grid of half-cluster-wide cells, so finding an unconnected
+	// triangle near a cluster only looks at the 27 cells around it (buckets drop assigned triangles lazily):
+	float const GridCell = 0.5f * cluster_width;
+	auto cell_of = [GridCell](glm::vec3 const &p) {
+		return glm::ivec3(int(std::floor(p.x / GridCell)), int(std::floor(p.y / GridCell)), int(std::floor(p.z / GridCell)));
+	};
+	auto cell_key = [](glm::ivec3 const &c) {
+		return (uint64_t(uint32_t(c.x) & 0x1fffff) << 42) | (uint64_t(uint32_t(c.y) & 0x1fffff) << 21) | uint64_t(uint32_t(c.z) & 0x1fffff);
+	};
+	std::unordered_map< uint64_t, std::vector< uint32_t > > grid;
+	for (uint32_t t = 0; t < triangle_count; ++t) {
+		grid[cell_key(cell_of(centroids[t]))].emplace_back(t);
+	}
+
+	std::vector< bool > assigned(triangle_count, false);
+	std::vector< uint32_t > vertex_cluster(positions.size(), -1U); //cluster each vertex was last added to
+	std::vector< uint32_t > candidate_cluster(triangle_count, -1U); //cluster that last listed each triangle as a candidate
+	std::vector< uint32_t > members, candidates;
+	uint32_t scan = 0; //(every triangle before this is assigned)
+	uint32_t seed = -1U;
+
+	while (true) {
+		if (seed == -1U) {
+			while (scan < triangle_count && assigned[scan]) ++scan;
+			if (scan == triangle_count) break;
+			seed = scan;
+		}
+		uint32_t id = uint32_t(clusters.size());
+		members.clear();
+		candidates.clear();
+		glm::vec3 normal_sum(0.0f), centroid_sum(0.0f);
+
+		//grow the cluster from the seed:
+		for (uint32_t next = seed; next != -1U; ) {
+			assigned[next] = true;
+			members.emplace_back(next);
+			normal_sum += normals[next];
+			centroid_sum += centroids[next];
+			for (uint32_t c = 0; c < 3; ++c) {
+				uint32_t v = indices[3*next+c];
+				if (vertex_cluster[v] == id) continue;
+				vertex_cluster[v] = id;
+				for (uint32_t k = first[v]; k < first[v + 1]; ++k) {
+					uint32_t t = around[k];
+					if (!assigned[t] && candidate_cluster[t] != id) {
+						candidate_cluster[t] = id;
+						candidates.emplace_back(t);
+					}
+				}
+			}
+			if (members.size() == max_triangles) break;
+
+			//next: the neighbour that adds the fewest vertices, faces most like the cluster, and is closest:
+			float normal_length = glm::length(normal_sum);
+			glm::vec3 normal = (normal_length > 0.0f ? normal_sum / normal_length : glm::vec3(0.0f));
+			glm::vec3 centroid = centroid_sum / float(members.size());
+			float best_score = std::numeric_limits< float >::infinity();
+			next = -1U;
+			for (uint32_t i = 0; i < candidates.size(); ) {
+				uint32_t t = candidates[i];
+				if (assigned[t]) {
+					candidates[i] = candidates.back();
+					candidates.pop_back();
+					continue;
+				}
+				uint32_t shared = 0;
+				for (uint32_t c = 0; c < 3; ++c) {
+					if (vertex_cluster[indices[3*t+c]] == id) shared += 1;
+				}
+				float score = float(3 - shared) + 2.0f * (1.0f - glm::dot(normals[t], normal)) + glm::length(centroids[t] - centroid) / cluster_width;
+				if (score < best_score) {
+					best_score = score;
+					next = t;
+				}
+				++i;
+			}
+			if (next == -1U) {
+				//nothing connected is left; take a nearby unconnected triangle (e.g., a separate piece) instead:
+				float best_distance = GridCell;
+				glm::ivec3 center = cell_of(centroid);
+				for (int dz = -1; dz <= 1; ++dz) for (int dy = -1; dy <= 1; ++dy) for (int dx = -1; dx <= 1; ++dx) {
+					auto found = grid.find(cell_key(center + glm::ivec3(dx, dy, dz)));
+					if (found == grid.end()) continue;
+					std::vector< uint32_t > &bucket = found->second;
+					for (uint32_t i = 0; i < bucket.size(); ) {
+						uint32_t t = bucket[i];
+						if (assigned[t]) {
+							bucket[i] = bucket.back();
+							bucket.pop_back();
+							continue;
+						}
+						float distance = glm::length(centroids[t] - centroid);
+						if (distance < best_distance) {
+							best_distance = distance;
+							next = t;
+						}
+						++i;
+					}
+				}
+			}
+		}
+
+		MeshCluster cluster;
+		cluster.index_start = uint32_t(reordered.size());
+		cluster.index_count = 3 * uint32_t(members.size());
+		for (uint32_t t : members) {
+			reordered.insert(reordered.end(), indices.begin() + 3*t, indices.begin() + 3*t + 3);
+		}
+
+		//bounding sphere (around the box's center, as in mesh_bounds):
+		glm::vec3 min = positions[reordered[cluster.index_start]], max = min;
+		for (uint32_t i = cluster.index_start; i < reordered.size(); ++i) {
+			min = glm::min(min, positions[reordered[i]]);
+			max = glm::max(max, positions[reordered[i]]);
+		}
+		cluster.center = 0.5f * (min + max);
+		float radius2 = 0.0f;
+		for (uint32_t i = cluster.index_start; i < reordered.size(); ++i) {
+			glm::vec3 d = positions[reordered[i]] - cluster.center;
+			radius2 = std::max(radius2, glm::dot(d, d));
+		}
+		cluster.radius = std::sqrt(radius2);
+
+		//normal cone: the axis is the average normal; the cutoff comes from the normal furthest from it:
+		// (degenerate triangles are never drawn, so they don't widen the cone)
+		float normal_length = glm::length(normal_sum);
+		cluster.cone_axis = (normal_length > 0.0f ? normal_sum / normal_length : glm::vec3(0.0f, 0.0f, 1.0f));
+		float min_dot = (normal_length > 0.0f ? 1.0f : -1.0f);
+		for (uint32_t t : members) {
+			if (normals[t] == glm::vec3(0.0f)) continue;
+			min_dot = std::min(min_dot, glm::dot(normals[t], cluster.cone_axis));
+		}
+		//(cones wider than about 170 degrees almost never cull, so don't bother testing them)
+		cluster.cone_cutoff = (min_dot <= 0.1f ? 1.0f : std::sqrt(1.0f - min_dot * min_dot));
+		clusters.emplace_back(cluster);
+
+		//next seed: the leftover neighbour closest to this cluster, so clusters tile the surface:
+		glm::vec3 centroid = centroid_sum / float(members.size());
+		float best_distance = std::numeric_limits< float >::infinity();
+		seed = -1U;
+		for (uint32_t t : candidates) {
+			if (assigned[t]) continue;
+			float distance = glm::length(centroids[t] - centroid);
+			if (distance < best_distance) {
+				best_distance = distance;
+				seed = t;
+			}
+		}
+	}
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+
+/*
+ * Split an indexed triangle list into clusters ("meshlets") that can be culled separately.
+ *
+ * Clusters are grown greedily from a seed triangle, preferring neighbours that share the
+ * most vertices with the cluster, face the same way, and lie close to it, so each cluster
+ * is a compact, roughly flat patch of at most 'max_triangles' triangles. Each cluster gets:
+ *  - a bounding sphere, to test against the view frustum,
+ *  - a normal cone (axis and cutoff), to test if it faces away from a viewer: the whole
+ *    cluster is back-facing when seen from 'eye' if
+ *      dot(center - eye, axis) >= cutoff * length(center - eye) + radius
+ *    (cutoff is 1 -- never back-facing -- when the normals spread too far to bound).
+ * The triangles are written to 'reordered' cluster by cluster, so each cluster is one
+ * contiguous index range (same triangles as 'indices', same winding).
+ */
+
+struct MeshCluster {
+	uint32_t index_start, index_count; //in 'reordered'
+	glm::vec3 center;
+	float radius;
+	glm::vec3 cone_axis;
+	float cone_cutoff;
+};
+
+void mesh_clusters(
+	std::vector< glm::vec3 > const &positions,
+	std::vector< uint32_t > const &indices,
+	uint32_t max_triangles,
+	std::vector< uint32_t > *reordered,
+	std::vector< MeshCluster > *clusters);
@@ -0,0 +1,346 @@
+#include "ChunkFile.hpp"
+#include "write_chunk.hpp"
+#include "mesh_simplify.hpp"
+#include "mesh_bounds.hpp"
+#include "mesh_clusters.hpp"
+#include "mesh_optimize.hpp"
+
+#include <glm/glm.hpp>
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+//"mesh_lod" adds simplified levels of detail to a mesh blob:
+//   mesh_lod in.blob out.blob [levels=3] [ratio=0.5] [max_error=0.1] [cluster_size=64]
+// Each level keeps about 'ratio' of the previous level's triangles, as long as the surface
+// moves no more than 'max_error' (as a fraction of the mesh's bounding box diagonal).
+// LOD triangles index the same vertices as the full mesh; their index ranges are listed
+// in a 'lod0' chunk of {mesh, index start, index count, error} entries. Blobs with unindexed
+// ('idx0') meshes are rewritten with indexed ('idx1') meshes, since LODs need indices.
+// Full-detail triangles of meshes with more than 'cluster_size' triangles are reordered into
+// clusters of at most that many, listed (with bounding sphere and normal cone, for culling)
+// in a 'cls0' chunk; 0 turns clustering off.
+// Since clustering replaces mesh_bake's triangle order, each cluster is re-optimized for the
+// vertex cache (where that beats the order it grew in) and clusters are drawn outward-facing
+// first when that costs little cache efficiency (as mesh_bake does for overdraw); each level
+// of detail is optimized for both as well. Vertices are then renumbered in order of first use
+// (rewriting the vertex data chunk), and the final ACMR, ATVR, and overdraw are printed.
+// Mesh bounds ('bnd0') are (re)computed; all other chunks are copied unchanged.
+
+//vertex formats (as in Meshes.cpp):
+struct v3n3 {
+	glm::vec3 v;
+	glm::vec3 n;
+};
+static_assert(sizeof(v3n3) == 24, "v3n3 is packed");
+struct v3nq {
+	glm::vec3 v;
+	uint32_t n;
+};
+static_assert(sizeof(v3nq) == 16, "v3nq is packed");
+struct p16n {
+	uint16_t v[3];
+	uint16_t pad;
+	uint32_t n;
+};
+static_assert(sizeof(p16n) == 12, "p16n is packed");
+
+struct Quantization {
+	glm::vec3 offset;
+	glm::vec3 scale;
+};
+static_assert(sizeof(Quantization) == 24, "Quantization entry should be packed");
+
+struct IndexEntry {
+	uint32_t name_begin, name_end;
+	uint32_t vertex_start, vertex_count;
+	uint32_t index_start, index_count; //indices are relative to vertex_start
+};
+static_assert(sizeof(IndexEntry) == 24, "Index entry should be packed");
+
+struct LodEntry {
+	uint32_t mesh; //index of the mesh's idx1 entry
+	uint32_t index_start, index_count; //in the mesh's index chunk, relative to its vertex_start
+	float error; //object-space distance from the full mesh (roughly)
+};
+static_assert(sizeof(LodEntry) == 16, "Lod entry should be packed");
+
+struct ClusterEntry {
+	uint32_t mesh; //index of the mesh's idx1 entry
+	uint32_t index_start, index_count; //in the mesh's index chunk, within its full-detail range
+	glm::vec3 center; //object-space bounding sphere
+	float radius;
+	glm::vec3 cone_axis; //normal cone (see mesh_clusters.hpp)
+	float cone_cutoff;
+};
+static_assert(sizeof(ClusterEntry) == 44, "Cluster entry should be packed");
+
+static glm::vec3 unpack_normal(uint32_t packed) {
+	glm::vec3 n;
+	for (uint32_t c = 0; c < 3; ++c) {
+		int32_t bits = (packed >> (10 * c)) & 0x3ff;
+		if (bits & 0x200) bits -= 0x400;
+		n[c] = std::max(bits / 511.0f, -1.0f);
+	}
+	return n;
+}
+
+int main(int argc, char **argv) {
+	if (argc < 3 || argc > 7) {
+		std::cerr << "Usage:\n\t" << argv[0] << " in.blob out.blob [levels=3] [ratio=0.5] [max_error=0.1] [cluster_size=64]" << std::endl;
+		return 1;
+	}
+	std::string in_filename = argv[1];
+	std::string out_filename = argv[2];
+	uint32_t levels = (argc > 3 ? uint32_t(std::stoul(argv[3])) : 3);
+	float ratio = (argc > 4 ? std::stof(argv[4]) : 0.5f);
+	float max_error = (argc > 5 ? std::stof(argv[5]) : 0.1f);
+	uint32_t cluster_size = (argc > 6 ? uint32_t(std::stoul(argv[6])) : 64);
+	if (!(ratio > 0.0f && ratio < 1.0f)) {
+		std::cerr << "ratio should be between zero and one." << std::endl;
+		return 1;
+	}
+
+	try {
+		ChunkFile in(in_filename);
+
+		//decode vertex data to float positions (before dequantization) and normals:
+		std::string format;
+		std::vector< glm::vec3 > positions, normals;
+		if (in.has("v3n3")) {
+			format = "v3n3";
+			for (v3n3 const &v : in.get< v3n3 >(format)) {
+				positions.emplace_back(v.v);
+				normals.emplace_back(v.n);
+			}
+		} else if (in.has("v3nq")) {
+			format = "v3nq";
+			for (v3nq const &v : in.get< v3nq >(format)) {
+				positions.emplace_back(v.v);
+				normals.emplace_back(unpack_normal(v.n));
+			}
+		} else if (in.has("p16n")) {
+			format = "p16n";
+			for (p16n const &v : in.get< p16n >(format)) {
+				positions.emplace_back(v.v[0] / 65535.0f, v.v[1] / 65535.0f, v.v[2] / 65535.0f);
+				normals.emplace_back(unpack_normal(v.n));
+			}
+		} else {
+			throw std::runtime_error("No vertex data chunk in '" + in_filename + "'");
+		}
+		ChunkSpan< Quantization > quantization;
+		if (format == "p16n") quantization = in.get< Quantization >("qnt0");
+		//(copied, to be reordered mesh by mesh as vertices are renumbered)
+		size_t stride = (format == "v3n3" ? sizeof(v3n3) : format == "v3nq" ? sizeof(v3nq) : sizeof(p16n));
+		ChunkSpan< char > in_vertices = in.get< char >(format);
+		std::vector< char > out_vertices(in_vertices.begin(), in_vertices.end());
+		ChunkSpan< char > strings = in.get< char >("str0");
+
+		//read meshes (as index entries + full-detail indices):
+		std::vector< IndexEntry > meshes;
+		std::vector< std::vector< uint32_t > > mesh_indices;
+		if (in.has("idx1")) {
+			ChunkSpan< uint16_t > indices16;
+			if (in.has("ix16")) indices16 = in.get< uint16_t >("ix16");
+			ChunkSpan< uint32_t > indices32;
+			if (in.has("ix32")) indices32 = in.get< uint32_t >("ix32");
+			for (IndexEntry const &entry : in.get< IndexEntry >("idx1")) {
+				meshes.emplace_back(entry);
+				mesh_indices.emplace_back();
+				if (entry.vertex_count > 0x10000) {
+					for (uint32_t i : indices32.subspan(entry.index_start, entry.index_count)) mesh_indices.back().emplace_back(i);
+				} else {
+					for (uint16_t i : indices16.subspan(entry.index_start, entry.index_count)) mesh_indices.back().emplace_back(i);
+				}
+			}
+		} else {
+			struct IndexEntry0 {
+				uint32_t name_begin, name_end;
+				uint32_t vertex_start, vertex_count;
+			};
+			static_assert(sizeof(IndexEntry0) == 16, "Index entry should be packed");
+			for (IndexEntry0 const &entry : in.get< IndexEntry0 >("idx0")) {
+				meshes.emplace_back(IndexEntry{entry.name_begin, entry.name_end, entry.vertex_start, entry.vertex_count, 0, entry.vertex_count});
+				mesh_indices.emplace_back();
+				for (uint32_t i = 0; i < entry.vertex_count; ++i) mesh_indices.back().emplace_back(i);
+			}
+		}
+		if (!quantization.empty() && quantization.size() != meshes.size()) {
+			throw std::runtime_error("qnt0 chunk doesn't match index chunk");
+		}
+
+		//simplify each mesh, writing its indices then its LODs' indices:
+		std::vector< uint16_t > out_indices16;
+		std::vector< uint32_t > out_indices32;
+		std::vector< LodEntry > lods;
+		std::vector< BoundsEntry > bounds;
+		std::vector< ClusterEntry > clusters;
+		for (uint32_t m = 0; m < meshes.size(); ++m) {
+			IndexEntry &entry = meshes[m];
+			if (!(entry.vertex_start < entry.vertex_start + entry.vertex_count && entry.vertex_start + entry.vertex_count <= positions.size())) {
+				throw std::runtime_error("index entry has out-of-range vertex start/count");
+			}
+			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
+				throw std::runtime_error("index entry has out-of-range name begin/end");
+			}
+			std::string name(strings.begin() + entry.name_begin, strings.begin() + entry.name_end);
+
+			std::vector< glm::vec3 > mesh_positions(positions.begin() + entry.vertex_start, positions.begin() + entry.vertex_start + entry.vertex_count);
+			std::vector< glm::vec3 > mesh_normals(normals.begin() + entry.vertex_start, normals.begin() + entry.vertex_start + entry.vertex_count);
+			if (!quantization.empty()) { //measure error in object space:
+				for (glm::vec3 &p : mesh_positions) p = quantization[m].offset + quantization[m].scale * p;
+			}
+
+			bool wide = (entry.vertex_count > 0x10000);
+			auto append = [&](std::vector< uint32_t > const &indices) -> uint32_t {
+				uint32_t start;
+				if (wide) {
+					start = uint32_t(out_indices32.size());
+					out_indices32.insert(out_indices32.end(), indices.begin(), indices.end());
+				} else {
+					start = uint32_t(out_indices16.size());
+					for (uint32_t i : indices) out_indices16.emplace_back(uint16_t(i));
+				}
+				return start;
+			};
+
+			std::vector< uint32_t > &full = mesh_indices[m];
+			for (uint32_t i : full) {
+				if (i >= entry.vertex_count) throw std::runtime_error("index entry has indices past the end of its vertex range");
+			}
+			std::vector< MeshCluster > mesh_clustered;
+			if (cluster_size != 0 && full.size() / 3 > cluster_size) {
+				std::vector< uint32_t > reordered;
+				mesh_clusters(mesh_positions, full, cluster_size, &reordered, &mesh_clustered);
+				//cache-optimize within each cluster (numbering its vertices locally, so this costs the
+				// cluster's size rather than the mesh's) -- unless the order it grew in is already better --
+				// then draw clusters outward-facing first, if that costs little enough cache efficiency:
+				std::vector< uint32_t > starts;
+				std::vector< uint32_t > local(entry.vertex_count, -1U), global;
+				for (MeshCluster &cluster : mesh_clustered) {
+					uint32_t *begin = &reordered[cluster.index_start], *end = begin + cluster.index_count;
+					std::vector< uint32_t > range;
+					global.clear();
+					for (uint32_t *i = begin; i != end; ++i) {
+						if (local[*i] == -1U) {
+							local[*i] = uint32_t(global.size());
+							global.emplace_back(*i);
+						}
+						range.emplace_back(local[*i]);
+					}
+					std::vector< uint32_t > optimized = optimize_vertex_cache(range, uint32_t(global.size()));
+					if (mesh_acmr(optimized, uint32_t(global.size())) < mesh_acmr(range, uint32_t(global.size()))) {
+						for (uint32_t k = 0; k < optimized.size(); ++k) begin[k] = global[optimized[k]];
+					}
+					for (uint32_t v : global) local[v] = -1U;
+					starts.emplace_back(cluster.index_start / 3);
+				}
+				starts.emplace_back(uint32_t(reordered.size() / 3));
+				full.clear();
+				std::vector< MeshCluster > ordered;
+				for (uint32_t c : patch_order(reordered, mesh_positions, starts)) {
+					ordered.emplace_back(mesh_clustered[c]);
+					ordered.back().index_start = uint32_t(full.size());
+					full.insert(full.end(), reordered.begin() + mesh_clustered[c].index_start, reordered.begin() + mesh_clustered[c].index_start + mesh_clustered[c].index_count);
+				}
+				if (mesh_acmr(full, entry.vertex_count) <= OverdrawThreshold * mesh_acmr(reordered, entry.vertex_count)) {
+					mesh_clustered.swap(ordered);
+				} else {
+					full.swap(reordered);
+				}
+			}
+
+			bounds.emplace_back(mesh_bounds(mesh_positions, full));
+			bounds.back().vertex_start = entry.vertex_start;
+			bounds.back().vertex_count = entry.vertex_count;
+			float mesh_max_error = max_error * glm::length(bounds.back().max - bounds.back().min);
+
+			//each level simplifies the previous one, so errors accumulate (a bound on distance from the full mesh):
+			std::vector< std::vector< uint32_t > > levels_indices;
+			levels_indices.reserve(levels); //(so 'previous' stays valid)
+			std::vector< float > levels_error;
+			std::vector< uint32_t > const *previous = &full;
+			float error = 0.0f;
+			for (uint32_t level = 1; level <= levels; ++level) {
+				uint32_t target = uint32_t(previous->size() / 3 * ratio);
+				if (target < 4) break;
+				std::vector< uint32_t > simplified;
+				error += mesh_simplify(mesh_positions, mesh_normals, *previous, target, mesh_max_error - error, &simplified);
+				//stop once simplification stalls (too much error, or everything left is locked boundary):
+				if (simplified.size() > previous->size() * 9 / 10) break;
+				levels_indices.emplace_back(optimize_overdraw(optimize_vertex_cache(simplified, entry.vertex_count), mesh_positions));
+				levels_error.emplace_back(error);
+				previous = &levels_indices.back();
+			}
+
+			//renumber vertices in order of first use (by the full mesh, then its levels), moving their data to match:
+			std::vector< uint32_t > order = optimize_vertex_fetch(&full, entry.vertex_count);
+			{
+				std::vector< uint32_t > remap(entry.vertex_count);
+				for (uint32_t v = 0; v < entry.vertex_count; ++v) remap[order[v]] = v;
+				for (auto &level : levels_indices) {
+					for (uint32_t &i : level) i = remap[i];
+				}
+				std::vector< glm::vec3 > ordered_positions(entry.vertex_count);
+				char const *from = in_vertices.begin() + stride * entry.vertex_start;
+				char *to = &out_vertices[stride * entry.vertex_start];
+				for (uint32_t v = 0; v < entry.vertex_count; ++v) {
+					std::copy(from + stride * order[v], from + stride * (order[v] + 1), to + stride * v);
+					ordered_positions[v] = mesh_positions[order[v]];
+				}
+				mesh_positions.swap(ordered_positions);
+			}
+
+			entry.index_start = append(full);
+			entry.index_count = uint32_t(full.size());
+			for (MeshCluster const &cluster : mesh_clustered) {
+				clusters.emplace_back(ClusterEntry{m, entry.index_start + cluster.index_start, cluster.index_count, cluster.center, cluster.radius, cluster.cone_axis, cluster.cone_cutoff});
+			}
+
+			std::cout << "'" << name << "': " << full.size() / 3;
+			if (!mesh_clustered.empty()) std::cout << " (" << mesh_clustered.size() << " clusters)";
+			std::cout << " [ACMR " << mesh_acmr(full, entry.vertex_count) << ", ATVR " << mesh_atvr(full, entry.vertex_count) << ", overdraw " << mesh_overdraw(full, mesh_positions) << "]";
+			for (uint32_t l = 0; l < levels_indices.size(); ++l) {
+				lods.emplace_back(LodEntry{m, append(levels_indices[l]), uint32_t(levels_indices[l].size()), levels_error[l]});
+				std::cout << " -> " << levels_indices[l].size() / 3 << " (error " << levels_error[l] << "; ACMR " << mesh_acmr(levels_indices[l], entry.vertex_count) << ")";
+			}
+			std::cout << " triangles." << std::endl;
+		}
+
+		//copy other chunks, then add the new index chunks:
+		std::vector< BlobChunk > chunks;
+		bool compress = false; //compress the output if the input was compressed
+		for (ChunkFile::Entry const &entry : in.directory) {
+			std::string const &magic = entry.magic;
+			if (entry.flags & ChunkFlagCompressed) compress = true;
+			if (magic == "toc0" || magic == "idx0" || magic == "idx1" || magic == "ix16" || magic == "ix32" || magic == "lod0" || magic == "bnd0" || magic == "cls0") continue;
+			if (magic == format) {
+				chunks.emplace_back(magic, out_vertices);
+				continue;
+			}
+			ChunkSpan< char > payload = in.get< char >(magic);
+			chunks.emplace_back(magic, payload.begin(), payload.size());
+		}
+		if (!out_indices16.empty()) chunks.emplace_back("ix16", out_indices16);
+		if (!out_indices32.empty()) chunks.emplace_back("ix32", out_indices32);
+		chunks.emplace_back("idx1", meshes);
+		chunks.emplace_back("lod0", lods);
+		chunks.emplace_back("bnd0", bounds);
+		if (!clusters.empty()) chunks.emplace_back("cls0", clusters);
+
+		std::ofstream out(out_filename, std::ios::binary);
+		write_blob(out, chunks, (compress ? 4096 : 0));
+		if (!out) {
+			throw std::runtime_error("Failed to write '" + out_filename + "'");
+		}
+	} catch (std::exception &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,289 @@
+#include "mesh_optimize.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cassert>
+
+//side of the (per-axis) images used to measure overdraw:
+static constexpr uint32_t OverdrawResolution = 256;
+
+//average cache miss ratio (vertex shader runs per triangle) of an index list with a FIFO cache:
+float mesh_acmr(std::vector< uint32_t > const &indices, uint32_t vertex_count) {
+	if (indices.empty()) return 0.0f;
+	std::vector< uint32_t > entered(vertex_count, 0); //miss count when the vertex last entered the cache (+1)
+	uint32_t misses = 0;
+	for (uint32_t i : indices) {
+		//(vertex is in the FIFO if fewer than VertexCacheSize misses happened since it entered)
+		if (entered[i] != 0 && misses + 1 - entered[i] <= VertexCacheSize) continue;
+		misses += 1;
+		entered[i] = misses;
+	}
+	return misses / (indices.size() / 3.0f);
+}
+
+//average transform to vertex ratio (vertex shader runs per unique vertex; 1.0 is ideal):
+float mesh_atvr(std::vector< uint32_t > const &indices, uint32_t vertex_count) {
+	if (vertex_count == 0) return 0.0f;
+	return mesh_acmr(indices, vertex_count) * (indices.size() / 3.0f) / vertex_count;
+}
+
+//average overdraw (fragments shaded per pixel covered) of drawing the triangles in order,
+// depth-tested and back-face culled, looking along each axis from both sides:
+float mesh_overdraw(std::vector< uint32_t > const &indices, std::vector< glm::vec3 > const &positions) {
+	if (indices.empty()) return 0.0f;
+	glm::vec3 lo = positions[indices[0]], hi = lo;
+	for (uint32_t i : indices) {
+		lo = glm::min(lo, positions[i]);
+		hi = glm::max(hi, positions[i]);
+	}
+	glm::vec3 extent = hi - lo;
+	float size = std::max(extent.x, std::max(extent.y, extent.z));
+	if (!(size > 0.0f)) return 0.0f;
+	float to_pixels = (OverdrawResolution - 1) / size;
+
+	uint64_t shaded = 0, covered = 0;
+	std::vector< float > depth(OverdrawResolution * OverdrawResolution);
+	for (uint32_t axis = 0; axis < 3; ++axis) {
+		uint32_t u = (axis + 1) % 3, v = (axis + 2) % 3; //(u, v, axis) is right-handed
+		for (float facing : {1.0f, -1.0f}) {
+			std::fill(depth.begin(), depth.end(), std::numeric_limits< float >::infinity());
+			for (uint32_t t = 0; t + 2 < indices.size(); t += 3) {
+				//screen position (x, y) and depth of each corner; mirrored in x when looking from the other side:
+				float x[3], y[3], z[3];
+				for (uint32_t k = 0; k < 3; ++k) {
+					glm::vec3 const &p = positions[indices[t + k]];
+					x[k] = facing * (p[u] - lo[u]) * to_pixels;
+					if (facing < 0.0f) x[k] += OverdrawResolution - 1;
+					y[k] = (p[v] - lo[v]) * to_pixels;
+					z[k] = -facing * (p[axis] - lo[axis]);
+				}
+				float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+				if (!(area > 0.0f)) continue; //back-facing or degenerate
+				int32_t x0 = std::max(0, int32_t(std::ceil(std::min(x[0], std::min(x[1], x[2])))));
+				int32_t x1 = std::min(int32_t(OverdrawResolution) - 1, int32_t(std::floor(std::max(x[0], std::max(x[1], x[2])))));
+				int32_t y0 = std::max(0, int32_t(std::ceil(std::min(y[0], std::min(y[1], y[2])))));
+				int32_t y1 = std::min(int32_t(OverdrawResolution) - 1, int32_t(std::floor(std::max(y[0], std::max(y[1], y[2])))));
+				for (int32_t py = y0; py <= y1; ++py) {
+					for (int32_t px = x0; px <= x1; ++px) {
+						//barycentric weights of the pixel:
+						float w0 = (x[1] - px) * (y[2] - py) - (x[2] - px) * (y[1] - py);
+						float w1 = (x[2] - px) * (y[0] - py) - (x[0] - px) * (y[2] - py);
+						float w2 = area - w0 - w1;
+						if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) continue;
+						float d = (w0 * z[0] + w1 * z[1] + w2 * z[2]) / area;
+						float &at = depth[py * OverdrawResolution + px];
+						if (d < at) {
+							if (at == std::numeric_limits< float >::infinity()) covered += 1;
+							at = d;
+							shaded += 1;
+						}
+					}
+				}
+			}
+		}
+	}
+	return (covered ? float(shaded) / float(covered) : 0.0f);
+}
+
+//sort patches by how far out they face (from the area-weighted center of all of them):
+std::vector< uint32_t > patch_order(std::vector< uint32_t > const &indices, std::vector< glm::vec3 > const &positions, std::vector< uint32_t > const &starts) {
+	assert(!starts.empty());
+	glm::vec3 center(0.0f);
+	float total_area = 0.0f;
+	std::vector< glm::vec3 > patch_center(starts.size() - 1), patch_normal(starts.size() - 1);
+	for (uint32_t p = 0; p + 1 < starts.size(); ++p) {
+		glm::vec3 normal_sum(0.0f), centroid_sum(0.0f);
+		float area_sum = 0.0f;
+		for (uint32_t t = starts[p]; t < starts[p + 1]; ++t) {
+			glm::vec3 const &a = positions[indices[3*t]], &b = positions[indices[3*t+1]], &c = positions[indices[3*t+2]];
+			glm::vec3 n = glm::cross(b - a, c - a);
+			float area = glm::length(n);
+			normal_sum += n;
+			centroid_sum += area * (a + b + c) / 3.0f;
+			area_sum += area;
+		}
+		patch_center[p] = (area_sum > 0.0f ? centroid_sum / area_sum : positions[indices[3*starts[p]]]);
+		float length = glm::length(normal_sum);
+		patch_normal[p] = (length > 0.0f ? normal_sum / length : glm::vec3(0.0f));
+		center += centroid_sum;
+		total_area += area_sum;
+	}
+	if (total_area > 0.0f) center /= total_area;
+	std::vector< float > outward(starts.size() - 1);
+	std::vector< uint32_t > order(starts.size() - 1);
+	for (uint32_t p = 0; p < order.size(); ++p) {
+		outward[p] = glm::dot(patch_center[p] - center, patch_normal[p]);
+		order[p] = p;
+	}
+	std::stable_sort(order.begin(), order.end(), [&outward](uint32_t a, uint32_t b) { return outward[a] > outward[b]; });
+	return order;
+}
+
+//reorder patches of (cache-ordered) triangles so outward-facing ones draw first, reducing overdraw
+// (Sander, Nehab, and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw", 2007):
+// patches end wherever the cache would have started over (all three vertices miss) -- or sooner, once
+// a patch drawn on its own (from an empty cache) is within 'threshold' of the mesh's ACMR.
+std::vector< uint32_t > optimize_overdraw(std::vector< uint32_t > const &indices, std::vector< glm::vec3 > const &positions, float threshold) {
+	uint32_t triangle_count = uint32_t(indices.size() / 3);
+	if (triangle_count == 0) return indices;
+	float limit = threshold * mesh_acmr(indices, uint32_t(positions.size()));
+
+	//split into patches:
+	std::vector< uint32_t > starts;
+	std::vector< uint32_t > entered(positions.size(), 0); //(as in mesh_acmr)
+	uint32_t misses = 0;
+	uint32_t patch_start = 0, patch_misses = 0;
+	for (uint32_t t = 0; t < triangle_count; ++t) {
+		uint32_t triangle_misses = 0;
+		for (uint32_t k = 0; k < 3; ++k) {
+			uint32_t i = indices[3*t+k];
+			if (entered[i] != 0 && misses + 1 - entered[i] <= VertexCacheSize) continue;
+			misses += 1;
+			entered[i] = misses;
+			triangle_misses += 1;
+		}
+		if (t != patch_start && triangle_misses == 3) {
+			starts.emplace_back(patch_start);
+			patch_start = t;
+			patch_misses = 0;
+		}
+		patch_misses += triangle_misses;
+		if (patch_misses <= limit * (t + 1 - patch_start)) {
+			starts.emplace_back(patch_start);
+			patch_start = t + 1;
+			patch_misses = 0;
+			//(the next patch may be drawn anywhere, so it starts with an empty cache)
+			misses += VertexCacheSize;
+		}
+	}
+	if (patch_start < triangle_count) starts.emplace_back(patch_start);
+	starts.emplace_back(triangle_count);
+
+	std::vector< uint32_t > order = patch_order(indices, positions, starts);
+
+	std::vector< uint32_t > out;
+	out.reserve(indices.size());
+	for (uint32_t p : order) {
+		out.insert(out.end(), indices.begin() + 3 * starts[p], indices.begin() + 3 * starts[p + 1]);
+	}
+	return out;
+}
+
+//renumber vertices in order of first use (so vertex fetches walk forward through memory):
+// returns the old index of each new vertex.
+std::vector< uint32_t > optimize_vertex_fetch(std::vector< uint32_t > *indices_, uint32_t vertex_count) {
+	assert(indices_);
+	auto &indices = *indices_;
+	std::vector< uint32_t > remap(vertex_count, -1U), order;
+	order.reserve(vertex_count);
+	for (uint32_t &i : indices) {
+		if (remap[i] == -1U) {
+			remap[i] = uint32_t(order.size());
+			order.emplace_back(i);
+		}
+		i = remap[i];
+	}
+	//(vertices no triangle uses go last)
+	for (uint32_t v = 0; v < vertex_count; ++v) {
+		if (remap[v] == -1U) order.emplace_back(v);
+	}
+	return order;
+}
+
+//reorder triangles for post-transform cache locality
+// (Tom Forsyth, "Linear-Speed Vertex Cache Optimisation", 2006; same scoring as export-meshes.py):
+std::vector< uint32_t > optimize_vertex_cache(std::vector< uint32_t > const &indices, uint32_t vertex_count) {
+	uint32_t triangle_count = uint32_t(indices.size() / 3);
+
+	//triangles using each vertex (compressed rows; 'remaining' counts un-emitted ones, kept at the front):
+	std::vector< uint32_t > first(vertex_count + 1, 0);
+	for (uint32_t i : indices) first[i + 1] += 1;
+	for (uint32_t v = 0; v < vertex_count; ++v) first[v + 1] += first[v];
+	std::vector< uint32_t > vertex_triangles(indices.size());
+	std::vector< uint32_t > remaining(vertex_count, 0);
+	for (uint32_t t = 0; t < triangle_count; ++t) {
+		for (uint32_t k = 0; k < 3; ++k) {
+			uint32_t v = indices[3*t+k];
+			vertex_triangles[first[v] + remaining[v]++] = t;
+		}
+	}
+
+	std::vector< int32_t > cache_position(vertex_count, -1);
+	auto vertex_score = [&](uint32_t v) {
+		if (remaining[v] == 0) return -1.0f;
+		float score = 0.0f;
+		int32_t p = cache_position[v];
+		if (p >= 0) {
+			if (p < 3) score = 0.75f; //just used; don't favor it too much
+			else score = std::pow(1.0f - (p - 3) / float(VertexCacheSize - 3), 1.5f);
+		}
+		return score + 2.0f / std::sqrt(float(remaining[v])); //favor finishing off vertices
+	};
+	std::vector< float > vertex_scores(vertex_count);
+	for (uint32_t v = 0; v < vertex_count; ++v) vertex_scores[v] = vertex_score(v);
+	auto triangle_score = [&](uint32_t t) {
+		return vertex_scores[indices[3*t]] + vertex_scores[indices[3*t+1]] + vertex_scores[indices[3*t+2]];
+	};
+
+	std::vector< bool > emitted(triangle_count, false);
+	std::vector< uint32_t > cache, next_cache;
+	std::vector< uint32_t > out;
+	out.reserve(indices.size());
+	uint32_t scan = 0; //everything before 'scan' has been emitted
+	int64_t best = -1;
+	float best_score = -1.0f;
+	for (uint32_t t = 0; t < triangle_count; ++t) {
+		float score = triangle_score(t);
+		if (score > best_score) {
+			best = t;
+			best_score = score;
+		}
+	}
+	while (best != -1) {
+		uint32_t const *triangle = &indices[3*best];
+		out.insert(out.end(), triangle, triangle + 3);
+		emitted[best] = true;
+		for (uint32_t k = 0; k < 3; ++k) {
+			uint32_t v = triangle[k];
+			uint32_t *row = &vertex_triangles[first[v]];
+			uint32_t *at = std::find(row, row + remaining[v], uint32_t(best));
+			std::swap(*at, row[remaining[v] - 1]);
+			remaining[v] -= 1;
+		}
+
+		//move the triangle's vertices to the front of the (modeled) cache:
+		next_cache.assign(triangle, triangle + 3);
+		for (uint32_t v : cache) {
+			if (v != triangle[0] && v != triangle[1] && v != triangle[2]) next_cache.emplace_back(v);
+		}
+		cache.swap(next_cache);
+		for (uint32_t p = 0; p < cache.size(); ++p) {
+			cache_position[cache[p]] = (p < VertexCacheSize ? int32_t(p) : -1);
+		}
+		for (uint32_t v : cache) {
+			vertex_scores[v] = vertex_score(v);
+		}
+
+		//pick the best triangle using a cached vertex (including ones just pushed out):
+		best = -1;
+		best_score = -1.0f;
+		for (uint32_t v : cache) {
+			for (uint32_t i = first[v]; i < first[v] + remaining[v]; ++i) {
+				float score = triangle_score(vertex_triangles[i]);
+				if (score > best_score) {
+					best = vertex_triangles[i];
+					best_score = score;
+				}
+			}
+		}
+		if (cache.size() > VertexCacheSize) cache.resize(VertexCacheSize);
+		//...or, if none remain, the next un-emitted triangle:
+		if (best == -1) {
+			while (scan < triangle_count && emitted[scan]) ++scan;
+			if (scan < triangle_count) best = scan;
+		}
+	}
+	assert(out.size() == indices.size());
+	return out;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+
+/*
+ * Reorder indexed triangle lists for the GPU, and measure the results (used by mesh_bake,
+ * and by mesh_lod on each cluster and level of detail it makes):
+ *  - optimize_vertex_cache orders triangles so their vertices stay in the post-transform cache,
+ *  - optimize_overdraw then moves patches of (cache-ordered) triangles so outward-facing ones
+ *    draw first, giving up at most 'threshold' times the ACMR,
+ *  - optimize_vertex_fetch renumbers vertices in order of first use; the caller reorders
+ *    its vertex data to match.
+ * ACMR is vertex shader runs per triangle and ATVR per unique vertex (both with a FIFO cache
+ * of VertexCacheSize entries); overdraw is fragments shaded per pixel covered, looking
+ * along each axis from both sides.
+ */
+
+//post-transform vertex cache size assumed by the optimizer and the statistics (as in export-meshes.py):
+constexpr uint32_t VertexCacheSize = 32;
+//overdraw reordering may make ACMR this much worse:
+constexpr float OverdrawThreshold = 1.05f;
+
+float mesh_acmr(std::vector< uint32_t > const &indices, uint32_t vertex_count);
+float mesh_atvr(std::vector< uint32_t > const &indices, uint32_t vertex_count);
+float mesh_overdraw(std::vector< uint32_t > const &indices, std::vector< glm::vec3 > const &positions);
+
+std::vector< uint32_t > optimize_vertex_cache(std::vector< uint32_t > const &indices, uint32_t vertex_count);
+std::vector< uint32_t > optimize_overdraw(std::vector< uint32_t > const &indices, std::vector< glm::vec3 > const &positions, float threshold = OverdrawThreshold);
+//returns the old index of each new vertex:
+std::vector< uint32_t > optimize_vertex_fetch(std::vector< uint32_t > *indices, uint32_t vertex_count);
+
+//order in which to draw patches of triangles -- patch p is triangles [starts[p], starts[p+1]) --
+// so outward-facing ones come first (e.g., to order clusters for overdraw):
+std::vector< uint32_t > patch_order(std::vector< uint32_t > const &indices, std::vector< glm::vec3 > const &positions, std::vector< uint32_t > const &starts);
@@ -0,0 +1,273 @@
+#include "mesh_simplify.hpp"
+
+#include <algorithm>
+#include <queue>
+#include <map>
+#include <stdexcept>
+#include <cmath>
+#include <cassert>
+
+namespace {
+
+//sum of squared distances to a set of planes, as a symmetric 4x4 matrix (upper triangle):
+struct Quadric {
+	double q[10] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+	void add_plane(glm::vec3 const &n, double d) {
+		double a = n.x, b = n.y, c = n.z;
+		q[0] += a*a; q[1] += a*b; q[2] += a*c; q[3] += a*d;
+		q[4] += b*b; q[5] += b*c; q[6] += b*d;
+		q[7] += c*c; q[8] += c*d;
+		q[9] += d*d;
+	}
+	Quadric &operator+=(Quadric const &o) {
+		for (uint32_t i = 0; i < 10; ++i) q[i] += o.q[i];
+		return *this;
+	}
+	double error(glm::vec3 const &v) const {
+		double x = v.x, y = v.y, z = v.z;
+		double e = q[0]*x*x + 2.0*q[1]*x*y + 2.0*q[2]*x*z + 2.0*q[3]*x
+		         + q[4]*y*y + 2.0*q[5]*y*z + 2.0*q[6]*y
+		         + q[7]*z*z + 2.0*q[8]*z
+		         + q[9];
+		return std::max(0.0, e); //(rounding can make it slightly negative)
+	}
+};
+
+struct Triangle {
+	uint32_t corner[3]; //input vertex at each corner
+	uint32_t point[3]; //current (welded) position at each corner
+	bool removed = false;
+};
+
+struct Collapse {
+	double cost;
+	uint32_t from, to;
+	uint32_t from_version, to_version; //(stale if either point changed since)
+	bool operator<(Collapse const &o) const { return cost > o.cost; } //(min-heap)
+};
+
+}
+
+float mesh_simplify(
+	std::vector< glm::vec3 > const &positions,
+	std::vector< glm::vec3 > const &normals,
+	std::vector< uint32_t > const &indices,
+	uint32_t target_triangles,
+	float max_error,
+	std::vector< uint32_t > *simplified_) {
+
+	assert(simplified_);
+	auto &simplified = *simplified_;
+	if (normals.size() != positions.size()) {
+		throw std::runtime_error("mesh_simplify needs one normal per position.");
+	}
+	if (indices.size() % 3 != 0) {
+		throw std::runtime_error("mesh_simplify needs a triangle list.");
+	}
+	for (uint32_t i : indices) {
+		if (i >= positions.size()) throw std::runtime_error("mesh_simplify given out-of-range index.");
+	}
+
+	//weld vertices by position (so hard edges, which duplicate positions, can't crack open):
+	std::vector< uint32_t > point_of(positions.size());
+	std::vector< glm::vec3 > points;
+	std::vector< std::vector< uint32_t > > vertices_at;
+	{
+		std::vector< uint32_t > order(positions.size());
+		for (uint32_t i = 0; i < order.size(); ++i) order[i] = i;
+		auto less = [&](uint32_t a, uint32_t b) {
+			glm::vec3 const &pa = positions[a], &pb = positions[b];
+			if (pa.x != pb.x) return pa.x < pb.x;
+			if (pa.y != pb.y) return pa.y < pb.y;
+			return pa.z < pb.z;
+		};
+		std::sort(order.begin(), order.end(), less);
+		for (uint32_t i = 0; i < order.size(); ++i) {
+			if (i == 0 || less(order[i-1], order[i])) {
+				points.emplace_back(positions[order[i]]);
+				vertices_at.emplace_back();
+			}
+			point_of[order[i]] = uint32_t(points.size() - 1);
+			vertices_at.back().emplace_back(order[i]);
+		}
+	}
+
+	//triangles (zero-area ones are dropped), per-point quadrics, and triangles around each point:
+	std::vector< Triangle > triangles;
+	std::vector< Quadric > quadrics(points.size());
+	std::vector< std::vector< uint32_t > > triangles_at(points.size());
+	for (uint32_t i = 0; i + 2 < indices.size(); i += 3) {
+		Triangle t;
+		for (uint32_t k = 0; k < 3; ++k) {
+			t.corner[k] = indices[i+k];
+			t.point[k] = point_of[indices[i+k]];
+		}
+		glm::vec3 n = glm::cross(points[t.point[1]] - points[t.point[0]], points[t.point[2]] - points[t.point[0]]);
+		float len = glm::length(n);
+		if (!(len > 0.0f)) continue;
+		n /= len;
+		for (uint32_t k = 0; k < 3; ++k) {
+			quadrics[t.point[k]].add_plane(n, -double(glm::dot(n, points[t.point[0]])));
+			triangles_at[t.point[k]].emplace_back(uint32_t(triangles.size()));
+		}
+		triangles.emplace_back(t);
+	}
+	uint32_t live = uint32_t(triangles.size());
+
+	//points on open edges (edges with only one triangle) stay put, so outlines don't erode:
+	std::vector< bool > locked(points.size(), false);
+	{
+		std::map< std::pair< uint32_t, uint32_t >, uint32_t > edge_uses;
+		for (Triangle const &t : triangles) {
+			for (uint32_t k = 0; k < 3; ++k) {
+				uint32_t a = t.point[k], b = t.point[(k+1)%3];
+				edge_uses[std::make_pair(std::min(a,b), std::max(a,b))] += 1;
+			}
+		}
+		for (auto const &edge : edge_uses) {
+			if (edge.second != 2) {
+				locked[edge.first.first] = true;
+				locked[edge.first.second] = true;
+			}
+		}
+	}
+
+	std::vector< uint32_t > version(points.size(), 0);
+	std::vector< bool > gone(points.size(), false);
+	std::priority_queue< Collapse > queue;
+
+	auto push = [&](uint32_t from, uint32_t to) {
+		if (locked[from]) return;
+		Quadric q = quadrics[from];
+		q += quadrics[to];
+		queue.push(Collapse{q.error(points[to]), from, to, version[from], version[to]});
+	};
+	auto push_edges_of = [&](uint32_t p) {
+		for (uint32_t ti : triangles_at[p]) {
+			Triangle const &t = triangles[ti];
+			if (t.removed) continue;
+			for (uint32_t k = 0; k < 3; ++k) {
+				if (t.point[k] == p) continue;
+				push(p, t.point[k]);
+				push(t.point[k], p);
+			}
+		}
+	};
+	for (Triangle const &t : triangles) {
+		for (uint32_t k = 0; k < 3; ++k) {
+			push(t.point[k], t.point[(k+1)%3]);
+			push(t.point[(k+1)%3], t.point[k]);
+		}
+	}
+
+	//points sharing a live triangle with p:
+	auto neighbours = [&](uint32_t p) {
+		std::vector< uint32_t > ret;
+		for (uint32_t ti : triangles_at[p]) {
+			Triangle const &t = triangles[ti];
+			if (t.removed) continue;
+			for (uint32_t k = 0; k < 3; ++k) {
+				if (t.point[k] != p) ret.emplace_back(t.point[k]);
+			}
+		}
+		std::sort(ret.begin(), ret.end());
+		ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+		return ret;
+	};
+
+	double max_cost = double(max_error) * double(max_error);
+	double worst = 0.0;
+	while (live > target_triangles && !queue.empty()) {
+		Collapse c = queue.top();
+		queue.pop();
+		if (gone[c.from] || gone[c.to]) continue;
+		if (version[c.from] != c.from_version || version[c.to] != c.to_version) continue;
+		if (c.cost > max_cost) break;
+
+		//triangles on the edge (removed by the collapse) and the rest of the fan around 'from' (moved by it):
+		uint32_t shared = 0;
+		bool flips = false;
+		for (uint32_t ti : triangles_at[c.from]) {
+			Triangle const &t = triangles[ti];
+			if (t.removed) continue;
+			if (t.point[0] == c.to || t.point[1] == c.to || t.point[2] == c.to) {
+				++shared;
+				continue;
+			}
+			glm::vec3 before[3], after[3];
+			for (uint32_t k = 0; k < 3; ++k) {
+				before[k] = points[t.point[k]];
+				after[k] = (t.point[k] == c.from ? points[c.to] : before[k]);
+			}
+			glm::vec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+			glm::vec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+			float l0 = glm::length(n0), l1 = glm::length(n1);
+			//reject collapses that fold triangles over (or make slivers of them):
+			if (!(l1 > 0.0f) || glm::dot(n0, n1) < 0.2f * l0 * l1) {
+				flips = true;
+				break;
+			}
+		}
+		if (shared == 0 || flips) continue; //(no longer an edge, or would damage the surface)
+
+		//link condition: the only points adjacent to both ends are the edge triangles' third corners
+		// (otherwise the collapse pinches the surface into a non-manifold):
+		{
+			std::vector< uint32_t > a = neighbours(c.from), b = neighbours(c.to), both;
+			std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(both));
+			if (both.size() != shared) continue;
+		}
+
+		//collapse:
+		for (uint32_t ti : triangles_at[c.from]) {
+			Triangle &t = triangles[ti];
+			if (t.removed) continue;
+			if (t.point[0] == c.to || t.point[1] == c.to || t.point[2] == c.to) {
+				t.removed = true;
+				--live;
+				continue;
+			}
+			for (uint32_t k = 0; k < 3; ++k) {
+				if (t.point[k] == c.from) t.point[k] = c.to;
+			}
+			triangles_at[c.to].emplace_back(ti);
+		}
+		triangles_at[c.from].clear();
+		quadrics[c.to] += quadrics[c.from];
+		gone[c.from] = true;
+		version[c.to] += 1;
+		worst = std::max(worst, c.cost);
+
+		//the collapse changed the cost of every edge around 'to':
+		push_edges_of(c.to);
+
+		//(occasionally drop removed triangles from fan lists so they don't grow without bound)
+		std::vector< uint32_t > &fan = triangles_at[c.to];
+		if (fan.size() > 64) {
+			fan.erase(std::remove_if(fan.begin(), fan.end(), [&](uint32_t ti) { return triangles[ti].removed; }), fan.end());
+		}
+	}
+
+	//each corner uses the vertex at its point whose normal is closest to the corner's original normal:
+	simplified.clear();
+	simplified.reserve(3 * live);
+	for (Triangle const &t : triangles) {
+		if (t.removed) continue;
+		for (uint32_t k = 0; k < 3; ++k) {
+			uint32_t best = t.corner[k];
+			if (point_of[best] != t.point[k]) {
+				float best_dot = -2.0f;
+				for (uint32_t v : vertices_at[t.point[k]]) {
+					float d = glm::dot(normals[v], normals[t.corner[k]]);
+					if (d > best_dot) {
+						best_dot = d;
+						best = v;
+					}
+				}
+			}
+			simplified.emplace_back(best);
+		}
+	}
+
+	return float(std::sqrt(worst));
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+
+/*
+ * Simplify an indexed triangle list by quadric-error edge collapse (Garland & Heckbert '97).
+ *
+ * Collapses move a vertex onto one of its neighbours rather than to a new position,
+ * so the result indexes the same vertex array (a LOD can share its mesh's vertex buffer):
+ *  - vertices at the same position are moved together; each corner of the result uses
+ *    the vertex at its (new) position whose normal best matches the corner's old normal,
+ *    so hard edges keep plausible normals,
+ *  - vertices on open boundaries are never moved.
+ * Stops once at most 'target_triangles' remain, or when the next collapse would move
+ * the surface by more than 'max_error' (roughly: distance from the input's faces).
+ * Returns the largest such error of any collapse made.
+ */
+
+float mesh_simplify(
+	std::vector< glm::vec3 > const &positions,
+	std::vector< glm::vec3 > const &normals,
+	std::vector< uint32_t > const &indices,
+	uint32_t target_triangles,
+	float max_error,
+	std::vector< uint32_t > *simplified);
@@ -7,10 +7,209 @@
 
 #reads 'island.blend' and writes '../dist/meshes.blob' (meshes) and '../dist/scene.blob' (scene in layer 1)
 
+#With '--raw' (i.e., blender --background --python export-meshes.py -- --raw), writes every
+# triangle corner of every mesh to '../dist/meshes.raw' as an unindexed 'v3n3'/'str0'/'idx0'
+# blob instead, skipping encoding and cache optimization; then run
+#   mesh_bake ../dist/meshes.raw ../dist/meshes.blob
+# which does the rest (multithreaded, and much faster on high-poly meshes).
+
 import sys
+import array
 
 import bpy
 import struct
+import collections
+import math
+
+#chunk payloads are zero-padded to a multiple of this so that every payload in the blob
+# starts aligned, and ChunkFile (ChunkFile.hpp) can hand out spans without copying.
+# (trailing padding is harmless: all data is addressed through index ranges)
+CHUNK_ALIGN = 4
+
+def write_chunk(blob, magic, payload):
+	payload += b'\0' * (-len(payload) % CHUNK_ALIGN)
+	blob.write(struct.pack('4s', magic)) #type
+	blob.write(struct.pack('I', len(payload))) #length
+	blob.write(payload)
+
+#write a list of (magic, payload) chunks, preceded by a 'toc0' table of contents
+# giving (magic, header offset, payload size, flags) for each, so loaders can
+# fetch chunks in any order and skip ones they don't know:
+def write_blob(blob, chunks):
+	chunks = [ (magic, payload + b'\0' * (-len(payload) % CHUNK_ALIGN)) for (magic, payload) in chunks ]
+	toc = b''
+	offset = 8 + 16 * len(chunks)
+	for (magic, payload) in chunks:
+		toc += struct.pack('4sIII', magic, offset, len(payload), 0)
+		offset += 8 + len(payload)
+	write_chunk(blob, b'toc0', toc)
+	for (magic, payload) in chunks:
+		write_chunk(blob, magic, payload)
+
+#merge identical (packed) vertices; returns unique vertices and an index list:
+def deduplicate(vertices):
+	index_of = dict()
+	unique = []
+	indices = []
+	for v in vertices:
+		i = index_of.get(v)
+		if i == None:
+			i = len(unique)
+			index_of[v] = i
+			unique.append(v)
+		indices.append(i)
+	return (unique, indices)
+
+#post-transform vertex cache size assumed by the optimizer and the ACMR reports:
+CACHE_SIZE = 32
+
+#average cache miss ratio (vertex shader runs per triangle) of an index list with a FIFO cache:
+def acmr(indices):
+	if len(indices) == 0: return 0.0
+	fifo = collections.deque()
+	in_fifo = set()
+	misses = 0
+	for i in indices:
+		if i in in_fifo: continue
+		misses += 1
+		fifo.append(i)
+		in_fifo.add(i)
+		if len(fifo) > CACHE_SIZE:
+			in_fifo.discard(fifo.popleft())
+	return misses / (len(indices) / 3)
+
+#reorder triangles for post-transform cache locality
+# (Tom Forsyth, "Linear-Speed Vertex Cache Optimisation", 2006):
+def optimize_vertex_cache(indices, vertex_count):
+	triangle_count = len(indices) // 3
+	vertex_triangles = [ [] for v in range(0, vertex_count) ]
+	for t in range(0, triangle_count):
+		for v in indices[3*t:3*t+3]:
+			vertex_triangles[v].append(t)
+	cache_position = [-1] * vertex_count
+
+	def vertex_score(v):
+		remaining = len(vertex_triangles[v])
+		if remaining == 0: return -1.0
+		score = 0.0
+		p = cache_position[v]
+		if p >= 0:
+			if p < 3: score = 0.75 #just used; don't favor it too much
+			else: score = (1.0 - (p - 3) / (CACHE_SIZE - 3)) ** 1.5
+		return score + 2.0 * remaining ** -0.5 #favor finishing off vertices
+
+	vertex_scores = [ vertex_score(v) for v in range(0, vertex_count) ]
+	def triangle_score(t):
+		return sum(vertex_scores[v] for v in indices[3*t:3*t+3])
+
+	emitted = [False] * triangle_count
+	cache = []
+	out = []
+	scan = 0 #everything before 'scan' has been emitted
+	best = -1
+	if triangle_count > 0:
+		best = max(range(0, triangle_count), key=triangle_score)
+	while best != -1:
+		triangle = indices[3*best:3*best+3]
+		out += triangle
+		emitted[best] = True
+		for v in triangle:
+			vertex_triangles[v].remove(best)
+
+		#move the triangle's vertices to the front of the (modeled) cache:
+		cache = triangle + [ v for v in cache if not v in triangle ]
+		for p in range(0, len(cache)):
+			cache_position[cache[p]] = p if p < CACHE_SIZE else -1
+		for v in cache:
+			vertex_scores[v] = vertex_score(v)
+		touched = cache
+		cache = cache[0:CACHE_SIZE]
+
+		#pick the best triangle using a cached vertex:
+		best = -1
+		best_score = -1.0
+		for v in touched:
+			for t in vertex_triangles[v]:
+				score = triangle_score(t)
+				if score > best_score:
+					best = t
+					best_score = score
+		#...or, if none remain, the next un-emitted triangle:
+		if best == -1:
+			while scan < triangle_count and emitted[scan]: scan += 1
+			if scan < triangle_count: best = scan
+	assert(len(out) == len(indices))
+	return out
+
+#vertex format to write (see Meshes.cpp):
+# 'v3n3' - float position, float normal (24 bytes)
+# 'v3nq' - float position, normal packed as GL_INT_2_10_10_10_REV (16 bytes)
+# 'p16n' - 16-bit normalized position relative to the mesh's bounds, packed normal (12 bytes)
+VERTEX_FORMAT = 'p16n'
+VERTEX_SIZE = { 'v3n3':24, 'v3nq':16, 'p16n':12 }[VERTEX_FORMAT]
+
+#pack a unit normal as a signed 2_10_10_10 integer (w = 0):
+def pack_normal(n):
+	def component(x):
+		return int(round(max(-1.0, min(1.0, x)) * 511.0)) & 0x3ff
+	return component(n[0]) | (component(n[1]) << 10) | (component(n[2]) << 20)
+
+def unpack_normal(packed):
+	def component(bits):
+		c = bits - 0x400 if bits & 0x200 else bits
+		return max(c / 511.0, -1.0)
+	return tuple(component((packed >> shift) & 0x3ff) for shift in (0, 10, 20))
+
+#encode (position, normal) pairs in VERTEX_FORMAT; returns encoded vertices,
+# the (offset, scale) that dequantizes positions, and the max position / normal error:
+def encode_vertices(vertices):
+	lo = tuple(min(v[0][c] for v in vertices) for c in range(0,3))
+	hi = tuple(max(v[0][c] for v in vertices) for c in range(0,3))
+	if VERTEX_FORMAT == 'p16n':
+		offset = lo
+		scale = tuple(hi[c] - lo[c] for c in range(0,3))
+	else:
+		offset = (0.0, 0.0, 0.0)
+		scale = (1.0, 1.0, 1.0)
+
+	encoded = []
+	position_error = 0.0
+	normal_error = 0.0
+	for (co, normal) in vertices:
+		if VERTEX_FORMAT == 'v3n3':
+			encoded.append(struct.pack('3f', *co) + struct.pack('3f', *normal))
+			continue
+		packed = pack_normal(normal)
+		decoded = unpack_normal(packed)
+		length = math.sqrt(sum(x * x for x in decoded)) * math.sqrt(sum(x * x for x in normal))
+		if length > 0.0:
+			cosine = sum(decoded[c] * normal[c] for c in range(0,3)) / length
+			normal_error = max(normal_error, math.degrees(math.acos(max(-1.0, min(1.0, cosine)))))
+		if VERTEX_FORMAT == 'v3nq':
+			encoded.append(struct.pack('3fI', co[0], co[1], co[2], packed))
+			continue
+		q = tuple(int(round((co[c] - offset[c]) / scale[c] * 65535.0)) if scale[c] > 0.0 else 0 for c in range(0,3))
+		for c in range(0,3):
+			position_error = max(position_error, abs(offset[c] + scale[c] * (q[c] / 65535.0) - co[c]))
+		encoded.append(struct.pack('4HI', q[0], q[1], q[2], 0, packed))
+	return (encoded, offset, scale, position_error, normal_error)
+
+#bounds and statistics of a mesh, given its (unindexed) (position, normal) triangle corners,
+# as a 'bnd0' entry (min, max, sphere center, radius, area, triangles, vertex start, vertex count):
+# ('slack' is added to the radius to cover quantization error)
+def mesh_bounds(vertices, vertex_start, vertex_count, slack):
+	lo = tuple(min(v[0][c] for v in vertices) for c in range(0,3))
+	hi = tuple(max(v[0][c] for v in vertices) for c in range(0,3))
+	center = tuple(0.5 * (lo[c] + hi[c]) for c in range(0,3))
+	radius = max(math.sqrt(sum((v[0][c] - center[c]) ** 2 for c in range(0,3))) for v in vertices) + slack
+	area = 0.0
+	for t in range(0, len(vertices) - 2, 3):
+		a, b, c = vertices[t][0], vertices[t+1][0], vertices[t+2][0]
+		e1 = tuple(b[i] - a[i] for i in range(0,3))
+		e2 = tuple(c[i] - a[i] for i in range(0,3))
+		cross = (e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0])
+		area += 0.5 * math.sqrt(sum(x * x for x in cross))
+	return struct.pack('3f3f3fffIII', *lo, *hi, *center, radius, area, len(vertices) // 3, vertex_start, vertex_count)
 
 bpy.ops.wm.open_mainfile(filepath='cube_volleyball.blend')
 
@@ -26,16 +225,35 @@ to_write = [
         'Sphere',
 ]
 
-#data contains vertex and normal data from the meshes:
-data = b''
+RAW = '--raw' in (sys.argv[sys.argv.index('--')+1:] if '--' in sys.argv else [])
+
+#(blobs are built in bytearrays, which append in place; appending to bytes copies the whole thing every time)
+
+#data contains (deduplicated) vertex and normal data from the meshes, in VERTEX_FORMAT:
+data = bytearray()
+
+#raw contains every triangle corner's position and normal (for --raw):
+raw = array.array('f')
+
+#quantization contains the position offset and scale for each mesh in the index:
+quantization = bytearray()
+
+#indices16 / indices32 contain triangle indices (relative to each mesh's first vertex);
+# meshes with at most 2^16 vertices use 16-bit indices:
+indices16 = []
+indices32 = []
 
 #strings contains the mesh names:
-strings = b''
+strings = bytearray()
+
+#index gives offsets into the data, indices (and names) for each mesh:
+index = bytearray()
 
-#index gives offsets into the data (and names) for each mesh:
-index = b''
+#bounds gives precomputed bounds and statistics for each mesh in the index:
+bounds = bytearray()
 
 vertex_count = 0
+expanded_count = 0
 for name in to_write:
 	print("Writing '" + name + "'...")
 	bpy.ops.object.mode_set(mode='OBJECT') #get out of edit mode (just in case)
@@ -61,7 +279,41 @@ for name in to_write:
 	mesh = obj.data
 	mesh.calc_normals_split()
 
-	#record mesh name, start position and vertex count in the index:
+	#gather the mesh's triangle vertices:
+	vertices = []
+	for poly in mesh.polygons:
+		assert(len(poly.loop_indices) == 3)
+		for i in range(0,3):
+			assert(mesh.loops[poly.loop_indices[i]].vertex_index == poly.vertices[i])
+			loop = mesh.loops[poly.loop_indices[i]]
+			vertices.append( (tuple(mesh.vertices[loop.vertex_index].co), tuple(loop.normal)) )
+
+	if RAW:
+		#record name and corner range; mesh_bake does the rest:
+		name_begin = len(strings)
+		strings += bytes(name, "utf8")
+		index += struct.pack('IIII', name_begin, len(strings), len(raw) // 6, len(vertices))
+		for (co, normal) in vertices:
+			raw.extend(co)
+			raw.extend(normal)
+		print("  " + str(len(vertices) // 3) + " triangles (raw)")
+		continue
+
+	#encode vertices and report the error introduced:
+	(encoded, offset, scale, position_error, normal_error) = encode_vertices(vertices)
+	quantization += struct.pack('3f', *offset) + struct.pack('3f', *scale)
+	diagonal = math.sqrt(sum(x * x for x in scale)) if VERTEX_FORMAT == 'p16n' else 0.0
+	print("  " + VERTEX_FORMAT + ": " + str(VERTEX_SIZE) + " bytes/vertex (v3n3: 24);"
+		+ " max position error %g (%.4f%% of bounds), max normal error %.3f degrees" % (position_error, 100.0 * position_error / diagonal if diagonal > 0.0 else 0.0, normal_error))
+
+	#merge shared vertices and reorder triangles for the post-transform cache:
+	(unique, indices) = deduplicate(encoded)
+	acmr_blender = acmr(indices)
+	indices = optimize_vertex_cache(indices, len(unique))
+	print("  " + str(len(indices) // 3) + " triangles, " + str(len(vertices)) + " -> " + str(len(unique)) + " vertices;"
+		+ " ACMR 3.00 unindexed, %.3f in blender order, %.3f optimized" % (acmr_blender, acmr(indices)))
+
+	#record mesh name, vertex range and index range in the index:
 	name_begin = len(strings)
 	strings += bytes(name, "utf8")
 	name_end = len(strings)
@@ -69,40 +321,50 @@ for name in to_write:
 	index += struct.pack('I', name_end)
 
 	index += struct.pack('I', vertex_count)
-	index += struct.pack('I', len(mesh.polygons) * 3)
+	index += struct.pack('I', len(unique))
+
+	if len(unique) <= 0x10000:
+		index += struct.pack('I', len(indices16))
+		indices16 += indices
+	else:
+		index += struct.pack('I', len(indices32))
+		indices32 += indices
+	index += struct.pack('I', len(indices))
+
+	bounds += mesh_bounds(vertices, vertex_count, len(unique), position_error * math.sqrt(3.0))
 
 	#write the mesh:
-	for poly in mesh.polygons:
-		assert(len(poly.loop_indices) == 3)
-		for i in range(0,3):
-			assert(mesh.loops[poly.loop_indices[i]].vertex_index == poly.vertices[i])
-			loop = mesh.loops[poly.loop_indices[i]]
-			vertex = mesh.vertices[loop.vertex_index]
-			for x in mesh.vertices[loop.vertex_index].co:
-				data += struct.pack('f', x)
-			for x in loop.normal:
-				data += struct.pack('f', x)
-	vertex_count += len(mesh.polygons) * 3
-
-#check that we wrote as much data as anticipated:
-assert(vertex_count * (3 * 4 + 3 * 4) == len(data))
-
-#write the data chunk and index chunk to an output blob:
-blob = open('../dist/meshes.blob', 'wb')
-#first chunk: the data
-blob.write(struct.pack('4s',b'v3n3')) #type
-blob.write(struct.pack('I', len(data))) #length
-blob.write(data)
-#second chunk: the strings
-blob.write(struct.pack('4s',b'str0')) #type
-blob.write(struct.pack('I', len(strings))) #length
-blob.write(strings)
-#third chunk: the index
-blob.write(struct.pack('4s',b'idx0')) #type
-blob.write(struct.pack('I', len(index))) #length
-blob.write(index)
-
-print("Wrote " + str(blob.tell()) + " bytes to meshes.blob")
+	data += b''.join(unique)
+	vertex_count += len(unique)
+	expanded_count += len(vertices)
+
+if RAW:
+	blob = open('../dist/meshes.raw', 'wb')
+	write_blob(blob, [
+		(b'v3n3', raw.tobytes()), #every triangle corner
+		(b'str0', bytes(strings)), #the strings
+		(b'idx0', bytes(index)), #the index (corner ranges)
+	])
+	print("Wrote " + str(blob.tell()) + " bytes to meshes.raw (run mesh_bake to make meshes.blob)")
+else:
+	#check that we wrote as much data as anticipated:
+	assert(vertex_count * VERTEX_SIZE == len(data))
+
+	#write the data chunk and index chunk to an output blob:
+	blob = open('../dist/meshes.blob', 'wb')
+	write_blob(blob, [
+		(bytes(VERTEX_FORMAT, 'utf8'), bytes(data)), #the data
+		(b'qnt0', bytes(quantization)), #the position dequantization
+		(b'ix16', array.array('H', indices16).tobytes()), #the 16-bit indices
+		(b'ix32', array.array('I', indices32).tobytes()), #the 32-bit indices
+		(b'str0', bytes(strings)), #the strings
+		(b'idx1', bytes(index)), #the index
+		(b'bnd0', bytes(bounds)), #the bounds
+	])
+
+	print("Wrote " + str(blob.tell()) + " bytes to meshes.blob"
+		+ " (unindexed v3n3 vertex data would have been " + str(expanded_count * (3 * 4 + 3 * 4)) + " bytes"
+		+ ", indexed vertex + index data is " + str(len(data) + 2 * len(indices16) + 4 * len(indices32)) + " bytes)")
 
 #---------------------------------------------------------------------
 #Export scene (object positions for every object on layer one)
@@ -111,7 +373,7 @@ print("Wrote " + str(blob.tell()) + " bytes to meshes.blob")
 bpy.ops.wm.open_mainfile(filepath='cube_volleyball.blend')
 
 #strings chunk will have names
-strings = b''
+strings = bytearray()
 #these map from the *mesh* name of our the written objects to the *object* name they are stored under:
 name_begin = dict()
 name_end = dict()
@@ -122,7 +384,7 @@ for name in to_write:
 	name_end[mesh_name] = len(strings)
 
 #scene chunk will have transforms + indices into strings for name
-scene = b''
+scene = bytearray()
 for obj in bpy.data.objects:
 	if obj.layers[0] == False: continue
 	if obj.data.name == 'Sphere': continue
@@ -140,14 +402,10 @@ for obj in bpy.data.objects:
 
 #write the strings chunk and scene chunk to an output blob:
 blob = open('../dist/scene.blob', 'wb')
-#first chunk: the strings
-blob.write(struct.pack('4s',b'str0')) #type
-blob.write(struct.pack('I', len(strings))) #length
-blob.write(strings)
-#second chunk: the scene
-blob.write(struct.pack('4s',b'scn0')) #type
-blob.write(struct.pack('I', len(scene))) #length
-blob.write(scene)
+write_blob(blob, [
+	(b'str0', bytes(strings)), #the strings
+	(b'scn0', bytes(scene)), #the scene
+])
 
 print("Wrote " + str(blob.tell()) + " bytes to scene.blob")
 
@@ -0,0 +1,89 @@
+#include "load_save_png.hpp"
+#include "ThreadPool.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+//"png_bench" measures save_png's presets on a corpus of frames (e.g., recorded or screenshot PNGs):
+//   png_bench [--repeat N] [--threads T] frame.png [frame2.png ...]
+// Each frame is encoded N times (default 3) with every preset -- by save_png, and by save_png_parallel
+// on T threads (default: one per hardware thread) -- and checked to decode unchanged.
+// Speed is in MB/s of raw RGBA pixels; ratio is raw size over encoded size.
+
+int main(int argc, char **argv) {
+	uint32_t repeat = 3;
+	uint32_t threads = 0;
+	std::vector< std::string > files;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--repeat" && i + 1 < argc) {
+			repeat = std::max(1, std::stoi(argv[++i]));
+		} else if (arg == "--threads" && i + 1 < argc) {
+			threads = std::max(1, std::stoi(argv[++i]));
+		} else {
+			files.emplace_back(arg);
+		}
+	}
+	if (files.empty()) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [--repeat N] [--threads T] frame.png [frame2.png ...]" << std::endl;
+		return 1;
+	}
+
+	struct Frame {
+		std::string filename;
+		unsigned int width = 0, height = 0;
+		std::vector< uint32_t > pixels;
+	};
+	std::vector< Frame > frames;
+	uint64_t raw_bytes = 0;
+	for (auto const &filename : files) {
+		frames.emplace_back();
+		Frame &frame = frames.back();
+		frame.filename = filename;
+		if (!load_png(filename, &frame.width, &frame.height, &frame.pixels, UpperLeftOrigin)) {
+			std::cerr << "ERROR: failed to load '" << filename << "'." << std::endl;
+			return 1;
+		}
+		raw_bytes += 4 * uint64_t(frame.pixels.size());
+	}
+	std::cout << frames.size() << " frames, " << raw_bytes / (1024.0 * 1024.0) << " MB of pixels, encoded " << repeat << " times each:" << std::endl;
+
+	ThreadPool pool(threads);
+	for (char const *name : {"default", "fastest", "balanced", "smallest"}) for (bool parallel : {false, true}) {
+		PngOptions options;
+		PngOptions::preset(name, &options);
+		uint64_t encoded_bytes = 0;
+		double seconds = 0.0;
+		for (Frame const &frame : frames) {
+			std::string encoded;
+			for (uint32_t r = 0; r < repeat; ++r) {
+				std::ostringstream out;
+				auto before = std::chrono::high_resolution_clock::now();
+				if (parallel) {
+					save_png_parallel(out, frame.width, frame.height, frame.pixels.data(), pool, UpperLeftOrigin, options);
+				} else {
+					save_png(out, frame.width, frame.height, frame.pixels.data(), UpperLeftOrigin, options);
+				}
+				seconds += std::chrono::duration< double >(std::chrono::high_resolution_clock::now() - before).count();
+				encoded = out.str();
+			}
+			encoded_bytes += encoded.size();
+
+			std::istringstream in(encoded);
+			unsigned int width = 0, height = 0;
+			std::vector< uint32_t > decoded;
+			if (!load_png(in, &width, &height, &decoded, UpperLeftOrigin) || width != frame.width || height != frame.height || decoded != frame.pixels) {
+				std::cerr << "ERROR: '" << frame.filename << "' didn't survive the '" << name << "' preset" << (parallel ? " (parallel)" : "") << "." << std::endl;
+				return 1;
+			}
+		}
+		std::cout << "  " << name << (parallel ? " (parallel, " + std::to_string(pool.size()) + " threads)" : std::string()) << ": " << (raw_bytes * double(repeat) / (1024.0 * 1024.0)) / seconds << " MB/s, ratio " << double(raw_bytes) / encoded_bytes
+			<< " (" << encoded_bytes << " bytes)" << std::endl;
+	}
+
+	return 0;
+}
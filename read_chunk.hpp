@@ -1,21 +1,17 @@
 #pragma once
 
+#include "chunk_zlib.hpp"
+
 #include <iostream>
 #include <vector>
+#include <string>
 #include <stdexcept>
+#include <limits>
 #include <cassert>
 
-template< typename T >
-void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *_to) {
-	assert(_to);
-	auto &to = *_to;
-
-	struct ChunkHeader {
-		char magic[4] = {'\0', '\0', '\0', '\0'};
-		uint32_t size = 0;
-	};
-	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
-
+//read a chunk header (and extension, if any), which must have the indicated magic number:
+// note: will throw if the header is missing, malformed, or has the wrong magic number.
+inline ChunkInfo read_chunk_header(std::istream &from, std::string const &magic) {
 	ChunkHeader header;
 	if (!from.read(reinterpret_cast< char * >(&header), sizeof(header))) {
 		throw std::runtime_error("Failed to read chunk header");
@@ -23,12 +19,45 @@ void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *
 	if (std::string(header.magic,4) != magic) {
 		throw std::runtime_error("Unexpected magic number in chunk");
 	}
+	ChunkHeaderExtension extension;
+	if (header.size == ChunkSizeExtended) {
+		if (!from.read(reinterpret_cast< char * >(&extension), sizeof(extension))) {
+			throw std::runtime_error("Failed to read chunk header extension");
+		}
+	}
+	return chunk_info(header, extension);
+}
+
+template< typename T >
+void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *_to) {
+	assert(_to);
+	auto &to = *_to;
+
+	ChunkInfo info = read_chunk_header(from, magic);
+	if (info.size > std::numeric_limits< size_t >::max()) {
+		throw std::runtime_error("Chunk is too big to read into memory.");
+	}
+
+	if (info.flags & ChunkFlagCompressed) {
+		//compressed chunk: read the body, then inflate it into 'to':
+		std::vector< char > body(size_t(info.size));
+		if (!from.read(body.data(), body.size())) {
+			throw std::runtime_error("Failed to read chunk data.");
+		}
+		uint64_t size = inflated_size(body.data(), body.size());
+		if (size % sizeof(T) != 0) {
+			throw std::runtime_error("Size of chunk not divisible by element size");
+		}
+		to.resize(size_t(size / sizeof(T)));
+		inflate_chunk(body.data(), body.size(), reinterpret_cast< char * >(to.data()));
+		return;
+	}
 
-	if (header.size % sizeof(T) != 0) {
+	if (info.size % sizeof(T) != 0) {
 		throw std::runtime_error("Size of chunk not divisible by element size");
 	}
 
-	to.resize(header.size / sizeof(T));
+	to.resize(size_t(info.size / sizeof(T)));
 	if (!from.read(reinterpret_cast< char * >(&to[0]), to.size() * sizeof(T))) {
 		throw std::runtime_error("Failed to read chunk data.");
 	}
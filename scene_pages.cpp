@@ -0,0 +1,211 @@
+#include "ChunkFile.hpp"
+#include "write_chunk.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <tuple>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+
+//"scene_pages" splits a scene blob into spatial pages, for ScenePager to stream:
+//   scene_pages [--quantize] in.blob out.blob [cell_size=32]
+// Entries are grouped by the grid cell (of 'cell_size' on a side) their position falls in,
+// and each cell's entries are written contiguously to 'scn0'. A 'pag0' chunk lists each
+// cell's {box min, entry start, box max, entry count}, where the box is around the cell's
+// entry positions. All other chunks are copied unchanged.
+// With --quantize, the entries are instead written as 16-byte 'scq0' entries (see QuantizedEntry):
+// positions relative to their page's box, smallest-three rotations, and indices into tables of
+// mesh names ('scm0') and of the distinct scales ('scs0') in place of per-entry names and scales.
+
+struct SceneEntry {
+	uint32_t name_begin, name_end;
+	glm::vec3 position;
+	glm::quat rotation;
+	glm::vec3 scale;
+};
+static_assert(sizeof(SceneEntry) == 48, "Scene entry should be packed");
+
+struct PageEntry {
+	glm::vec3 min;
+	uint32_t entry_start;
+	glm::vec3 max;
+	uint32_t entry_count;
+};
+static_assert(sizeof(PageEntry) == 32, "Page entry should be packed");
+
+//quantized entry format (as decoded in AssetLoader.cpp):
+struct QuantizedEntry {
+	uint16_t position[3]; //fraction of the way across the page's box (in 65535ths)
+	uint16_t mesh; //index in 'scm0'
+	uint32_t rotation; //smallest three: index of the largest component in the top two bits, then the others in 10 bits each
+	uint32_t scale; //index in 'scs0'
+};
+static_assert(sizeof(QuantizedEntry) == 16, "Quantized scene entry should be packed");
+
+struct MeshName {
+	uint32_t name_begin, name_end;
+};
+static_assert(sizeof(MeshName) == 8, "Mesh name should be packed");
+
+static uint32_t quantize_rotation(glm::quat q) {
+	float length = std::sqrt(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+	if (!(length > 0.0f)) return 3U << 30 | 512 | 512 << 10 | 512 << 20; //(identity: small components at the middle of their range, i.e. about zero)
+	uint32_t largest = 0;
+	for (uint32_t c = 1; c < 4; ++c) {
+		if (std::abs(q[c]) > std::abs(q[largest])) largest = c;
+	}
+	//(q and -q are the same rotation, so make the largest component positive)
+	float sign = (q[largest] < 0.0f ? -1.0f : 1.0f) / length;
+	float const Half = 1.0f / std::sqrt(2.0f);
+	uint32_t bits = largest << 30;
+	for (uint32_t c = 0, small = 0; c < 4; ++c) {
+		if (c == largest) continue;
+		float value = std::max(-Half, std::min(Half, sign * q[c]));
+		bits |= uint32_t(std::round((value + Half) / (2.0f * Half) * 1023.0f)) << (10 * small);
+		small += 1;
+	}
+	return bits;
+}
+
+int main(int argc, char **argv) {
+	bool quantize = false;
+	std::vector< std::string > args;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--quantize") {
+			quantize = true;
+		} else {
+			args.emplace_back(arg);
+		}
+	}
+	if (args.size() < 2 || args.size() > 3) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [--quantize] in.blob out.blob [cell_size=32]" << std::endl;
+		return 1;
+	}
+	std::string in_filename = args[0];
+	std::string out_filename = args[1];
+	float cell_size = (args.size() > 2 ? std::stof(args[2]) : 32.0f);
+	if (!(cell_size > 0.0f)) {
+		std::cerr << "cell_size should be positive." << std::endl;
+		return 1;
+	}
+
+	try {
+		ChunkFile in(in_filename);
+		ChunkSpan< char > strings = in.get< char >("str0");
+		ChunkSpan< SceneEntry > scene = in.get< SceneEntry >("scn0");
+
+		//sort entries by cell (stable, so entries keep their relative order within a cell):
+		struct Cell {
+			int32_t x, y, z;
+			bool operator<(Cell const &o) const {
+				if (x != o.x) return x < o.x;
+				if (y != o.y) return y < o.y;
+				return z < o.z;
+			}
+			bool operator!=(Cell const &o) const { return x != o.x || y != o.y || z != o.z; }
+		};
+		std::vector< Cell > cells;
+		std::vector< uint32_t > order;
+		for (uint32_t i = 0; i < scene.size(); ++i) {
+			glm::vec3 const &p = scene[i].position;
+			if (!(std::abs(p.x / cell_size) < 2e9f && std::abs(p.y / cell_size) < 2e9f && std::abs(p.z / cell_size) < 2e9f)) {
+				throw std::runtime_error("scene entry " + std::to_string(i) + " has a position too far out (or not a number) to page");
+			}
+			cells.emplace_back(Cell{int32_t(std::floor(p.x / cell_size)), int32_t(std::floor(p.y / cell_size)), int32_t(std::floor(p.z / cell_size))});
+			order.emplace_back(i);
+		}
+		std::stable_sort(order.begin(), order.end(), [&cells](uint32_t a, uint32_t b) { return cells[a] < cells[b]; });
+
+		std::vector< SceneEntry > entries;
+		std::vector< PageEntry > pages;
+		for (uint32_t i = 0; i < order.size(); ++i) {
+			SceneEntry const &entry = scene[order[i]];
+			if (i == 0 || cells[order[i]] != cells[order[i - 1]]) {
+				pages.emplace_back(PageEntry{entry.position, uint32_t(entries.size()), entry.position, 0});
+			}
+			PageEntry &page = pages.back();
+			page.min = glm::min(page.min, entry.position);
+			page.max = glm::max(page.max, entry.position);
+			page.entry_count += 1;
+			entries.emplace_back(entry);
+		}
+		std::cout << "Split " << entries.size() << " entries into " << pages.size() << " pages." << std::endl;
+
+		//copy other chunks, then add the paged scene:
+		std::vector< BlobChunk > chunks;
+		bool compress = false; //compress the output if the input was compressed
+		for (ChunkFile::Entry const &entry : in.directory) {
+			std::string const &magic = entry.magic;
+			if (entry.flags & ChunkFlagCompressed) compress = true;
+			if (magic == "toc0" || magic == "toc1" || magic == "scn0" || magic == "pag0" || magic == "scq0" || magic == "scm0" || magic == "scs0") continue;
+			ChunkSpan< char > payload = in.get< char >(magic);
+			chunks.emplace_back(magic, payload.begin(), payload.size());
+		}
+		if (!quantize) {
+			chunks.emplace_back("scn0", entries);
+		} else {
+			std::vector< QuantizedEntry > quantized;
+			std::vector< MeshName > mesh_names;
+			std::vector< glm::vec3 > scales;
+			std::map< std::string, uint16_t > mesh_index;
+			std::map< std::tuple< float, float, float >, uint32_t > scale_index;
+			for (PageEntry const &page : pages) {
+				glm::vec3 extent = page.max - page.min;
+				for (uint32_t i = page.entry_start; i < page.entry_start + page.entry_count; ++i) {
+					SceneEntry const &entry = entries[i];
+					if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
+						throw std::runtime_error("scene entry " + std::to_string(i) + " has out-of-range name begin/end");
+					}
+					QuantizedEntry q;
+					for (uint32_t c = 0; c < 3; ++c) {
+						float t = (extent[c] > 0.0f ? (entry.position[c] - page.min[c]) / extent[c] : 0.0f);
+						q.position[c] = uint16_t(std::round(std::max(0.0f, std::min(1.0f, t)) * 65535.0f));
+					}
+					std::string name(strings.begin() + entry.name_begin, strings.begin() + entry.name_end);
+					auto m = mesh_index.find(name);
+					if (m == mesh_index.end()) {
+						if (mesh_names.size() > 0xffff) throw std::runtime_error("scene uses more than 65536 meshes, too many to quantize");
+						m = mesh_index.emplace(name, uint16_t(mesh_names.size())).first;
+						mesh_names.emplace_back(MeshName{entry.name_begin, entry.name_end});
+					}
+					q.mesh = m->second;
+					q.rotation = quantize_rotation(entry.rotation);
+					auto key = std::make_tuple(entry.scale.x, entry.scale.y, entry.scale.z);
+					auto f = scale_index.find(key);
+					if (f == scale_index.end()) {
+						f = scale_index.emplace(key, uint32_t(scales.size())).first;
+						scales.emplace_back(entry.scale);
+					}
+					q.scale = f->second;
+					quantized.emplace_back(q);
+				}
+			}
+			std::cout << "Quantized to " << mesh_names.size() << " meshes and " << scales.size() << " distinct scales ("
+				<< sizeof(QuantizedEntry) * quantized.size() + sizeof(MeshName) * mesh_names.size() + sizeof(glm::vec3) * scales.size()
+				<< " bytes, was " << sizeof(SceneEntry) * entries.size() << ")." << std::endl;
+			chunks.emplace_back("scq0", quantized);
+			chunks.emplace_back("scm0", mesh_names);
+			chunks.emplace_back("scs0", scales);
+		}
+		chunks.emplace_back("pag0", pages);
+
+		std::ofstream out(out_filename, std::ios::binary);
+		write_blob(out, chunks, (compress ? 4096 : 0));
+		if (!out) {
+			throw std::runtime_error("Failed to write '" + out_filename + "'");
+		}
+	} catch (std::exception &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
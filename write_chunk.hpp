@@ -0,0 +1,144 @@
+#pragma once
+
+#include "chunk_zlib.hpp"
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdint>
+
+//chunk payloads are zero-padded to a multiple of this many bytes, so every chunk stays aligned:
+constexpr uint32_t ChunkAlign = 4;
+
+//bytes of header a chunk with a (padded) payload of 'size' bytes needs:
+inline uint64_t chunk_header_size(uint64_t size) {
+	return sizeof(ChunkHeader) + (size >= ChunkSizeCompressed ? sizeof(ChunkHeaderExtension) : 0);
+}
+
+//write a chunk whose payload (or, if 'compressed', compressed chunk body) is ready:
+// (chunks of 2GB and up get an extended header; see chunk_header.hpp)
+inline void write_stored_chunk(std::ostream &to, std::string const &magic, void const *data, size_t size, bool compressed) {
+	if (magic.size() != 4) {
+		throw std::runtime_error("Chunk magic '" + magic + "' isn't four characters.");
+	}
+
+	uint32_t padding = uint32_t(-size % ChunkAlign);
+	uint64_t padded = uint64_t(size) + padding;
+	ChunkHeader header;
+	std::copy(magic.begin(), magic.end(), header.magic);
+	if (chunk_header_size(padded) == sizeof(ChunkHeader)) {
+		header.size = uint32_t(padded) | (compressed ? ChunkSizeCompressed : 0);
+		to.write(reinterpret_cast< char const * >(&header), sizeof(header));
+	} else {
+		header.size = ChunkSizeExtended;
+		ChunkHeaderExtension extension;
+		extension.version = ChunkHeaderVersion;
+		extension.flags = (compressed ? ChunkFlagCompressed : 0);
+		extension.size = padded;
+		to.write(reinterpret_cast< char const * >(&header), sizeof(header));
+		to.write(reinterpret_cast< char const * >(&extension), sizeof(extension));
+	}
+	to.write(reinterpret_cast< char const * >(data), size);
+	char const zeros[ChunkAlign] = {0};
+	to.write(zeros, padding);
+}
+
+//write a chunk in the format read_chunk and ChunkFile expect:
+// (with 'compress', the payload is stored as a compressed chunk body; see chunk_zlib.hpp)
+inline void write_chunk(std::ostream &to, std::string const &magic, void const *data, size_t size, bool compress = false) {
+	if (compress) {
+		std::vector< char > body;
+		deflate_chunk(data, size, &body);
+		write_stored_chunk(to, magic, body.data(), body.size(), true);
+	} else {
+		write_stored_chunk(to, magic, data, size, false);
+	}
+}
+
+template< typename T >
+void write_chunk(std::ostream &to, std::string const &magic, std::vector< T > const &data, bool compress = false) {
+	write_chunk(to, magic, data.data(), sizeof(T) * data.size(), compress);
+}
+
+//a whole blob is a 'toc0' chunk giving (magic, header offset, stored size, flags) for
+// every chunk that follows it -- or, if some offset or size doesn't fit in 32 bits, a 'toc1'
+// chunk giving (magic, flags, header offset, stored size) with 64-bit offsets and sizes:
+struct BlobChunk {
+	std::string magic;
+	std::vector< char > payload;
+	bool compress = false; //store as a compressed chunk
+
+	BlobChunk(std::string const &magic_, void const *data, size_t size) : magic(magic_),
+		payload(reinterpret_cast< char const * >(data), reinterpret_cast< char const * >(data) + size) { }
+	template< typename T >
+	BlobChunk(std::string const &magic_, std::vector< T > const &data) : BlobChunk(magic_, data.data(), sizeof(T) * data.size()) { }
+};
+
+//write chunks, preceded by a 'toc0' chunk:
+// (if 'compress_over' is non-zero, chunks with payloads at least that big are compressed too)
+inline void write_blob(std::ostream &to, std::vector< BlobChunk > const &chunks, size_t compress_over = 0) {
+	struct TocEntry {
+		char magic[4];
+		uint32_t offset; //of the chunk's header, from the start of the blob
+		uint32_t size;
+		uint32_t flags;
+	};
+	static_assert(sizeof(TocEntry) == 16, "toc entry is packed");
+	struct TocEntry64 {
+		char magic[4];
+		uint32_t flags;
+		uint64_t offset;
+		uint64_t size;
+	};
+	static_assert(sizeof(TocEntry64) == 24, "toc1 entry is packed");
+
+	//compress first, so the table of contents has stored sizes:
+	std::vector< std::vector< char > > bodies(chunks.size());
+	std::vector< bool > compressed(chunks.size(), false);
+	for (size_t i = 0; i < chunks.size(); ++i) {
+		if (chunks[i].magic.size() != 4) {
+			throw std::runtime_error("Chunk magic '" + chunks[i].magic + "' isn't four characters.");
+		}
+		if (chunks[i].compress || (compress_over != 0 && chunks[i].payload.size() >= compress_over)) {
+			deflate_chunk(chunks[i].payload.data(), chunks[i].payload.size(), &bodies[i]);
+			compressed[i] = true;
+		}
+	}
+
+	//lay out the chunks after a table of contents with 'entry_size'-byte entries:
+	std::vector< TocEntry64 > toc(chunks.size());
+	auto layout = [&](uint64_t entry_size) {
+		uint64_t toc_size = entry_size * toc.size();
+		uint64_t offset = chunk_header_size(toc_size) + toc_size;
+		for (size_t i = 0; i < chunks.size(); ++i) {
+			uint64_t size = (compressed[i] ? bodies[i] : chunks[i].payload).size();
+			size += -size % ChunkAlign;
+			std::copy(chunks[i].magic.begin(), chunks[i].magic.end(), toc[i].magic);
+			toc[i].flags = (compressed[i] ? ChunkFlagCompressed : 0);
+			toc[i].offset = offset;
+			toc[i].size = size;
+			offset += chunk_header_size(size) + size;
+		}
+		return offset;
+	};
+
+	if (layout(sizeof(TocEntry)) <= 0xffffffffULL) {
+		std::vector< TocEntry > toc32(toc.size());
+		for (size_t i = 0; i < toc.size(); ++i) {
+			std::copy(toc[i].magic, toc[i].magic + 4, toc32[i].magic);
+			toc32[i].offset = uint32_t(toc[i].offset);
+			toc32[i].size = uint32_t(toc[i].size);
+			toc32[i].flags = toc[i].flags;
+		}
+		write_chunk(to, "toc0", toc32);
+	} else {
+		layout(sizeof(TocEntry64));
+		write_chunk(to, "toc1", toc);
+	}
+	for (size_t i = 0; i < chunks.size(); ++i) {
+		std::vector< char > const &stored = (compressed[i] ? bodies[i] : chunks[i].payload);
+		write_stored_chunk(to, chunks[i].magic, stored.data(), stored.size(), compressed[i]);
+	}
+}